@@ -0,0 +1,157 @@
+/**
+ * @file    can_ll_bench_example.c
+ * @author  syhanjin
+ * @date    2025-10-17
+ * @brief   benchmark of the register-level bxCAN path against the HAL path
+ *
+ * 使用 DWT 周期计数器分别测量 HAL_CAN_AddTxMessage / HAL_CAN_GetRxMessage 与
+ * CAN_LL_AddTxMessage / CAN_LL_GetRxMessage 每帧消耗的周期数。
+ *
+ * --------------------------------------------------------------------------
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Project repository: https://github.com/HITSZ-WTR2026/motor_drivers
+ */
+
+#include "bsp/can_driver.h"
+#include "can.h"
+
+#ifdef CAN_LL
+
+#    define CAN_BENCH_ROUNDS (1000U)
+
+/**
+ * 测量结果，在调试器中查看
+ */
+typedef struct
+{
+    uint32_t rounds;   ///< 完成的收发次数
+    uint32_t hal_tx;   ///< HAL_CAN_AddTxMessage 平均周期数
+    uint32_t hal_rx;   ///< HAL_CAN_GetRxMessage 平均周期数
+    uint32_t ll_tx;    ///< CAN_LL_AddTxMessage 平均周期数
+    uint32_t ll_rx;    ///< CAN_LL_GetRxMessage 平均周期数
+    uint32_t timeouts; ///< 等待回环帧超时的次数
+} CAN_Bench_t;
+
+volatile CAN_Bench_t can_bench;
+
+typedef HAL_StatusTypeDef (*CAN_BenchTx_t)(CAN_HandleTypeDef*         hcan,
+                                           const CAN_TxHeaderTypeDef* header,
+                                           const uint8_t              data[],
+                                           uint32_t*                  mailbox);
+typedef HAL_StatusTypeDef (*CAN_BenchRx_t)(CAN_HandleTypeDef*   hcan,
+                                           uint32_t             fifo,
+                                           CAN_RxHeaderTypeDef* header,
+                                           uint8_t              data[]);
+
+/**
+ * 发送一帧并等待回环接收，分别累加发送和接收函数的周期数
+ * @return 是否收到回环帧
+ */
+static bool bench_round(const CAN_BenchTx_t tx,
+                        const CAN_BenchRx_t rx,
+                        uint32_t*           tx_cycles,
+                        uint32_t*           rx_cycles)
+{
+    static const CAN_TxHeaderTypeDef header = {
+        .StdId = 0x200, .IDE = CAN_ID_STD, .RTR = CAN_RTR_DATA, .DLC = 8
+    };
+    uint8_t  data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint32_t mailbox;
+
+    // 关中断测量，避免计入中断的时间
+    __disable_irq();
+    uint32_t start = DWT->CYCCNT;
+    tx(&hcan1, &header, data, &mailbox);
+    *tx_cycles += DWT->CYCCNT - start;
+    __enable_irq();
+
+    const uint32_t tick = HAL_GetTick();
+    while (HAL_CAN_GetRxFifoFillLevel(&hcan1, CAN_RX_FIFO0) == 0)
+        if (HAL_GetTick() - tick > CAN_SEND_TIMEOUT)
+            return false;
+
+    CAN_RxHeaderTypeDef rx_header;
+    __disable_irq();
+    start = DWT->CYCCNT;
+    rx(&hcan1, CAN_RX_FIFO0, &rx_header, data);
+    *rx_cycles += DWT->CYCCNT - start;
+    __enable_irq();
+    return true;
+}
+
+/**
+ * 运行测量
+ *
+ * 需要在 STM32CubeMX 中把 CAN1 设置为 Loopback 模式（不需要连接总线），
+ * 并且不要开启 CAN1 的接收中断，帧由本函数轮询读取
+ */
+void CAN_Bench_Run()
+{
+    /**
+     * Step0: 放行所有标准帧到 FIFO0
+     */
+    CAN_ConfigFilter(&hcan1,
+                     &(CAN_FilterTypeDef) {
+                             .FilterFIFOAssignment = CAN_FILTER_FIFO0,
+                             .FilterBank           = 0,
+                             .FilterMode           = CAN_FILTERMODE_IDMASK,
+                             .FilterScale          = CAN_FILTERSCALE_32BIT,
+                             .FilterActivation     = ENABLE,
+                             .SlaveStartFilterBank = CAN_SLAVE_START_FILTER_BANK,
+                     },
+                     NULL);
+
+    /**
+     * Step1: 启动 CAN，不开启接收中断
+     *
+     * CAN_Start 同时会开启 DWT 周期计数器
+     */
+    CAN_Start(&hcan1, 0);
+
+    /**
+     * Step2: 交替测量 HAL 路径与寄存器路径
+     */
+    uint32_t hal_tx = 0, hal_rx = 0, ll_tx = 0, ll_rx = 0, rounds = 0, timeouts = 0;
+    for (uint32_t i = 0; i < CAN_BENCH_ROUNDS; i++)
+    {
+        uint32_t cycles[4] = { 0 };
+        if (!bench_round(HAL_CAN_AddTxMessage, HAL_CAN_GetRxMessage, &cycles[0], &cycles[1]) ||
+            !bench_round(CAN_LL_AddTxMessage, CAN_LL_GetRxMessage, &cycles[2], &cycles[3]))
+        {
+            timeouts++;
+            continue;
+        }
+        hal_tx += cycles[0];
+        hal_rx += cycles[1];
+        ll_tx  += cycles[2];
+        ll_rx  += cycles[3];
+        rounds++;
+    }
+
+    /**
+     * Step3: 保存结果
+     */
+    can_bench.rounds   = rounds;
+    can_bench.timeouts = timeouts;
+    if (rounds > 0)
+    {
+        can_bench.hal_tx = hal_tx / rounds;
+        can_bench.hal_rx = hal_rx / rounds;
+        can_bench.ll_tx  = ll_tx / rounds;
+        can_bench.ll_rx  = ll_rx / rounds;
+    }
+}
+
+#endif
@@ -50,6 +50,13 @@ Motor_VelCtrl_t vel_dji;
  */
 void TIM_Callback(TIM_HandleTypeDef* htim)
 {
+#ifdef CAN_RX_DEFERRED
+    /**
+     * 延迟解包模式下，接收中断只拷贝原始帧，在控制计算之前统一解包
+     */
+    CAN_ProcessRxQueue(&hcan1);
+#endif
+
     /**
      * 进行 PID 计算
      *
@@ -61,10 +68,9 @@ void TIM_Callback(TIM_HandleTypeDef* htim)
     /**
      * 发送控制信号
      *
-     * IQ_CMD_GROUP_1_4 和 IQ_CMD_GROUP_5_8 代表发送的电调 ID 组
+     * 只发送有电机注册的控制帧，也可以用 DJI_SendSetIqCommand 按电调 ID 组发送
      */
-    DJI_SendSetIqCommand(&hcan1, IQ_CMD_GROUP_1_4);
-    // DJI_SendSetIqCommand(&hcan1, IQ_CMD_GROUP_5_8);
+    DJI_SendCommands(&hcan1);
 }
 
 void DJI_Control_Init()
@@ -73,19 +79,19 @@ void DJI_Control_Init()
      * Step0: 初始化 CAN 过滤器
      *
      * 默认使用一个过滤器 + 掩码模式
-     * 亦可以使用其他过滤器模式，处理函数与使用什么过滤器无关，只要保证数据能被接收到即可
+     * 过滤器会按 FilterMatchIndex 绑定 DJI_CAN_BaseReceiveCallback，该过滤器收到的帧只会交给 DJI 驱动
      */
     DJI_CAN_FilterInit(&hcan1, 0);
 
     /**
-     * Step1: 注册 DJI CAN 处理回调
+     * Step1: 注册 CAN 处理回调
      *
      * 需要在 STM32CubeMX -> `Project Manager` -> `Advanced Settings`
      *  -> `Register Callback` 中启用 CAN 回调
      *
      * 一般情况下我们只使用 Fifo0，因为 Fifo0 的优先度比 Fifo1 高，当然也可以两个都使用
+     * 使用自定义过滤器时，可以用 CAN_RegisterIdRangeCallback 或 CAN_RegisterCallback 注册回调
      */
-    CAN_RegisterCallback(&hcan1, DJI_CAN_BaseReceiveCallback);
     HAL_CAN_RegisterCallback(&hcan1, HAL_CAN_RX_FIFO0_MSG_PENDING_CB_ID, CAN_Fifo0ReceiveCallback);
     // HAL_CAN_RegisterCallback(&hcan1, HAL_CAN_RX_FIFO1_MSG_PENDING_CB_ID,
     // DJI_CAN_Fifo1ReceiveCallback);
@@ -49,10 +49,16 @@ Motor_PosCtrl_t pos_dm;
  *
  */
 Motor_VelCtrl_t vel_dm;
-uint32_t        prescaler = 0;
+uint32_t        prescaler  = 0;
+bool            dm_enabled = false;
 
 void DM_TIM_Callback(TIM_HandleTypeDef* htim)
 {
+    if (!dm_enabled)
+    {
+        // DM_Init 不会使能电机，由使能状态机发送并确认，全部确认后不再调用
+        dm_enabled = DM_EnableProcess(&hcan1) == 0;
+    }
     ++prescaler;
     Motor_PosCtrlUpdate(&pos_dm); // 位置控制函数，目前只支持定速度控制，速度为初始化电机时的VEL_MAX
     if (prescaler == 5)
@@ -62,13 +68,32 @@ void DM_TIM_Callback(TIM_HandleTypeDef* htim)
         Motor_VelCtrlUpdate(&vel_dm);
         // Motor_VelCtrlUpdate(&vel_dm);
     }
+#ifdef DM_CMD_COALESCE
+    DM_FlushCmd(&hcan1); // 控制周期结尾统一发送指令槽中的指令
+#endif
 }
 
 void DM_Control_Init()
 {
     /**
      *
-     * 初始化can滤波器
+     * 电机初始化，位置、速度、力矩最大参数需与调试助手初始化一致
+     * 如果使用位置速度模式，需要把VEL_MAX设置成自己想要的运行速度。
+     *
+     */
+    DM_Init(&dm,
+            &(DM_Config_t) { .hcan        = &hcan1,
+                             .id0         = 0,
+                             .POS_MAX_RAD = 3.1416,
+                             .VEL_MAX_RAD = 40,
+                             .T_MAX       = 10,
+                             .mode        = DM_MODE_VEL,
+                             .motor_type  = DM_S3519,
+                             .reverse     = false });
+
+    /**
+     *
+     * 初始化can滤波器，根据已注册电机的反馈 ID 生成，必须在 DM_Init 之后调用
      */
     DM_CAN_FilterInit(&hcan1, 0);
 
@@ -86,21 +111,6 @@ void DM_Control_Init()
      */
     CAN_Start(&hcan1, CAN_IT_RX_FIFO0_MSG_PENDING);
 
-    /**
-     *
-     * 电机初始化，位置、速度、力矩最大参数需与调试助手初始化一致
-     * 如果使用位置速度模式，需要把VEL_MAX设置成自己想要的运行速度。
-     *
-     */
-    DM_Init(&dm,
-            &(DM_Config_t) { .hcan        = &hcan1,
-                             .id0         = 0,
-                             .POS_MAX_RAD = 3.1416,
-                             .VEL_MAX_RAD = 40,
-                             .T_MAX       = 10,
-                             .mode        = DM_MODE_VEL,
-                             .motor_type  = DM_S3519 });
-
     /**
      * 位置控制实例初始化
      *
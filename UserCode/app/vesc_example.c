@@ -63,6 +63,12 @@ void VESC_TIM_Callback(TIM_HandleTypeDef* htim)
         Motor_VelCtrlUpdate(&vesc_vel_ctrl);
     }
     Motor_PosCtrlUpdate(&vesc_pos_ctrl);
+#ifdef VESC_CMD_COALESCE
+    /**
+     * 控制周期结尾统一发送指令槽中的指令
+     */
+    VESC_FlushCmd(&hcan1);
+#endif
 }
 
 void VESC_Control_Init()
@@ -83,19 +89,14 @@ void VESC_Control_Init()
      *
      * 我们只使用 Fifo0，因为 Fifo0 的优先度比 Fifo1 高
      */
-    HAL_CAN_RegisterCallback(&hcan1,
-                             HAL_CAN_RX_FIFO0_MSG_PENDING_CB_ID,
-                             VESC_CAN_Fifo0ReceiveCallback);
+    HAL_CAN_RegisterCallback(&hcan1, HAL_CAN_RX_FIFO0_MSG_PENDING_CB_ID, CAN_Fifo0ReceiveCallback);
 
     /**
      * Step2: 启动 CAN
      *
      * CAN 必须在注册回调后再启用，否则回调无法正常注册，同样地，我们也只使用 Fifo0
-     * @note: 如果同时启用 DJI 和
-     VESC，你需要另定义一个回调处理函数，手动获取数据并手动调用以下两个函数 void
-     VESC_CAN_BaseReceiveCallback(CAN_HandleTypeDef* hcan, CAN_RxHeaderTypeDef* header, uint8_t
-     data[]) void DJI_CAN_BaseReceiveCallback(CAN_HandleTypeDef* hcan, CAN_RxHeaderTypeDef* header,
-     uint8_t data[])
+     * @note: 同时启用 DJI 和 VESC 时，只需分别调用 DJI_CAN_FilterInit 和 VESC_CAN_FilterInit
+     *        (使用不同的过滤器编号)，CAN_Fifo0ReceiveCallback 会按 FilterMatchIndex 把帧交给对应的驱动
      */
     CAN_Start(&hcan1, CAN_IT_RX_FIFO0_MSG_PENDING);
 
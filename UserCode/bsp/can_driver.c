@@ -22,195 +22,2559 @@
  */
 #include "can_driver.h"
 
+#include <stdbool.h>
+#include <string.h>
+
 #ifdef __cplusplus
 extern "C"
 {
-#endif
+#endif
+
+#include "cmsis_compiler.h"
+
+#if (CAN_TX_QUEUE_SIZE & (CAN_TX_QUEUE_SIZE - 1)) != 0
+#    error "CAN_TX_QUEUE_SIZE must be a power of 2"
+#endif
+#if (CAN_TX_TELEMETRY_QUEUE_SIZE & (CAN_TX_TELEMETRY_QUEUE_SIZE - 1)) != 0
+#    error "CAN_TX_TELEMETRY_QUEUE_SIZE must be a power of 2"
+#endif
+#if CAN_TX_TELEMETRY_SLOTS >= CAN_TX_SLOT_NUM
+#    error "CAN_TX_TELEMETRY_SLOTS must leave at least one mailbox for control frames"
+#endif
+
+#ifdef CAN_RX_DEFERRED
+#    if (CAN_RX_QUEUE_SIZE & (CAN_RX_QUEUE_SIZE - 1)) != 0
+#        error "CAN_RX_QUEUE_SIZE must be a power of 2"
+#    endif
+
+typedef struct
+{
+    CAN_RxHeaderTypeDef       header;
+    uint8_t                   data[CAN_MAX_DATA_LEN];
+    uint32_t                  fifo;
+    CAN_FifoReceiveCallback_t callback; ///< NULL 表示按 can_dispatch 分发
+} CAN_RxFrame;
+
+/**
+ * 单生产者（接收中断）单消费者（控制任务）无锁队列
+ *
+ * head 只由中断写，tail 只由控制任务写。FIFO0 和 FIFO1 的接收中断必须是同一优先级，
+ * 否则两个中断互相抢占时会出现两个生产者
+ */
+typedef struct
+{
+    CAN_RxFrame       frames[CAN_RX_QUEUE_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+} CAN_RxQueue;
+#endif
+
+#ifdef CAN_CAPTURE
+#    if (CAN_CAPTURE_SIZE & (CAN_CAPTURE_SIZE - 1)) != 0
+#        error "CAN_CAPTURE_SIZE must be a power of 2"
+#    endif
+
+_Static_assert(sizeof(CAN_CaptureRecord_t) == 20, "CAN_CaptureRecord_t must be 20 bytes");
+
+/**
+ * 录制缓冲区，所有总线共用
+ *
+ * 接收中断、发送邮箱中断和任务都可能写入，写入在临界区内完成；只有 CAN_CaptureFlush 读出
+ */
+typedef struct
+{
+    CAN_CaptureRecord_t records[CAN_CAPTURE_SIZE];
+    volatile uint32_t   head; ///< 写入位置，只增不减，取模得到下标
+    volatile uint32_t   tail; ///< 读出位置
+    volatile bool       enabled;
+    uint32_t            recorded;
+    uint32_t            dropped;
+} CAN_Capture;
+
+static CAN_Capture capture;
+#endif
+
+#ifdef CAN_STATS
+#    if (CAN_STATS_ID_NUM & (CAN_STATS_ID_NUM - 1)) != 0
+#        error "CAN_STATS_ID_NUM must be a power of 2"
+#    endif
+
+/**
+ * 每条总线的统计数据
+ *
+ * counters.ids 是以 ID 为键的开放寻址哈希表，CAN_GetStats 输出快照时再压缩成连续数组
+ */
+typedef struct
+{
+    CAN_Stats_t counters;
+    bool        id_used[CAN_STATS_ID_NUM];
+    uint32_t    mailbox_cycles[CAN_TX_SLOT_NUM]; ///< 各发送邮箱写入时的 DWT 周期计数
+    uint32_t    window_tick;       ///< 上次快照的 HAL_GetTick
+    uint32_t    window_bits;       ///< 上次快照时的 counters.bits
+} CAN_StatsData;
+#endif
+
+/**
+ * 32 位微秒时基，由 DWT 周期计数器累加得到
+ */
+typedef struct
+{
+    uint32_t cycles; ///< 上次更新时的 DWT 周期计数
+    uint32_t rem;    ///< 不足 1 us 的周期数
+    uint32_t us;     ///< 当前时间 (unit: us)
+    uint32_t tick;   ///< 上次更新时的 HAL_GetTick
+} CAN_Clock;
+
+static CAN_Clock can_clock;
+
+#ifdef CAN_HW_TIMESTAMP
+/**
+ * 把 bxCAN 的 16 位位时间计数器扩展到 CAN_Clock 时基
+ */
+typedef struct
+{
+    bool     valid;      ///< 是否已对齐
+    uint16_t last_hw;    ///< 上一帧的硬件时间戳 (unit: bit)
+    uint32_t last_us;    ///< 上一帧的时间戳 (unit: us)
+    uint32_t rem_ns;     ///< 不足 1 us 的部分
+    uint32_t ns_per_bit; ///< 位时间 (unit: ns)，0 表示不可用
+} CAN_RxClock;
+#endif
+
+typedef struct
+{
+    CAN_TxHeaderTypeDef header;
+    uint8_t             data[CAN_MAX_DATA_LEN];
+    uint32_t            enqueue_cycles; ///< 入队时的 DWT 周期计数
+} CAN_TxFrame;
+
+typedef struct
+{
+    CAN_TxFrame*        frames;
+    uint32_t            size; ///< 队列长度，2 的幂
+    uint32_t            head; ///< 写入位置，只增不减，取模得到下标
+    uint32_t            tail; ///< 读出位置
+    CAN_TxQueuePolicy_t policy;
+    CAN_TxStats_t       stats;
+    uint32_t            max_wait_cycles; ///< 最长排队时间 (unit: DWT 周期)
+} CAN_TxQueue;
+
+typedef struct
+{
+    uint32_t ide;
+    uint32_t id_min;
+    uint32_t id_max;
+    uint8_t  handler; ///< handlers 下标
+} CAN_IdRange;
+
+typedef struct
+{
+    uint32_t ide;
+    uint32_t id;
+    uint32_t mask;    ///< 全 1 表示精确匹配
+    uint8_t  handler; ///< handlers 下标
+} CAN_FilterEntry;
+
+typedef struct
+{
+    CAN_HandleTypeDef* hcan;
+
+    /* 广播回调：没有被过滤器编号或 ID 范围认领的帧会交给所有广播回调 */
+    CAN_FifoReceiveCallback_t callbacks[CAN_MAX_CALLBACK_NUM];
+    uint32_t                  callback_count;
+
+    /* 定向回调：每一帧只会交给唯一的处理函数 */
+    CAN_FifoReceiveCallback_t handlers[CAN_MAX_CALLBACK_NUM];
+    uint32_t                  handler_count;
+    uint8_t     filter_handlers[2][CAN_FILTER_INDEX_NUM]; ///< [fifo][FilterMatchIndex] 0 表示未绑定
+    CAN_IdRange id_ranges[CAN_MAX_ID_RANGE_NUM];
+    uint32_t    id_range_count;
+
+    /* 过滤器规划：由各驱动的 Init 登记，CAN_FilterApply 统一写入硬件 */
+    CAN_FilterEntry filter_entries[CAN_MAX_FILTER_ENTRY_NUM];
+    uint32_t        filter_entry_count;
+#ifdef CAN_USE_FDCAN
+    uint32_t filter_std_count; ///< 已使用的标准帧过滤器元素
+    uint32_t filter_ext_count; ///< 已使用的扩展帧过滤器元素
+#endif
+
+    CAN_TxFrame   tx_frames[CAN_TX_QUEUE_SIZE];
+    CAN_TxFrame   telemetry_frames[CAN_TX_TELEMETRY_QUEUE_SIZE];
+    CAN_TxQueue   tx[CAN_TX_PRIO_NUM];
+    uint32_t      telemetry_slots; ///< 被低优先级帧占用的发送邮箱（位图）
+    CAN_RxStats_t rx;
+#ifdef CAN_HW_TIMESTAMP
+    CAN_RxClock rx_clock;
+#endif
+#ifdef CAN_RX_DEFERRED
+    CAN_RxQueue rx_queue;
+#endif
+#ifdef CAN_STATS
+    CAN_StatsData stats;
+#endif
+#if defined(CAN_USE_FDCAN) && defined(CAN_FD_PACK)
+    struct
+    {
+        bool     enabled;
+        uint8_t  data[CAN_MAX_DATA_LEN];
+        uint32_t size; ///< 已写入的字节数
+    } pack;
+#endif
+} CAN_CallbackMap;
+
+static CAN_CallbackMap maps[CAN_NUM];
+static size_t          map_size = 0;
+
+static CAN_CallbackMap* get_map(const CAN_HandleTypeDef* hcan)
+{
+    for (size_t i = 0; i < map_size; i++)
+        if (maps[i].hcan == hcan)
+            return &maps[i];
+
+    return NULL;
+}
+
+/**
+ * 获取 hcan 对应的 map，不存在时新建
+ * @attention 本函数非线程安全，只应在初始化阶段被调用
+ */
+static CAN_CallbackMap* get_or_create_map(CAN_HandleTypeDef* hcan)
+{
+    CAN_CallbackMap* map = get_map(hcan);
+    if (map != NULL)
+        return map;
+    if (map_size >= CAN_NUM)
+    {
+        CAN_ERROR_HANDLER();
+        return NULL;
+    }
+    map = &maps[map_size++];
+    memset(map, 0, sizeof(CAN_CallbackMap));
+    map->hcan                             = hcan;
+    map->tx[CAN_TX_PRIO_CONTROL].frames   = map->tx_frames;
+    map->tx[CAN_TX_PRIO_CONTROL].size     = CAN_TX_QUEUE_SIZE;
+    map->tx[CAN_TX_PRIO_TELEMETRY].frames = map->telemetry_frames;
+    map->tx[CAN_TX_PRIO_TELEMETRY].size   = CAN_TX_TELEMETRY_QUEUE_SIZE;
+    return map;
+}
+
+/**
+ * 获取定向回调的编号（从 1 开始），不存在时添加
+ * @return 编号，0 表示失败
+ */
+static uint8_t get_or_add_handler(CAN_CallbackMap* map, const CAN_FifoReceiveCallback_t callback)
+{
+    for (uint32_t i = 0; i < map->handler_count; i++)
+        if (map->handlers[i] == callback)
+            return i + 1;
+    if (map->handler_count >= CAN_MAX_CALLBACK_NUM)
+    {
+        CAN_ERROR_HANDLER();
+        return 0;
+    }
+    map->handlers[map->handler_count++] = callback;
+    return map->handler_count;
+}
+
+#ifndef CAN_USE_FDCAN
+/**
+ * 获取过滤器寄存器所在的 CAN 外设，与 HAL_CAN_ConfigFilter 保持一致
+ */
+static CAN_TypeDef* get_filter_instance(const CAN_HandleTypeDef* hcan)
+{
+#if defined(CAN3)
+    return hcan->Instance == CAN3 ? CAN3 : CAN1;
+#elif defined(CAN2)
+    (void) hcan;
+    return CAN1;
+#else
+    return hcan->Instance;
+#endif
+}
+
+/**
+ * 获取总线的中断号
+ * @param hcan can handle
+ * @param irqs 输出发送、FIFO0 接收、FIFO1 接收中断号
+ */
+static void get_irqs(const CAN_HandleTypeDef* hcan, IRQn_Type irqs[3])
+{
+#if defined(CAN3)
+    if (hcan->Instance == CAN3)
+    {
+        irqs[0] = CAN3_TX_IRQn;
+        irqs[1] = CAN3_RX0_IRQn;
+        irqs[2] = CAN3_RX1_IRQn;
+        return;
+    }
+#endif
+#if defined(CAN2)
+    if (hcan->Instance == CAN2)
+    {
+        irqs[0] = CAN2_TX_IRQn;
+        irqs[1] = CAN2_RX0_IRQn;
+        irqs[2] = CAN2_RX1_IRQn;
+        return;
+    }
+#endif
+    (void) hcan;
+    irqs[0] = CAN1_TX_IRQn;
+    irqs[1] = CAN1_RX0_IRQn;
+    irqs[2] = CAN1_RX1_IRQn;
+}
+
+/**
+ * 计算过滤器组对应的第一个 FilterMatchIndex
+ *
+ * FilterMatchIndex 在同一个 FIFO 内对过滤器逐个编号，与过滤器组是否启用无关：
+ * 32 位掩码模式占 1 个编号，32 位列表和 16 位掩码模式占 2 个，16 位列表模式占 4 个
+ * @param hcan can handle
+ * @param bank 过滤器组
+ * @param count 输出该过滤器组占用的编号数
+ * @return 第一个编号
+ */
+static uint32_t get_filter_match_index(const CAN_HandleTypeDef* hcan,
+                                       const uint32_t           bank,
+                                       uint32_t*                count)
+{
+    const CAN_TypeDef* can_ip = get_filter_instance(hcan);
+
+    uint32_t first_bank = 0;
+#if defined(CAN2)
+    if (hcan->Instance == CAN2)
+        first_bank = (can_ip->FMR & CAN_FMR_CAN2SB) >> CAN_FMR_CAN2SB_Pos;
+#endif
+
+    const uint32_t fifo  = (can_ip->FFA1R >> bank) & 1U;
+    uint32_t       index = 0;
+    for (uint32_t b = first_bank; b <= bank; b++)
+    {
+        if (((can_ip->FFA1R >> b) & 1U) != fifo)
+            continue;
+        const uint32_t scale32 = (can_ip->FS1R >> b) & 1U;
+        const uint32_t list    = (can_ip->FM1R >> b) & 1U;
+        const uint32_t n       = (scale32 ? 1U : 2U) << list;
+        if (b == bank)
+            *count = n;
+        else
+            index += n;
+    }
+    return index;
+}
+#endif
+
+#if defined(__CORTEX_M) && (__CORTEX_M >= 3U) && (CAN_IRQ_PRIORITY > 0)
+#    define CAN_CRITICAL_BASEPRI
+#endif
+
+/**
+ * 进入临界区，屏蔽优先级不高于 CAN_IRQ_PRIORITY 的中断
+ *
+ * 临界区内只做入队 / 出队和写邮箱，耗时为常数。__set_BASEPRI_MAX 只会提高屏蔽等级，
+ * 在已经屏蔽了更多中断的上下文中嵌套调用也是安全的
+ * @return 进入前的 BASEPRI (或 PRIMASK)
+ */
+static inline uint32_t can_enter_critical(void)
+{
+#ifdef USE_FULL_ASSERT
+    // 比 CAN_IRQ_PRIORITY 更优先的中断无法被屏蔽，不能调用 can_driver
+    const uint32_t ipsr = __get_IPSR();
+    if (ipsr >= 16U && NVIC_GetPriority((IRQn_Type) (ipsr - 16U)) < CAN_IRQ_PRIORITY)
+        CAN_ERROR_HANDLER();
+#endif
+#ifdef CAN_CRITICAL_BASEPRI
+    const uint32_t basepri = __get_BASEPRI();
+    __set_BASEPRI_MAX(CAN_IRQ_PRIORITY << (8U - __NVIC_PRIO_BITS));
+    return basepri;
+#else
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+#endif
+}
+
+static inline void can_exit_critical(const uint32_t mask)
+{
+#ifdef CAN_CRITICAL_BASEPRI
+    __set_BASEPRI(mask);
+#else
+    __set_PRIMASK(mask);
+#endif
+}
+
+#ifdef CAN_USE_FDCAN
+/* FDCAN 后端：把兼容层的 bxCAN 风格参数换算为 FDCAN HAL 的参数 */
+
+static const uint8_t fdcan_dlc_bytes[16] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64,
+};
+
+static const uint32_t fdcan_dlc_codes[16] = {
+    FDCAN_DLC_BYTES_0,  FDCAN_DLC_BYTES_1,  FDCAN_DLC_BYTES_2,  FDCAN_DLC_BYTES_3,
+    FDCAN_DLC_BYTES_4,  FDCAN_DLC_BYTES_5,  FDCAN_DLC_BYTES_6,  FDCAN_DLC_BYTES_7,
+    FDCAN_DLC_BYTES_8,  FDCAN_DLC_BYTES_12, FDCAN_DLC_BYTES_16, FDCAN_DLC_BYTES_20,
+    FDCAN_DLC_BYTES_24, FDCAN_DLC_BYTES_32, FDCAN_DLC_BYTES_48, FDCAN_DLC_BYTES_64,
+};
+
+/**
+ * 数据字节数换算为 DLC 编号，不是合法的 FD 长度时向上取整
+ */
+static uint32_t fdcan_dlc_index(const uint32_t bytes)
+{
+    uint32_t index = 0;
+    while (index < 15U && fdcan_dlc_bytes[index] < bytes)
+        index++;
+    return index;
+}
+
+static uint32_t fdcan_dlc_to_bytes(const uint32_t code)
+{
+    for (uint32_t i = 0; i < 16U; i++)
+        if (fdcan_dlc_codes[i] == code)
+            return fdcan_dlc_bytes[i];
+    return 0;
+}
+
+static inline uint32_t fdcan_rx_location(const uint32_t fifo)
+{
+    return fifo == CAN_RX_FIFO0 ? FDCAN_RX_FIFO0 : FDCAN_RX_FIFO1;
+}
+
+static inline uint32_t port_tx_free_level(CAN_HandleTypeDef* hcan)
+{
+    return HAL_FDCAN_GetTxFifoFreeLevel(hcan);
+}
+
+/**
+ * @param mailbox 发送缓冲区对应的位
+ * @return 该缓冲区中的帧是否仍在等待发送
+ */
+static inline bool port_tx_pending(CAN_HandleTypeDef* hcan, const uint32_t mailbox)
+{
+    return HAL_FDCAN_IsTxBufferMessagePending(hcan, mailbox) != 0U;
+}
+
+static inline bool port_is_fd(const CAN_TxHeaderTypeDef* header)
+{
+    return header->FDFormat != CAN_FD_CLASSIC;
+}
+
+/**
+ * 写入发送 FIFO
+ * @param mailbox 输出写入的发送缓冲区 (FDCAN_TX_BUFFERx)
+ */
+static HAL_StatusTypeDef port_add_tx_message(CAN_HandleTypeDef*         hcan,
+                                             const CAN_TxHeaderTypeDef* header,
+                                             const uint8_t              data[],
+                                             uint32_t*                  mailbox)
+{
+    const bool     fd     = port_is_fd(header);
+    const bool     ext    = header->IDE == CAN_ID_EXT;
+    const bool     remote = header->RTR == CAN_RTR_REMOTE;
+    const uint32_t dlc    = fdcan_dlc_index(fd || header->DLC <= 8 ? header->DLC : 8);
+
+    const FDCAN_TxHeaderTypeDef tx_header = {
+        .Identifier          = ext ? header->ExtId : header->StdId,
+        .IdType              = ext ? FDCAN_EXTENDED_ID : FDCAN_STANDARD_ID,
+        .TxFrameType         = remote ? FDCAN_REMOTE_FRAME : FDCAN_DATA_FRAME,
+        .DataLength          = fdcan_dlc_codes[dlc],
+        .ErrorStateIndicator = FDCAN_ESI_ACTIVE,
+        .BitRateSwitch       = header->FDFormat == CAN_FD_BRS ? FDCAN_BRS_ON : FDCAN_BRS_OFF,
+        .FDFormat            = fd ? FDCAN_FD_CAN : FDCAN_CLASSIC_CAN,
+        .TxEventFifoControl  = FDCAN_NO_TX_EVENTS,
+        .MessageMarker       = 0,
+    };
+
+    // HAL 按 DataLength 读取数据，长度向上取整时补零
+    uint8_t padded[CAN_MAX_DATA_LEN];
+    if (fdcan_dlc_bytes[dlc] > header->DLC)
+    {
+        memset(padded, 0, sizeof(padded));
+        memcpy(padded, data, header->DLC);
+        data = padded;
+    }
+
+    FDCAN_TxHeaderTypeDef*  tx     = (FDCAN_TxHeaderTypeDef*) &tx_header;
+    const HAL_StatusTypeDef status = HAL_FDCAN_AddMessageToTxFifoQ(hcan, tx, (uint8_t*) data);
+    if (status == HAL_OK)
+        *mailbox = HAL_FDCAN_GetLatestTxFifoQRequestBuffer(hcan);
+    return status;
+}
+
+static inline uint32_t port_rx_fill_level(CAN_HandleTypeDef* hcan, const uint32_t fifo)
+{
+    return HAL_FDCAN_GetRxFifoFillLevel(hcan, fdcan_rx_location(fifo));
+}
+
+/**
+ * 读取一帧并转换为兼容层的帧头
+ */
+static HAL_StatusTypeDef port_get_rx_message(CAN_HandleTypeDef*   hcan,
+                                             const uint32_t       fifo,
+                                             CAN_RxHeaderTypeDef* header,
+                                             uint8_t              data[])
+{
+    FDCAN_RxHeaderTypeDef   rx_header;
+    const HAL_StatusTypeDef status =
+            HAL_FDCAN_GetRxMessage(hcan, fdcan_rx_location(fifo), &rx_header, data);
+    if (status != HAL_OK)
+        return status;
+
+    const bool ext    = rx_header.IdType == FDCAN_EXTENDED_ID;
+    header->IDE       = ext ? CAN_ID_EXT : CAN_ID_STD;
+    header->StdId     = ext ? rx_header.Identifier >> 18 : rx_header.Identifier;
+    header->ExtId     = ext ? rx_header.Identifier : 0U;
+    header->RTR       = rx_header.RxFrameType == FDCAN_REMOTE_FRAME ? CAN_RTR_REMOTE : CAN_RTR_DATA;
+    header->DLC       = fdcan_dlc_to_bytes(rx_header.DataLength);
+    header->Timestamp = rx_header.RxTimestamp;
+    if (rx_header.FDFormat == FDCAN_CLASSIC_CAN)
+        header->FDFormat = CAN_FD_CLASSIC;
+    else
+        header->FDFormat = rx_header.BitRateSwitch == FDCAN_BRS_ON ? CAN_FD_BRS : CAN_FD_NO_BRS;
+
+    // IsFilterMatchingFrame 为 1 表示该帧没有匹配任何过滤器元素
+    if (rx_header.IsFilterMatchingFrame)
+        header->FilterMatchIndex = CAN_FILTER_INDEX_NUM;
+    else
+        header->FilterMatchIndex = (ext ? CAN_FDCAN_STD_FILTER_NUM : 0U) + rx_header.FilterIndex;
+    return HAL_OK;
+}
+
+/**
+ * 读取并清除接收 FIFO 的丢帧标志
+ */
+static inline bool port_take_overrun(CAN_HandleTypeDef* hcan, const uint32_t fifo)
+{
+    const uint32_t flag    = fifo == CAN_RX_FIFO0 ? FDCAN_FLAG_RX_FIFO0_MESSAGE_LOST
+                                                  : FDCAN_FLAG_RX_FIFO1_MESSAGE_LOST;
+    const bool     overrun = __HAL_FDCAN_GET_FLAG(hcan, flag) != 0;
+    if (overrun)
+        __HAL_FDCAN_CLEAR_FLAG(hcan, flag);
+    return overrun;
+}
+
+#    if defined(CAN_STATS) || defined(CAN_HW_TIMESTAMP)
+/**
+ * 根据初始化参数计算仲裁段波特率
+ */
+static uint32_t can_bitrate(const CAN_HandleTypeDef* hcan)
+{
+    const uint32_t tq = 1U + hcan->Init.NominalTimeSeg1 + hcan->Init.NominalTimeSeg2;
+    return HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_FDCAN) / (hcan->Init.NominalPrescaler * tq);
+}
+#    endif
+#elif defined(CAN_LL)
+/* bxCAN 寄存器直通：跳过 HAL 的状态检查和帧头逐字段转换 */
+
+static inline uint32_t port_tx_free_level(CAN_HandleTypeDef* hcan)
+{
+    const uint32_t tsr = hcan->Instance->TSR;
+    return ((tsr & CAN_TSR_TME0) != 0U) + ((tsr & CAN_TSR_TME1) != 0U) +
+           ((tsr & CAN_TSR_TME2) != 0U);
+}
+
+static inline bool port_tx_pending(CAN_HandleTypeDef* hcan, const uint32_t mailbox)
+{
+    // TME0 ~ TME2 与 CAN_TX_MAILBOX0 ~ 2 的位顺序一致
+    return (hcan->Instance->TSR & mailbox * CAN_TSR_TME0) == 0U;
+}
+
+static inline bool port_is_fd(const CAN_TxHeaderTypeDef* header)
+{
+    (void) header;
+    return false;
+}
+
+static inline HAL_StatusTypeDef port_add_tx_message(CAN_HandleTypeDef*         hcan,
+                                                    const CAN_TxHeaderTypeDef* header,
+                                                    const uint8_t              data[],
+                                                    uint32_t*                  mailbox)
+{
+    return CAN_LL_AddTxMessage(hcan, header, data, mailbox);
+}
+
+static inline uint32_t port_rx_fill_level(CAN_HandleTypeDef* hcan, const uint32_t fifo)
+{
+    const uint32_t rfr = fifo == CAN_RX_FIFO0 ? hcan->Instance->RF0R : hcan->Instance->RF1R;
+    return rfr & CAN_RF0R_FMP0;
+}
+
+static inline HAL_StatusTypeDef port_get_rx_message(CAN_HandleTypeDef*   hcan,
+                                                    const uint32_t       fifo,
+                                                    CAN_RxHeaderTypeDef* header,
+                                                    uint8_t              data[])
+{
+    return CAN_LL_GetRxMessage(hcan, fifo, header, data);
+}
+#else
+static inline uint32_t port_tx_free_level(CAN_HandleTypeDef* hcan)
+{
+    return HAL_CAN_GetTxMailboxesFreeLevel(hcan);
+}
+
+/**
+ * @param mailbox 邮箱对应的位 (CAN_TX_MAILBOXx)
+ * @return 该邮箱中的帧是否仍在等待发送
+ */
+static inline bool port_tx_pending(CAN_HandleTypeDef* hcan, const uint32_t mailbox)
+{
+    return HAL_CAN_IsTxMessagePending(hcan, mailbox) != 0U;
+}
+
+static inline bool port_is_fd(const CAN_TxHeaderTypeDef* header)
+{
+    (void) header;
+    return false;
+}
+
+/**
+ * 写入发送邮箱
+ * @param mailbox 输出写入的邮箱 (CAN_TX_MAILBOXx)
+ */
+static inline HAL_StatusTypeDef port_add_tx_message(CAN_HandleTypeDef*         hcan,
+                                                    const CAN_TxHeaderTypeDef* header,
+                                                    const uint8_t              data[],
+                                                    uint32_t*                  mailbox)
+{
+    return HAL_CAN_AddTxMessage(hcan, header, data, mailbox);
+}
+
+static inline uint32_t port_rx_fill_level(CAN_HandleTypeDef* hcan, const uint32_t fifo)
+{
+    return HAL_CAN_GetRxFifoFillLevel(hcan, fifo);
+}
+
+static inline HAL_StatusTypeDef port_get_rx_message(CAN_HandleTypeDef*   hcan,
+                                                    const uint32_t       fifo,
+                                                    CAN_RxHeaderTypeDef* header,
+                                                    uint8_t              data[])
+{
+    return HAL_CAN_GetRxMessage(hcan, fifo, header, data);
+}
+#endif
+
+#ifndef CAN_USE_FDCAN
+/**
+ * 读取并清除 FIFO 溢出标志 (FOVR)
+ */
+static inline bool port_take_overrun(CAN_HandleTypeDef* hcan, const uint32_t fifo)
+{
+    const uint32_t fovr_flag = fifo == CAN_RX_FIFO0 ? CAN_FLAG_FOV0 : CAN_FLAG_FOV1;
+    const bool     overrun   = __HAL_CAN_GET_FLAG(hcan, fovr_flag) != 0;
+    if (overrun)
+        __HAL_CAN_CLEAR_FLAG(hcan, fovr_flag);
+    return overrun;
+}
+
+#    if defined(CAN_STATS) || defined(CAN_HW_TIMESTAMP)
+/**
+ * 根据 BTR 寄存器计算波特率
+ */
+static uint32_t can_bitrate(const CAN_HandleTypeDef* hcan)
+{
+    const uint32_t btr = hcan->Instance->BTR;
+    const uint32_t tq  = 3U + ((btr & CAN_BTR_TS1) >> CAN_BTR_TS1_Pos) +
+                        ((btr & CAN_BTR_TS2) >> CAN_BTR_TS2_Pos);
+    return HAL_RCC_GetPCLK1Freq() / (((btr & CAN_BTR_BRP) + 1U) * tq);
+}
+#    endif
+#endif
+
+#ifdef CAN_LL
+/**
+ * 直接写 TIR/TDTR/TDLR/TDHR 发送一帧，与 HAL_CAN_AddTxMessage 等价
+ *
+ * 不检查句柄状态，调用前必须已经 HAL_CAN_Start；与 HAL 一样总是读取 8 字节 data
+ * @param hcan can handle
+ * @param header 帧头
+ * @param data 数据
+ * @param mailbox 输出写入的邮箱 (CAN_TX_MAILBOXx)
+ * @return 没有空闲邮箱时返回 HAL_ERROR
+ */
+HAL_StatusTypeDef CAN_LL_AddTxMessage(CAN_HandleTypeDef*         hcan,
+                                      const CAN_TxHeaderTypeDef* header,
+                                      const uint8_t              data[],
+                                      uint32_t*                  mailbox)
+{
+    CAN_TypeDef*   can = hcan->Instance;
+    const uint32_t tsr = can->TSR;
+    if ((tsr & (CAN_TSR_TME0 | CAN_TSR_TME1 | CAN_TSR_TME2)) == 0U)
+    {
+        hcan->ErrorCode |= HAL_CAN_ERROR_PARAM;
+        return HAL_ERROR;
+    }
+
+    // CODE 为下一个空闲邮箱的编号
+    const uint32_t index = (tsr & CAN_TSR_CODE) >> CAN_TSR_CODE_Pos;
+    const uint32_t id    = header->IDE == CAN_ID_EXT ? header->ExtId << CAN_TI0R_EXID_Pos
+                                                     : header->StdId << CAN_TI0R_STID_Pos;
+    const uint32_t tgt   = header->TransmitGlobalTime == ENABLE ? CAN_TDT0R_TGT : 0U;
+    uint32_t       words[2];
+    memcpy(words, data, sizeof(words));
+
+    CAN_TxMailBox_TypeDef* box = &can->sTxMailBox[index];
+    box->TIR                   = id | header->IDE | header->RTR;
+    box->TDTR                  = header->DLC | tgt;
+    box->TDLR                  = words[0];
+    box->TDHR                  = words[1];
+
+    // 邮箱内容写完后再请求发送
+    box->TIR |= CAN_TI0R_TXRQ;
+
+    *mailbox = 1UL << index;
+    return HAL_OK;
+}
+
+/**
+ * 直接读 RIR/RDTR/RDLR/RDHR 取出一帧并释放 FIFO 输出邮箱，与 HAL_CAN_GetRxMessage 等价
+ *
+ * 不检查句柄状态和 FIFO 是否为空，调用前请确认 FIFO 中有帧
+ * @param hcan can handle
+ * @param fifo CAN_RX_FIFO0 或 CAN_RX_FIFO1
+ * @param header 输出帧头
+ * @param data 输出数据，至少 8 字节
+ * @return HAL_OK
+ */
+HAL_StatusTypeDef CAN_LL_GetRxMessage(CAN_HandleTypeDef*   hcan,
+                                      const uint32_t       fifo,
+                                      CAN_RxHeaderTypeDef* header,
+                                      uint8_t              data[])
+{
+    CAN_TypeDef*                   can  = hcan->Instance;
+    const CAN_FIFOMailBox_TypeDef* box  = &can->sFIFOMailBox[fifo];
+    const uint32_t                 rir  = box->RIR;
+    const uint32_t                 rdtr = box->RDTR;
+
+    const uint32_t words[2] = { box->RDLR, box->RDHR };
+
+    header->IDE   = rir & CAN_RI0R_IDE;
+    header->RTR   = rir & CAN_RI0R_RTR;
+    header->StdId = (rir & CAN_RI0R_STID) >> CAN_RI0R_STID_Pos;
+    header->ExtId = (rir & (CAN_RI0R_STID | CAN_RI0R_EXID)) >> CAN_RI0R_EXID_Pos;
+    header->DLC   = (rdtr & CAN_RDT0R_DLC) >> CAN_RDT0R_DLC_Pos;
+    if (header->DLC > 8U)
+        header->DLC = 8U;
+    header->Timestamp        = (rdtr & CAN_RDT0R_TIME) >> CAN_RDT0R_TIME_Pos;
+    header->FilterMatchIndex = (rdtr & CAN_RDT0R_FMI) >> CAN_RDT0R_FMI_Pos;
+    memcpy(data, words, sizeof(words));
+
+    // 释放输出邮箱；直接写入而不是读-改-写，避免误清 FULL / FOVR 标志
+    if (fifo == CAN_RX_FIFO0)
+        can->RF0R = CAN_RF0R_RFOM0;
+    else
+        can->RF1R = CAN_RF1R_RFOM1;
+    return HAL_OK;
+}
+#endif
+
+/**
+ * 计算接收时间戳
+ * @param map 总线数据，可以为 NULL
+ * @param hw_timestamp HAL 读出的 16 位硬件时间戳
+ * @return 32 位时间戳 (unit: us)
+ */
+static uint32_t rx_timestamp(CAN_CallbackMap* map, const uint32_t hw_timestamp)
+{
+    const uint32_t now = CAN_GetTimeUs();
+#ifdef CAN_HW_TIMESTAMP
+    if (map == NULL || map->rx_clock.ns_per_bit == 0)
+        return now;
+
+    CAN_RxClock*   clock = &map->rx_clock;
+    const uint16_t hw    = (uint16_t) hw_timestamp;
+    uint32_t       timestamp;
+    if (clock->valid)
+    {
+        const uint32_t ns = (uint16_t) (hw - clock->last_hw) * clock->ns_per_bit + clock->rem_ns;
+        timestamp         = clock->last_us + ns / 1000U;
+        clock->rem_ns     = ns % 1000U;
+        if ((int32_t) (now - timestamp) >= 0)
+        {
+            // 两帧间隔超过计数器周期时补齐整数个周期，帧一定在 now 之前一个周期内到达
+            const uint32_t wrap_us = 65536U * clock->ns_per_bit / 1000U;
+            timestamp += (now - timestamp) / wrap_us * wrap_us;
+        }
+        else
+        {
+            // 推算结果晚于当前时间，说明时基之间有漂移，重新对齐
+            timestamp     = now;
+            clock->rem_ns = 0;
+        }
+    }
+    else
+    {
+        timestamp     = now;
+        clock->rem_ns = 0;
+        clock->valid  = true;
+    }
+    clock->last_hw = hw;
+    clock->last_us = timestamp;
+    return timestamp;
+#else
+    (void) map;
+    (void) hw_timestamp;
+    return now;
+#endif
+}
+
+/**
+ * 获取总线编号，与 hcan 的注册顺序无关
+ *
+ * 只比较外设实例地址，驱动可以用它直接索引自己的每总线数据
+ * @param hcan can handle
+ * @return CAN1 / FDCAN1 为 0，CAN2 / FDCAN2 为 1，CAN3 / FDCAN3 为 2
+ */
+uint8_t CAN_GetBusIndex(const CAN_HandleTypeDef* hcan)
+{
+#if defined(CAN_USE_FDCAN)
+#    if defined(FDCAN3)
+    if (hcan->Instance == FDCAN3)
+        return 2;
+#    endif
+#    if defined(FDCAN2)
+    if (hcan->Instance == FDCAN2)
+        return 1;
+#    endif
+#else
+#    if defined(CAN3)
+    if (hcan->Instance == CAN3)
+        return 2;
+#    endif
+#    if defined(CAN2)
+    if (hcan->Instance == CAN2)
+        return 1;
+#    endif
+#endif
+    return 0;
+}
+
+#ifdef CAN_CAPTURE
+/**
+ * 写入一条录制记录，缓冲区满时丢弃
+ */
+static void capture_record(const CAN_HandleTypeDef* hcan,
+                           const uint8_t            flags,
+                           const uint32_t           id,
+                           const uint32_t           dlc,
+                           const uint8_t            data[])
+{
+    if (!capture.enabled)
+        return;
+
+    const uint32_t primask = can_enter_critical();
+    const uint32_t head    = capture.head;
+    if (head - capture.tail >= CAN_CAPTURE_SIZE)
+    {
+        capture.dropped++;
+    }
+    else
+    {
+        CAN_CaptureRecord_t* record = &capture.records[head & (CAN_CAPTURE_SIZE - 1)];
+        record->timestamp           = CAN_CAPTURE_TIMESTAMP();
+        record->id                  = id;
+        record->bus                 = CAN_GetBusIndex(hcan);
+        record->flags               = flags;
+        record->dlc                 = (uint8_t) (dlc <= 8 ? dlc : 8);
+        record->magic               = CAN_CAPTURE_MAGIC;
+        memset(record->data, 0, sizeof(record->data));
+        memcpy(record->data, data, record->dlc);
+        capture.head = head + 1;
+        capture.recorded++;
+    }
+    can_exit_critical(primask);
+}
+
+static inline void capture_rx(const CAN_HandleTypeDef*   hcan,
+                              const CAN_RxHeaderTypeDef* header,
+                              const uint8_t              data[])
+{
+    const bool ext = header->IDE == CAN_ID_EXT;
+    capture_record(hcan,
+                   (ext ? CAN_CAPTURE_FLAG_EXT : 0U) |
+                           (header->RTR == CAN_RTR_REMOTE ? CAN_CAPTURE_FLAG_RTR : 0U),
+                   ext ? header->ExtId : header->StdId,
+                   header->DLC,
+                   data);
+}
+
+static inline void capture_tx(const CAN_HandleTypeDef*   hcan,
+                              const CAN_TxHeaderTypeDef* header,
+                              const uint8_t              data[])
+{
+    const bool ext = header->IDE == CAN_ID_EXT;
+    capture_record(hcan,
+                   CAN_CAPTURE_FLAG_TX | (ext ? CAN_CAPTURE_FLAG_EXT : 0U) |
+                           (header->RTR == CAN_RTR_REMOTE ? CAN_CAPTURE_FLAG_RTR : 0U),
+                   ext ? header->ExtId : header->StdId,
+                   header->DLC,
+                   data);
+}
+#endif
+
+static inline uint32_t can_cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+#ifdef CAN_STATS
+/**
+ * 把延迟计入直方图，第 k 格为 [2^(k-1), 2^k) us
+ */
+static void stats_hist_add(uint32_t       hist[CAN_STATS_HIST_BIN_NUM],
+                           uint32_t*      max,
+                           const uint32_t cycles)
+{
+    const uint32_t us  = cycles / (SystemCoreClock / 1000000U);
+    uint32_t       bin = 32U - __CLZ(us);
+    if (bin >= CAN_STATS_HIST_BIN_NUM)
+        bin = CAN_STATS_HIST_BIN_NUM - 1;
+    hist[bin]++;
+    if (us > *max)
+        *max = us;
+}
+
+/**
+ * 估算一帧在总线上占用的位数：帧本身 + 最坏情况位填充 + 3 位帧间隔
+ */
+static inline uint32_t stats_frame_bits(const uint32_t ide, const uint32_t bytes)
+{
+    const uint32_t payload = bytes * 8U;
+    if (ide == CAN_ID_EXT)
+        return 67U + payload + (54U + payload - 1U) / 4U;
+    return 47U + payload + (34U + payload - 1U) / 4U;
+}
+
+/**
+ * 查找 ID 对应的统计项，不存在时添加
+ * @return 统计项，ID 表已满时返回 NULL
+ */
+static CAN_IdStats_t* stats_find_id(CAN_StatsData* stats, const uint32_t ide, const uint32_t id)
+{
+    uint32_t index = (id ^ id >> 7 ^ id >> 14) & (CAN_STATS_ID_NUM - 1);
+    for (uint32_t i = 0; i < CAN_STATS_ID_NUM; i++, index = (index + 1) & (CAN_STATS_ID_NUM - 1))
+    {
+        CAN_IdStats_t* entry = &stats->counters.ids[index];
+        if (!stats->id_used[index])
+        {
+            stats->id_used[index] = true;
+            entry->ide            = ide;
+            entry->id             = id;
+            stats->counters.id_count++;
+            return entry;
+        }
+        if (entry->id == id && entry->ide == ide)
+            return entry;
+    }
+    return NULL;
+}
+
+/**
+ * 统计一帧，调用时必须处于临界区
+ */
+static void stats_count(CAN_StatsData* stats,
+                        const bool     tx,
+                        const uint32_t ide,
+                        const uint32_t id,
+                        const uint32_t rtr,
+                        const uint32_t dlc)
+{
+    const uint32_t len      = dlc <= CAN_MAX_DATA_LEN ? dlc : CAN_MAX_DATA_LEN;
+    const uint32_t bytes    = rtr == CAN_RTR_REMOTE ? 0U : len;
+    CAN_Stats_t*   counters = &stats->counters;
+    counters->bits += stats_frame_bits(ide, bytes);
+    if (tx)
+    {
+        counters->tx_frames++;
+        counters->tx_bytes += bytes;
+    }
+    else
+    {
+        counters->rx_frames++;
+        counters->rx_bytes += bytes;
+    }
+
+    CAN_IdStats_t* entry = stats_find_id(stats, ide, id);
+    if (entry == NULL)
+    {
+        counters->untracked++;
+    }
+    else if (tx)
+    {
+        entry->tx_frames++;
+        entry->tx_bytes += bytes;
+    }
+    else
+    {
+        entry->rx_frames++;
+        entry->rx_bytes += bytes;
+    }
+}
+
+#endif
+
+/**
+ * 写入发送邮箱，调用时必须处于临界区
+ *
+ * 录制模式下同时记录该帧，统计模式下计数并记下写入时刻
+ * @param map 总线对应的 map，可以为 NULL
+ */
+static HAL_StatusTypeDef can_add_tx_message(CAN_CallbackMap*           map,
+                                            CAN_HandleTypeDef*         hcan,
+                                            const CAN_TxHeaderTypeDef* header,
+                                            const uint8_t              data[],
+                                            uint32_t*                  mailbox)
+{
+    const HAL_StatusTypeDef status = port_add_tx_message(hcan, header, data, mailbox);
+    if (status != HAL_OK)
+        return status;
+#ifdef CAN_CAPTURE
+    // 录制格式只支持经典帧，打包帧中的各帧在打包时已经录制
+    if (!port_is_fd(header))
+        capture_tx(hcan, header, data);
+#endif
+#ifdef CAN_STATS
+    if (map != NULL)
+    {
+        // 邮箱编号与发送缓冲区编号均为单个位
+        map->stats.mailbox_cycles[31U - __CLZ(*mailbox)] = can_cycles();
+        stats_count(&map->stats,
+                    true,
+                    header->IDE,
+                    header->IDE == CAN_ID_EXT ? header->ExtId : header->StdId,
+                    header->RTR,
+                    header->DLC);
+    }
+#else
+    (void) map;
+#endif
+    return status;
+}
+
+static inline uint32_t tx_queue_size(const CAN_TxQueue* tx)
+{
+    return tx->head - tx->tail;
+}
+
+/**
+ * 释放已经发出的低优先级邮箱，调用时必须处于临界区
+ * @return 低优先级帧能否再占用一个邮箱
+ */
+static bool tx_telemetry_slot_free(CAN_CallbackMap* map)
+{
+    uint32_t slots = map->telemetry_slots;
+    uint32_t used  = 0;
+    while (slots != 0)
+    {
+        const uint32_t mailbox = 1U << (31U - __CLZ(slots));
+        if (port_tx_pending(map->hcan, mailbox))
+            used++;
+        else
+            map->telemetry_slots &= ~mailbox;
+        slots &= ~mailbox;
+    }
+    return used < CAN_TX_TELEMETRY_SLOTS;
+}
+
+/**
+ * 是否有可供该优先级使用的发送邮箱，调用时必须处于临界区
+ */
+static inline bool tx_mailbox_available(CAN_CallbackMap* map, const CAN_TxPriority_t priority)
+{
+    return port_tx_free_level(map->hcan) > 0 &&
+           (priority == CAN_TX_PRIO_CONTROL || tx_telemetry_slot_free(map));
+}
+
+/**
+ * 写入发送邮箱并记录排队时间，调用时必须处于临界区
+ * @param wait 排队时间 (unit: DWT 周期)
+ */
+static HAL_StatusTypeDef tx_send(CAN_CallbackMap*           map,
+                                 const CAN_TxPriority_t     priority,
+                                 const CAN_TxHeaderTypeDef* header,
+                                 const uint8_t              data[],
+                                 const uint32_t             wait,
+                                 uint32_t*                  mailbox)
+{
+    const HAL_StatusTypeDef status = can_add_tx_message(map, map->hcan, header, data, mailbox);
+    if (status != HAL_OK)
+        return status;
+
+    CAN_TxQueue* tx = &map->tx[priority];
+    if (wait > tx->max_wait_cycles)
+        tx->max_wait_cycles = wait;
+    if (priority == CAN_TX_PRIO_TELEMETRY)
+        map->telemetry_slots |= *mailbox;
+#ifdef CAN_STATS
+    stats_hist_add(map->stats.counters.queue_latency, &map->stats.counters.queue_latency_max, wait);
+#endif
+    return HAL_OK;
+}
+
+/**
+ * 按优先级将队列中的帧搬运到空闲的发送邮箱，调用时必须处于临界区
+ *
+ * 控制队列有积压时不发送低优先级帧
+ */
+static void tx_queue_drain(CAN_CallbackMap* map)
+{
+    for (uint32_t priority = 0; priority < CAN_TX_PRIO_NUM; priority++)
+    {
+        CAN_TxQueue* tx = &map->tx[priority];
+        while (tx->head != tx->tail && tx_mailbox_available(map, priority))
+        {
+            const CAN_TxFrame* frame = &tx->frames[tx->tail & (tx->size - 1)];
+            uint32_t           mailbox;
+            if (tx_send(map,
+                        priority,
+                        &frame->header,
+                        frame->data,
+                        can_cycles() - frame->enqueue_cycles,
+                        &mailbox) != HAL_OK)
+            {
+                CAN_ERROR_HANDLER();
+                return;
+            }
+            tx->tail++;
+        }
+        if (tx->head != tx->tail)
+            return;
+    }
+}
+
+/**
+ * 帧入队，调用时必须处于临界区
+ * @return 是否成功入队
+ */
+static bool tx_queue_push(CAN_TxQueue*               tx,
+                          const CAN_TxHeaderTypeDef* header,
+                          const uint8_t              data[])
+{
+    if (tx_queue_size(tx) >= tx->size)
+    {
+        if (tx->policy == CAN_TX_POLICY_DROP_NEWEST)
+        {
+            tx->stats.dropped++;
+            return false;
+        }
+        // 覆盖最旧的帧
+        tx->tail++;
+        tx->stats.overwritten++;
+    }
+    CAN_TxFrame* frame    = &tx->frames[tx->head & (tx->size - 1)];
+    frame->header         = *header;
+    frame->enqueue_cycles = can_cycles();
+    memcpy(frame->data, data, header->DLC <= CAN_MAX_DATA_LEN ? header->DLC : CAN_MAX_DATA_LEN);
+    tx->head++;
+
+    const uint32_t size = tx_queue_size(tx);
+    if (size > tx->stats.high_water)
+        tx->stats.high_water = size;
+    return true;
+}
+
+/**
+ * 发送一帧，调用时必须处于临界区
+ * @param map 总线对应的 map，NULL 表示总线未经 CAN_Start 启动，没有发送队列
+ */
+static uint32_t can_send_locked(CAN_CallbackMap*           map,
+                                CAN_HandleTypeDef*         hcan,
+                                const CAN_TxHeaderTypeDef* header,
+                                const uint8_t              data[],
+                                const CAN_TxPriority_t     priority)
+{
+    uint32_t mailbox = CAN_SEND_FAILED;
+    if (map == NULL)
+    {
+        // 未经 CAN_Start 启动的总线没有发送队列，只能尝试直接写入邮箱
+        if (port_tx_free_level(hcan) > 0 &&
+            can_add_tx_message(NULL, hcan, header, data, &mailbox) != HAL_OK)
+        {
+            CAN_ERROR_HANDLER();
+        }
+        return mailbox;
+    }
+
+    // 先把积压的帧送进邮箱，保证同一优先级内的发送顺序
+    tx_queue_drain(map);
+    bool idle = map->tx[priority].head == map->tx[priority].tail;
+    if (priority != CAN_TX_PRIO_CONTROL)
+        idle = idle && map->tx[CAN_TX_PRIO_CONTROL].head == map->tx[CAN_TX_PRIO_CONTROL].tail;
+    if (idle && tx_mailbox_available(map, priority))
+    {
+        // 直接写入邮箱，没有排队延迟
+        if (tx_send(map, priority, header, data, 0, &mailbox) != HAL_OK)
+        {
+            CAN_ERROR_HANDLER();
+        }
+    }
+    else if (tx_queue_push(&map->tx[priority], header, data))
+    {
+        mailbox = CAN_SEND_QUEUED;
+    }
+    return mailbox;
+}
+
+#if defined(CAN_USE_FDCAN) && defined(CAN_FD_PACK)
+/**
+ * 发出打包缓冲区中的帧，调用时必须处于临界区
+ * @return 同 CAN_SendMessage；缓冲区为空时返回 0
+ */
+static uint32_t fd_pack_flush(CAN_CallbackMap* map)
+{
+    if (map->pack.size == 0)
+        return 0;
+
+    // 补齐到合法的 FD 长度，0xFF 作为结束标记（DLC 为 15 的记录不存在）
+    const uint32_t size = fdcan_dlc_bytes[fdcan_dlc_index(map->pack.size)];
+    memset(&map->pack.data[map->pack.size], 0xFF, size - map->pack.size);
+    map->pack.size = 0;
+
+    const CAN_TxHeaderTypeDef header = { .StdId    = CAN_FD_PACK_ID,
+                                         .IDE      = CAN_ID_STD,
+                                         .RTR      = CAN_RTR_DATA,
+                                         .DLC      = size,
+                                         .FDFormat = CAN_FD_BRS };
+    return can_send_locked(map, map->hcan, &header, map->pack.data, CAN_TX_PRIO_CONTROL);
+}
+
+/**
+ * 把一个经典数据帧追加到打包缓冲区，放不下时先发出已有的内容，调用时必须处于临界区
+ *
+ * 记录格式：
+ *   标准帧 [0 | DLC << 3 | ID[10:8]] [ID[7:0]] data
+ *   扩展帧 [0x80 | DLC << 3] [ID[28:0] 大端 4 字节] data
+ */
+static uint32_t fd_pack_append(CAN_CallbackMap*           map,
+                               const CAN_TxHeaderTypeDef* header,
+                               const uint8_t              data[])
+{
+    const bool     ext  = header->IDE == CAN_ID_EXT;
+    const uint32_t dlc  = header->DLC <= 8 ? header->DLC : 8;
+    const uint32_t size = (ext ? 5U : 2U) + dlc;
+
+    if (map->pack.size + size > CAN_MAX_DATA_LEN && fd_pack_flush(map) == CAN_SEND_FAILED)
+        return CAN_SEND_FAILED;
+
+    uint8_t* record = &map->pack.data[map->pack.size];
+    if (ext)
+    {
+        record[0] = (uint8_t) (0x80U | dlc << 3);
+        record[1] = (uint8_t) (header->ExtId >> 24);
+        record[2] = (uint8_t) (header->ExtId >> 16);
+        record[3] = (uint8_t) (header->ExtId >> 8);
+        record[4] = (uint8_t) header->ExtId;
+    }
+    else
+    {
+        record[0] = (uint8_t) (dlc << 3 | (header->StdId >> 8 & 0x7U));
+        record[1] = (uint8_t) header->StdId;
+    }
+    memcpy(&record[size - dlc], data, dlc);
+    map->pack.size += size;
+#    ifdef CAN_CAPTURE
+    capture_tx(map->hcan, header, data);
+#    endif
+    return CAN_SEND_QUEUED;
+}
+
+/**
+ * 开启或关闭该总线的 CAN-FD 打包发送
+ *
+ * 开启后 CAN_SendMessage 发送的经典数据帧不会立即发出，而是依次写入一个 64 字节的 CAN-FD 帧
+ * (ID 为 CAN_FD_PACK_ID)，写满或调用 CAN_FdPackFlush 时发出。关闭时会发出缓冲区中剩余的帧
+ * @param hcan can handle，必须已经 CAN_Start
+ * @param enable 是否开启
+ */
+void CAN_SetFdPacking(const CAN_HandleTypeDef* hcan, const bool enable)
+{
+    CAN_CallbackMap* map = get_map(hcan);
+    if (map == NULL)
+        return;
+
+    const uint32_t primask = can_enter_critical();
+    if (!enable)
+        fd_pack_flush(map);
+    map->pack.enabled = enable;
+    can_exit_critical(primask);
+}
+
+/**
+ * 发出打包缓冲区中的帧，一般在每个控制周期的所有电机指令发送完之后调用
+ * @param hcan can handle
+ * @return 同 CAN_SendMessage；缓冲区为空时返回 0
+ */
+uint32_t CAN_FdPackFlush(const CAN_HandleTypeDef* hcan)
+{
+    CAN_CallbackMap* map = get_map(hcan);
+    if (map == NULL)
+        return 0;
+
+    const uint32_t primask = can_enter_critical();
+    const uint32_t mailbox = fd_pack_flush(map);
+    can_exit_critical(primask);
+    return mailbox;
+}
+#endif
+
+/**
+ * 发送一条 CAN 消息
+ *
+ * 等价于以 CAN_TX_PRIO_CONTROL 优先级调用 CAN_SendMessageWithPriority
+ * @param hcan can handle
+ * @param header CAN_TxHeaderTypeDef
+ * @param data 数据
+ * @note 本身想做成内联展开，但是必须写到 .h 文件，调研发现性能损失不大，所以直接放到此处
+ * @return mailbox; CAN_SEND_QUEUED 表示已入队; CAN_SEND_FAILED 表示队列已满，帧被丢弃
+ */
+uint32_t CAN_SendMessage(CAN_HandleTypeDef*         hcan,
+                         const CAN_TxHeaderTypeDef* header,
+                         const uint8_t              data[])
+{
+    return CAN_SendMessageWithPriority(hcan, header, data, CAN_TX_PRIO_CONTROL);
+}
+
+/**
+ * 以指定优先级发送一条 CAN 消息
+ *
+ * 若该优先级的发送队列为空且有空闲邮箱则直接写入邮箱，否则写入该总线对应优先级的软件发送队列，
+ * 由发送邮箱空中断 (CAN_TxMailboxCompleteCallback) 依次取出发送。
+ * 控制队列中有帧时不会发送低优先级帧，且低优先级帧最多同时占用 CAN_TX_TELEMETRY_SLOTS 个邮箱，
+ * 因此遥测流量不会推迟控制帧进入邮箱。各总线的队列相互独立。
+ * 本函数不会阻塞，可在任务和中断中调用。
+ *
+ * @param hcan can handle
+ * @param header CAN_TxHeaderTypeDef
+ * @param data 数据
+ * @param priority 发送优先级
+ * @return mailbox; CAN_SEND_QUEUED 表示已入队; CAN_SEND_FAILED 表示队列已满，帧被丢弃
+ */
+uint32_t CAN_SendMessageWithPriority(CAN_HandleTypeDef*         hcan,
+                                     const CAN_TxHeaderTypeDef* header,
+                                     const uint8_t              data[],
+                                     const CAN_TxPriority_t     priority)
+{
+    if (priority >= CAN_TX_PRIO_NUM)
+    {
+        CAN_ERROR_HANDLER();
+        return CAN_SEND_FAILED;
+    }
+    CAN_CallbackMap* map = get_map(hcan);
+
+    const uint32_t primask = can_enter_critical();
+    uint32_t       mailbox;
+#if defined(CAN_USE_FDCAN) && defined(CAN_FD_PACK)
+    // 打包帧按控制优先级发出，低优先级帧不参与打包
+    if (map != NULL && map->pack.enabled && priority == CAN_TX_PRIO_CONTROL &&
+        !port_is_fd(header) && header->RTR == CAN_RTR_DATA)
+        mailbox = fd_pack_append(map, header, data);
+    else
+#endif
+        mailbox = can_send_locked(map, hcan, header, data, priority);
+    can_exit_critical(primask);
+
+    return mailbox;
+}
+
+/**
+ * 发送邮箱空回调，从软件发送队列补充邮箱
+ *
+ * CAN_Start 会自动将其注册为 TX_MAILBOX{0,1,2}_ABORT 回调，发送完成回调见 can_tx_complete
+ * @param hcan can handle
+ */
+void CAN_TxMailboxCompleteCallback(CAN_HandleTypeDef* hcan)
+{
+    CAN_CallbackMap* map = get_map(hcan);
+    if (map == NULL)
+        return;
+
+    const uint32_t primask = can_enter_critical();
+    tx_queue_drain(map);
+    can_exit_critical(primask);
+}
+
+/**
+ * 邮箱发送完成：统计模式下记录邮箱延迟，然后从软件发送队列补充邮箱
+ * @param hcan can handle
+ * @param mailbox_index 邮箱编号 0 ~ 2
+ */
+static void can_tx_complete(CAN_HandleTypeDef* hcan, const uint32_t mailbox_index)
+{
+    CAN_CallbackMap* map = get_map(hcan);
+    if (map == NULL)
+        return;
+
+    const uint32_t primask = can_enter_critical();
+#ifdef CAN_STATS
+    stats_hist_add(map->stats.counters.mailbox_latency,
+                   &map->stats.counters.mailbox_latency_max,
+                   can_cycles() - map->stats.mailbox_cycles[mailbox_index]);
+#else
+    (void) mailbox_index;
+#endif
+    tx_queue_drain(map);
+    can_exit_critical(primask);
+}
+
+#ifdef CAN_USE_FDCAN
+/**
+ * 所有发送缓冲区对应的位
+ */
+#    define CAN_TX_SLOT_MASK                                                                      \
+        (CAN_TX_SLOT_NUM >= 32 ? 0xFFFFFFFFU : (1U << (CAN_TX_SLOT_NUM & 31U)) - 1U)
+
+static void fdcan_tx_complete(CAN_HandleTypeDef* hcan, uint32_t buffer_indexes)
+{
+    buffer_indexes &= CAN_TX_SLOT_MASK;
+    while (buffer_indexes != 0)
+    {
+        const uint32_t index = 31U - __CLZ(buffer_indexes);
+        can_tx_complete(hcan, index);
+        buffer_indexes &= ~(1U << index);
+    }
+}
+
+static void fdcan_tx_abort(CAN_HandleTypeDef* hcan, const uint32_t buffer_indexes)
+{
+    (void) buffer_indexes;
+    CAN_TxMailboxCompleteCallback(hcan);
+}
+
+static void fdcan_rx_fifo0(CAN_HandleTypeDef* hcan, const uint32_t its)
+{
+    (void) its;
+    CAN_Fifo0ReceiveCallback(hcan);
+}
+
+static void fdcan_rx_fifo1(CAN_HandleTypeDef* hcan, const uint32_t its)
+{
+    (void) its;
+    CAN_Fifo1ReceiveCallback(hcan);
+}
+#else
+static void can_tx_mailbox0_complete(CAN_HandleTypeDef* hcan)
+{
+    can_tx_complete(hcan, 0);
+}
+
+static void can_tx_mailbox1_complete(CAN_HandleTypeDef* hcan)
+{
+    can_tx_complete(hcan, 1);
+}
+
+static void can_tx_mailbox2_complete(CAN_HandleTypeDef* hcan)
+{
+    can_tx_complete(hcan, 2);
+}
+#endif
+
+/**
+ * 设置发送队列满时的处理策略
+ * @param hcan can handle
+ * @param policy 处理策略
+ */
+void CAN_SetTxQueuePolicy(const CAN_HandleTypeDef* hcan, const CAN_TxQueuePolicy_t policy)
+{
+    CAN_CallbackMap* map = get_map(hcan);
+    if (map == NULL)
+        return;
+    for (uint32_t i = 0; i < CAN_TX_PRIO_NUM; i++)
+        map->tx[i].policy = policy;
+}
+
+/**
+ * 获取控制优先级发送队列的统计信息
+ * @param hcan can handle
+ * @param stats 输出
+ */
+void CAN_GetTxStats(const CAN_HandleTypeDef* hcan, CAN_TxStats_t* stats)
+{
+    CAN_GetTxQueueStats(hcan, CAN_TX_PRIO_CONTROL, stats);
+}
+
+/**
+ * 获取指定优先级发送队列的统计信息
+ * @param hcan can handle
+ * @param priority 发送优先级
+ * @param stats 输出
+ */
+void CAN_GetTxQueueStats(const CAN_HandleTypeDef* hcan,
+                         const CAN_TxPriority_t   priority,
+                         CAN_TxStats_t*           stats)
+{
+    const CAN_CallbackMap* map = get_map(hcan);
+    if (map == NULL || priority >= CAN_TX_PRIO_NUM)
+    {
+        memset(stats, 0, sizeof(CAN_TxStats_t));
+        return;
+    }
+
+    const CAN_TxQueue* tx      = &map->tx[priority];
+    const uint32_t     primask = can_enter_critical();
+    *stats                     = tx->stats;
+    stats->pending             = tx_queue_size(tx);
+    stats->max_wait_us         = tx->max_wait_cycles / (SystemCoreClock / 1000000U);
+    can_exit_critical(primask);
+}
+
+/**
+ * CAN 初始化
+ *
+ * 会同时注册发送邮箱回调并开启 CAN_IT_TX_MAILBOX_EMPTY 中断，用于驱动软件发送队列。
+ * bxCAN 后端要求在 CubeMX 中开启 CANx_TX_IRQn，未开启或已开启的 CAN 中断优先级数值
+ * 小于 CAN_IRQ_PRIORITY 时调用 CAN_ERROR_HANDLER。
+ * FDCAN 后端还会把接收 FIFO 回调注册为 CAN_Fifo{0,1}ReceiveCallback，并开启发送完成中断
+ * @param hcan can handle
+ * @param ActiveITs CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO1_MSG_PENDING
+ */
+void CAN_Start(CAN_HandleTypeDef* hcan, const uint32_t ActiveITs)
+{
+    CAN_CallbackMap* map = get_or_create_map(hcan);
+    if (map == NULL)
+        return;
+
+#ifdef CAN_USE_FDCAN
+    if (HAL_FDCAN_RegisterRxFifo0Callback(hcan, fdcan_rx_fifo0) != HAL_OK ||
+        HAL_FDCAN_RegisterRxFifo1Callback(hcan, fdcan_rx_fifo1) != HAL_OK ||
+        HAL_FDCAN_RegisterTxBufferCompleteCallback(hcan, fdcan_tx_complete) != HAL_OK ||
+        HAL_FDCAN_RegisterTxBufferAbortCallback(hcan, fdcan_tx_abort) != HAL_OK)
+    {
+        CAN_ERROR_HANDLER();
+    }
+#else
+    // 软件发送队列只在发送中断中出队，未开启时排队的帧会一直滞留到下一次 CAN_SendMessage
+    IRQn_Type irqs[3];
+    get_irqs(hcan, irqs);
+    if (NVIC_GetEnableIRQ(irqs[0]) == 0U)
+    {
+        CAN_ERROR_HANDLER();
+    }
+#    ifdef CAN_CRITICAL_BASEPRI
+    // BASEPRI 屏蔽不了更优先的 CAN 中断，它们会打断临界区内的队列操作
+    for (size_t i = 0; i < 3; i++)
+    {
+        if (NVIC_GetEnableIRQ(irqs[i]) != 0U && NVIC_GetPriority(irqs[i]) < CAN_IRQ_PRIORITY)
+        {
+            CAN_ERROR_HANDLER();
+        }
+    }
+#    endif
+
+    static const struct
+    {
+        HAL_CAN_CallbackIDTypeDef id;
+        pCAN_CallbackTypeDef      callback;
+    } tx_callbacks[] = {
+        { HAL_CAN_TX_MAILBOX0_COMPLETE_CB_ID, can_tx_mailbox0_complete },
+        { HAL_CAN_TX_MAILBOX1_COMPLETE_CB_ID, can_tx_mailbox1_complete },
+        { HAL_CAN_TX_MAILBOX2_COMPLETE_CB_ID, can_tx_mailbox2_complete },
+        { HAL_CAN_TX_MAILBOX0_ABORT_CB_ID, CAN_TxMailboxCompleteCallback },
+        { HAL_CAN_TX_MAILBOX1_ABORT_CB_ID, CAN_TxMailboxCompleteCallback },
+        { HAL_CAN_TX_MAILBOX2_ABORT_CB_ID, CAN_TxMailboxCompleteCallback },
+    };
+    for (size_t i = 0; i < sizeof(tx_callbacks) / sizeof(tx_callbacks[0]); i++)
+    {
+        if (HAL_CAN_RegisterCallback(hcan, tx_callbacks[i].id, tx_callbacks[i].callback) != HAL_OK)
+        {
+            CAN_ERROR_HANDLER();
+        }
+    }
+#endif
+
+    // 开启 DWT 周期计数器，用于时间戳
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    CAN_GetTimeUs();
+#ifdef CAN_STATS
+    map->stats.window_tick = HAL_GetTick();
+#endif
+#ifdef CAN_HW_TIMESTAMP
+    const uint32_t bitrate   = can_bitrate(hcan);
+    map->rx_clock.valid      = false;
+    map->rx_clock.ns_per_bit = bitrate > 0 ? 1000000000U / bitrate : 0;
+#endif
+
+#ifdef CAN_USE_FDCAN
+    if (HAL_FDCAN_Start(hcan) != HAL_OK)
+    {
+        CAN_ERROR_HANDLER();
+    }
+
+    const uint32_t tx_its = FDCAN_IT_TX_COMPLETE | FDCAN_IT_TX_ABORT_COMPLETE;
+    if (HAL_FDCAN_ActivateNotification(hcan, ActiveITs | tx_its, CAN_TX_SLOT_MASK) != HAL_OK)
+    {
+        CAN_ERROR_HANDLER();
+    }
+#else
+    if (HAL_CAN_Start(hcan) != HAL_OK)
+    {
+        CAN_ERROR_HANDLER();
+    }
+
+    if (HAL_CAN_ActivateNotification(hcan, ActiveITs | CAN_IT_TX_MAILBOX_EMPTY) != HAL_OK)
+    {
+        CAN_ERROR_HANDLER();
+    }
+#endif
+}
+
+/**
+ * 注册 CAN Fifo 广播回调
+ *
+ * 没有被 CAN_ConfigFilter / CAN_RegisterFilterCallback / CAN_RegisterIdRangeCallback
+ * 认领的帧会依次交给所有广播回调
+ * @attention 本函数非线程安全，调用时请注意
+ * @param hcan hcan
+ * @param callback 回调函数指针
+ */
+void CAN_RegisterCallback(CAN_HandleTypeDef* hcan, const CAN_FifoReceiveCallback_t callback)
+{
+    CAN_CallbackMap* map = get_or_create_map(hcan);
+
+    if (map == NULL)
+        return;
+    if (map->callback_count < CAN_MAX_CALLBACK_NUM)
+        map->callbacks[map->callback_count++] = callback;
+    else
+        CAN_ERROR_HANDLER();
+}
+#ifdef CAN_USE_FDCAN
+/**
+ * 追加一个经典掩码过滤器元素并按 FilterMatchIndex 绑定回调
+ * @param handler handlers 下标，0 表示不绑定
+ */
+static bool fdcan_add_filter(CAN_CallbackMap* map,
+                             const uint32_t   ide,
+                             const uint32_t   id,
+                             const uint32_t   mask,
+                             const uint32_t   fifo,
+                             const uint8_t    handler)
+{
+    const bool     ext   = ide == CAN_ID_EXT;
+    uint32_t*      count = ext ? &map->filter_ext_count : &map->filter_std_count;
+    const uint32_t limit = ext ? map->hcan->Init.ExtFiltersNbr : map->hcan->Init.StdFiltersNbr;
+    if (*count >= limit || *count >= (ext ? CAN_FDCAN_EXT_FILTER_NUM : CAN_FDCAN_STD_FILTER_NUM))
+    {
+        CAN_ERROR_HANDLER(); // 过滤器元素不够用，请在 CubeMX 中增加 Std/Ext Filters Nbr
+        return false;
+    }
+
+    const uint32_t      config = fifo == CAN_FILTER_FIFO1 ? FDCAN_FILTER_TO_RXFIFO1
+                                                          : FDCAN_FILTER_TO_RXFIFO0;
+    FDCAN_FilterTypeDef filter = {
+        .IdType       = ext ? FDCAN_EXTENDED_ID : FDCAN_STANDARD_ID,
+        .FilterIndex  = *count,
+        .FilterType   = FDCAN_FILTER_MASK,
+        .FilterConfig = config,
+        .FilterID1    = id,
+        .FilterID2    = mask,
+    };
+    if (HAL_FDCAN_ConfigFilter(map->hcan, &filter) != HAL_OK)
+    {
+        CAN_ERROR_HANDLER();
+        return false;
+    }
+
+    const uint32_t index = (ext ? CAN_FDCAN_STD_FILTER_NUM : 0U) + (*count)++;
+    if (index < CAN_FILTER_INDEX_NUM)
+        map->filter_handlers[fifo][index] = handler;
+    return true;
+}
+
+/**
+ * 32 位过滤器 (STID[10:0] EXID[17:0] IDE RTR 0) 换算为过滤器元素，
+ * 掩码不要求 IDE 匹配时标准帧和扩展帧各占用一个元素
+ */
+static bool fdcan_add_filter32(CAN_CallbackMap* map,
+                               const uint32_t   value,
+                               const uint32_t   mask,
+                               const uint32_t   fifo,
+                               const uint8_t    handler)
+{
+    const bool any_ide = (mask & CAN_ID_EXT) == 0;
+    if ((any_ide || (value & CAN_ID_EXT) == 0) &&
+        !fdcan_add_filter(map, CAN_ID_STD, value >> 21, mask >> 21, fifo, handler))
+        return false;
+    if ((any_ide || (value & CAN_ID_EXT) != 0) &&
+        !fdcan_add_filter(map, CAN_ID_EXT, value >> 3, mask >> 3, fifo, handler))
+        return false;
+    return true;
+}
+
+/**
+ * bxCAN 格式的过滤器组换算为 FDCAN 过滤器元素，按配置顺序追加
+ *
+ * 16 位模式只支持标准帧
+ */
+static HAL_StatusTypeDef fdcan_config_filter(CAN_HandleTypeDef*              hcan,
+                                             const CAN_FilterTypeDef*        filter,
+                                             const CAN_FifoReceiveCallback_t callback)
+{
+    CAN_CallbackMap* map = get_or_create_map(hcan);
+    if (map == NULL)
+        return HAL_ERROR;
+    if (filter->FilterActivation == DISABLE)
+        return HAL_OK;
+
+    const uint8_t  handler = callback == NULL ? 0 : get_or_add_handler(map, callback);
+    const uint32_t fifo    = filter->FilterFIFOAssignment;
+    const bool     list    = filter->FilterMode == CAN_FILTERMODE_IDLIST;
+    bool           ok      = true;
+    if (filter->FilterScale == CAN_FILTERSCALE_32BIT)
+    {
+        const uint32_t fr1 = filter->FilterIdHigh << 16 | filter->FilterIdLow;
+        const uint32_t fr2 = filter->FilterMaskIdHigh << 16 | filter->FilterMaskIdLow;
+        if (list)
+            ok = fdcan_add_filter32(map, fr1, 0xFFFFFFFFU, fifo, handler) &&
+                 fdcan_add_filter32(map, fr2, 0xFFFFFFFFU, fifo, handler);
+        else
+            ok = fdcan_add_filter32(map, fr1, fr2, fifo, handler);
+    }
+    else
+    {
+        // 与 FilterMatchIndex 的顺序一致
+        const uint32_t fr[4] = { filter->FilterIdLow,
+                                 filter->FilterMaskIdLow,
+                                 filter->FilterIdHigh,
+                                 filter->FilterMaskIdHigh };
+        for (uint32_t i = 0; ok && i < 4; i += list ? 1U : 2U)
+        {
+            const uint32_t mask = list ? 0x7FFU : fr[i + 1] >> 5 & 0x7FFU;
+            ok = fdcan_add_filter(map, CAN_ID_STD, fr[i] >> 5 & 0x7FFU, mask, fifo, handler);
+        }
+    }
+    return ok ? HAL_OK : HAL_ERROR;
+}
+#endif
+
+/**
+ * 配置 CAN 过滤器并将其匹配到的帧定向交给 callback
+ *
+ * 根据过滤器寄存器计算该过滤器组的 FilterMatchIndex，接收时按编号直接查表，
+ * 每一帧只会调用一个回调函数。
+ * @attention 本函数非线程安全，调用时请注意；同一 FIFO 上后续配置的过滤器组不会影响已绑定的编号，
+ *            但修改编号更小的过滤器组的模式会使编号整体偏移，请按过滤器组顺序配置
+ * @note FDCAN 后端忽略 FilterBank，每次调用按顺序追加过滤器元素；16 位模式只支持标准帧
+ * @param hcan can handle
+ * @param filter 过滤器配置，与 HAL_CAN_ConfigFilter 相同
+ * @param callback 回调函数指针，NULL 表示不绑定（交给 ID 范围表或广播回调）
+ * @retval HAL_StatusTypeDef
+ */
+HAL_StatusTypeDef CAN_ConfigFilter(CAN_HandleTypeDef*              hcan,
+                                   const CAN_FilterTypeDef*        filter,
+                                   const CAN_FifoReceiveCallback_t callback)
+{
+#ifdef CAN_USE_FDCAN
+    return fdcan_config_filter(hcan, filter, callback);
+#else
+    const HAL_StatusTypeDef status = HAL_CAN_ConfigFilter(hcan, filter);
+    if (status != HAL_OK || callback == NULL)
+        return status;
+
+    uint32_t       count = 0;
+    const uint32_t index = get_filter_match_index(hcan, filter->FilterBank, &count);
+    for (uint32_t i = 0; i < count; i++)
+        CAN_RegisterFilterCallback(hcan, filter->FilterFIFOAssignment, index + i, callback);
+    return status;
+#endif
+}
+
+/**
+ * 按 FilterMatchIndex 注册定向回调
+ *
+ * @attention 本函数非线程安全，调用时请注意
+ * @param hcan can handle
+ * @param fifo CAN_RX_FIFO0 或 CAN_RX_FIFO1
+ * @param filter_match_index 过滤器编号
+ * @param callback 回调函数指针
+ */
+void CAN_RegisterFilterCallback(CAN_HandleTypeDef*              hcan,
+                                const uint32_t                  fifo,
+                                const uint32_t                  filter_match_index,
+                                const CAN_FifoReceiveCallback_t callback)
+{
+    CAN_CallbackMap* map = get_or_create_map(hcan);
+    if (map == NULL)
+        return;
+    if (fifo > CAN_RX_FIFO1 || filter_match_index >= CAN_FILTER_INDEX_NUM)
+    {
+        CAN_ERROR_HANDLER();
+        return;
+    }
+    map->filter_handlers[fifo][filter_match_index] = get_or_add_handler(map, callback);
+}
+
+/**
+ * 按 ID 范围注册定向回调
+ *
+ * 用于一个宽过滤器同时放行多个驱动的帧的情况，先注册的范围优先
+ * @attention 本函数非线程安全，调用时请注意
+ * @param hcan can handle
+ * @param ide CAN_ID_STD 或 CAN_ID_EXT
+ * @param id_min 最小 ID（含）
+ * @param id_max 最大 ID（含）
+ * @param callback 回调函数指针
+ */
+void CAN_RegisterIdRangeCallback(CAN_HandleTypeDef*              hcan,
+                                 const uint32_t                  ide,
+                                 const uint32_t                  id_min,
+                                 const uint32_t                  id_max,
+                                 const CAN_FifoReceiveCallback_t callback)
+{
+    CAN_CallbackMap* map = get_or_create_map(hcan);
+    if (map == NULL)
+        return;
+    if (map->id_range_count >= CAN_MAX_ID_RANGE_NUM)
+    {
+        CAN_ERROR_HANDLER();
+        return;
+    }
+    const uint8_t handler = get_or_add_handler(map, callback);
+    if (handler == 0)
+        return;
+    map->id_ranges[map->id_range_count++] =
+            (CAN_IdRange) { .ide = ide, .id_min = id_min, .id_max = id_max, .handler = handler };
+}
+
+/**
+ * 登记一条过滤规则，相同规则只记录一次
+ */
+static void filter_add_entry(CAN_HandleTypeDef*              hcan,
+                             const uint32_t                  ide,
+                             const uint32_t                  id,
+                             const uint32_t                  mask,
+                             const CAN_FifoReceiveCallback_t callback)
+{
+    CAN_CallbackMap* map = get_or_create_map(hcan);
+    if (map == NULL)
+        return;
+    const uint8_t handler = get_or_add_handler(map, callback);
+    if (handler == 0)
+        return;
+
+    for (uint32_t i = 0; i < map->filter_entry_count; i++)
+    {
+        const CAN_FilterEntry* entry = &map->filter_entries[i];
+        if (entry->ide == ide && entry->id == id && entry->mask == mask)
+        {
+            if (entry->handler != handler)
+                CAN_ERROR_HANDLER(); // 同一 ID 被两个驱动认领
+            return;
+        }
+    }
+    if (map->filter_entry_count >= CAN_MAX_FILTER_ENTRY_NUM)
+    {
+        CAN_ERROR_HANDLER();
+        return;
+    }
+    map->filter_entries[map->filter_entry_count++] =
+            (CAN_FilterEntry) { .ide = ide, .id = id, .mask = mask, .handler = handler };
+}
+
+/**
+ * 向过滤器规划登记一个需要接收的 ID
+ *
+ * 只登记，不写入硬件；所有电机初始化完成后调用 CAN_FilterApply 统一生成过滤器
+ * @attention 本函数非线程安全，调用时请注意
+ * @param hcan can handle
+ * @param ide CAN_ID_STD 或 CAN_ID_EXT
+ * @param id 帧 ID
+ * @param callback 接收到该 ID 时调用的回调函数
+ */
+void CAN_FilterAddId(CAN_HandleTypeDef*              hcan,
+                     const uint32_t                  ide,
+                     const uint32_t                  id,
+                     const CAN_FifoReceiveCallback_t callback)
+{
+    filter_add_entry(hcan, ide, id, ide == CAN_ID_STD ? 0x7FFU : 0x1FFFFFFFU, callback);
+}
+
+/**
+ * 向过滤器规划登记一组 ID (id & mask 相同的帧)
+ *
+ * @attention 本函数非线程安全，调用时请注意
+ * @param hcan can handle
+ * @param ide CAN_ID_STD 或 CAN_ID_EXT
+ * @param id 帧 ID
+ * @param mask 掩码，为 1 的位必须匹配
+ * @param callback 回调函数
+ */
+void CAN_FilterAddMask(CAN_HandleTypeDef*              hcan,
+                       const uint32_t                  ide,
+                       const uint32_t                  id,
+                       const uint32_t                  mask,
+                       const CAN_FifoReceiveCallback_t callback)
+{
+    filter_add_entry(hcan, ide, id & mask, mask, callback);
+}
+
+static inline bool filter_is_exact(const CAN_FilterEntry* entry)
+{
+    return entry->mask == (entry->ide == CAN_ID_STD ? 0x7FFU : 0x1FFFFFFFU);
+}
+
+#ifdef CAN_USE_FDCAN
+/**
+ * 每条规则占用一个过滤器元素，剩余元素关闭，并设置全局过滤器拒绝未匹配的帧和远程帧
+ */
+static uint32_t fdcan_filter_apply(CAN_CallbackMap* map, const bool dual_fifo)
+{
+    CAN_HandleTypeDef* hcan = map->hcan;
+    uint32_t           load[2] = { 0, 0 };
+
+    // 先清空旧的绑定，编号会重新分配
+    memset(map->filter_handlers, 0, sizeof(map->filter_handlers));
+    map->filter_std_count = 0;
+    map->filter_ext_count = 0;
+
+    for (uint32_t i = 0; i < map->filter_entry_count; i++)
+    {
+        const CAN_FilterEntry* entry = &map->filter_entries[i];
+        // 负载较轻的 FIFO 优先
+        const uint32_t fifo =
+                dual_fifo && load[1] < load[0] ? CAN_FILTER_FIFO1 : CAN_FILTER_FIFO0;
+        if (!fdcan_add_filter(map, entry->ide, entry->id, entry->mask, fifo, entry->handler))
+            return 0;
+        load[fifo]++;
+    }
+
+    // 关闭剩余的过滤器元素
+    for (uint32_t ext = 0; ext < 2; ext++)
+    {
+        const uint32_t first = ext ? map->filter_ext_count : map->filter_std_count;
+        const uint32_t last  = ext ? hcan->Init.ExtFiltersNbr : hcan->Init.StdFiltersNbr;
+        for (uint32_t index = first; index < last; index++)
+        {
+            FDCAN_FilterTypeDef filter = {
+                .IdType       = ext ? FDCAN_EXTENDED_ID : FDCAN_STANDARD_ID,
+                .FilterIndex  = index,
+                .FilterType   = FDCAN_FILTER_MASK,
+                .FilterConfig = FDCAN_FILTER_DISABLE,
+            };
+            if (HAL_FDCAN_ConfigFilter(hcan, &filter) != HAL_OK)
+                CAN_ERROR_HANDLER();
+        }
+    }
+    if (HAL_FDCAN_ConfigGlobalFilter(
+                hcan, FDCAN_REJECT, FDCAN_REJECT, FDCAN_REJECT_REMOTE, FDCAN_REJECT_REMOTE) !=
+        HAL_OK)
+        CAN_ERROR_HANDLER();
+
+    return map->filter_std_count + map->filter_ext_count;
+}
+#else
+/**
+ * 过滤规则转换为寄存器格式
+ *
+ * 16 位：STID[10:0] RTR IDE EXID[17:15]；32 位：EXID[28:0] IDE RTR 0。
+ * 掩码同时要求 IDE 与 RTR 匹配，只接收对应类型的数据帧
+ */
+static inline uint32_t filter_value(const CAN_FilterEntry* entry)
+{
+    return entry->ide == CAN_ID_STD ? entry->id << 5 : entry->id << 3 | CAN_ID_EXT;
+}
 
-#ifdef USE_RTOS
-#    include "cmsis_os2.h"
-static osMutexId_t can_mutex = NULL;
-static osMutexId_t get_can_mutex()
+static inline uint32_t filter_mask(const CAN_FilterEntry* entry)
 {
-    if (can_mutex == NULL)
-        can_mutex = osMutexNew(&(osMutexAttr_t) { .name = "can_mutex" });
-    return can_mutex;
+    return entry->ide == CAN_ID_STD ? entry->mask << 5 | 0x18U
+                                    : entry->mask << 3 | CAN_ID_EXT | CAN_RTR_REMOTE;
 }
-#else
-#    include "cmsis_compiler.h"
-#endif
+
 typedef struct
 {
-    CAN_HandleTypeDef*        hcan;
-    CAN_FifoReceiveCallback_t callbacks[CAN_MAX_CALLBACK_NUM];
-    uint32_t                  callback_count;
-} CAN_CallbackMap;
+    CAN_HandleTypeDef* hcan;
+    CAN_CallbackMap*   map;
+    uint32_t           bank;      ///< 下一个可用的过滤器组
+    uint32_t           last_bank; ///< 可用过滤器组上限（不含）
+    bool               dual_fifo;
+    uint32_t           fifo_load[2]; ///< 各 FIFO 已分配的过滤器数
+} CAN_FilterPlanner;
 
-static CAN_CallbackMap maps[CAN_NUM];
-static size_t          map_size = 0;
+/**
+ * 将若干条规则写入一个过滤器组并按 FilterMatchIndex 绑定回调
+ *
+ * 不足一组时用最后一条规则补齐，重复的规则指向同一个回调，不影响接收
+ */
+static bool filter_write_bank(CAN_FilterPlanner*      planner,
+                              const CAN_FilterEntry** entries,
+                              const uint32_t          count,
+                              const uint32_t          scale,
+                              const uint32_t          mode)
+{
+    if (planner->bank >= planner->last_bank)
+    {
+        CAN_ERROR_HANDLER(); // 过滤器组不够用
+        return false;
+    }
 
-static CAN_CallbackMap* get_map(const CAN_HandleTypeDef* hcan)
+    const uint32_t capacity = (scale == CAN_FILTERSCALE_32BIT ? 1U : 2U) << mode;
+    uint32_t       value[4], mask[4];
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        const CAN_FilterEntry* entry = entries[i < count ? i : count - 1];
+        value[i]                     = filter_value(entry);
+        mask[i]                      = filter_mask(entry);
+    }
+
+    // 负载较轻的 FIFO 优先
+    const uint32_t fifo = planner->dual_fifo && planner->fifo_load[1] < planner->fifo_load[0]
+                                  ? CAN_FILTER_FIFO1
+                                  : CAN_FILTER_FIFO0;
+
+    CAN_FilterTypeDef filter = { .FilterFIFOAssignment = fifo,
+                                 .FilterBank           = planner->bank,
+                                 .FilterMode           = mode,
+                                 .FilterScale          = scale,
+                                 .FilterActivation     = ENABLE,
+                                 .SlaveStartFilterBank = CAN_SLAVE_START_FILTER_BANK };
+    if (scale == CAN_FILTERSCALE_16BIT && mode == CAN_FILTERMODE_IDLIST)
+    {
+        filter.FilterIdLow      = value[0];
+        filter.FilterMaskIdLow  = value[1];
+        filter.FilterIdHigh     = value[2];
+        filter.FilterMaskIdHigh = value[3];
+    }
+    else if (scale == CAN_FILTERSCALE_16BIT)
+    {
+        filter.FilterIdLow      = value[0];
+        filter.FilterMaskIdLow  = mask[0];
+        filter.FilterIdHigh     = value[1];
+        filter.FilterMaskIdHigh = mask[1];
+    }
+    else
+    {
+        const uint32_t fr2      = mode == CAN_FILTERMODE_IDLIST ? value[1] : mask[0];
+        filter.FilterIdHigh     = value[0] >> 16;
+        filter.FilterIdLow      = value[0] & 0xFFFFU;
+        filter.FilterMaskIdHigh = fr2 >> 16;
+        filter.FilterMaskIdLow  = fr2 & 0xFFFFU;
+    }
+    if (HAL_CAN_ConfigFilter(planner->hcan, &filter) != HAL_OK)
+    {
+        CAN_ERROR_HANDLER();
+        return false;
+    }
+
+    // 组内过滤器编号顺序与上面的赋值顺序一致
+    uint32_t       n     = 0;
+    const uint32_t index = get_filter_match_index(planner->hcan, planner->bank, &n);
+    for (uint32_t i = 0; i < capacity && index + i < CAN_FILTER_INDEX_NUM; i++)
+        planner->map->filter_handlers[fifo][index + i] =
+                entries[i < count ? i : count - 1]->handler;
+
+    planner->fifo_load[fifo] += count;
+    planner->bank++;
+    return true;
+}
+
+static bool filter_write_banks(CAN_FilterPlanner*      planner,
+                               const CAN_FilterEntry** entries,
+                               const uint32_t          count,
+                               const uint32_t          scale,
+                               const uint32_t          mode)
 {
-    for (size_t i = 0; i < map_size; i++)
-        if (maps[i].hcan == hcan)
-            return &maps[i];
+    const uint32_t capacity = (scale == CAN_FILTERSCALE_32BIT ? 1U : 2U) << mode;
+    for (uint32_t i = 0; i < count; i += capacity)
+    {
+        const uint32_t n = count - i < capacity ? count - i : capacity;
+        if (!filter_write_bank(planner, entries + i, n, scale, mode))
+            return false;
+    }
+    return true;
+}
 
-    return NULL;
+static inline uint32_t div_ceil(const uint32_t a, const uint32_t b)
+{
+    return (a + b - 1) / b;
 }
+#endif
 
 /**
- * 发送一条 CAN 消息
+ * 根据登记的 ID 生成该总线的硬件过滤器
+ *
+ * 标准帧精确 ID 使用 16 位列表模式（每组 4 个），标准帧掩码使用 16 位掩码模式（每组 2 个），
+ * 扩展帧分别使用 32 位列表（每组 2 个）和 32 位掩码模式（每组 1 个）。列表模式剩余的 1~3 个
+ * ID 会在能减少过滤器组数量时放进掩码模式的空位。
+ * 每个过滤器都会按 FilterMatchIndex 绑定登记时的回调，
+ * 该总线剩余的过滤器组会被关闭，硬件只放行登记过的帧。
+ *
+ * FDCAN 后端每条规则占用一个过滤器元素，返回使用的过滤器元素数量。
+ *
+ * @attention 必须在所有电机初始化之后、CAN_Start 之前调用；本函数会覆盖该总线上已有的过滤器配置
  * @param hcan can handle
- * @param header CAN_TxHeaderTypeDef
- * @param data 数据
- * @note 本身想做成内联展开，但是必须写到 .h 文件，调研发现性能损失不大，所以直接放到此处
- * @attention 本函数大部分情况是线程安全的，少数情况（中断被中断打断）会出现不安全的情况。
- * @return mailbox, 0xFFFF 表示发送失败
+ * @param dual_fifo 是否将过滤器组分摊到 FIFO0 和 FIFO1（需要同时开启两个 FIFO 的接收中断）
+ * @return 使用的过滤器组数量
  */
-uint32_t CAN_SendMessage(CAN_HandleTypeDef*         hcan,
-                         const CAN_TxHeaderTypeDef* header,
-                         const uint8_t              data[])
+uint32_t CAN_FilterApply(CAN_HandleTypeDef* hcan, const bool dual_fifo)
 {
-    uint32_t mailbox = CAN_SEND_FAILED;
+    CAN_CallbackMap* map = get_map(hcan);
+    if (map == NULL)
+        return 0;
+#ifdef CAN_USE_FDCAN
+    return fdcan_filter_apply(map, dual_fifo);
+#else
 
-    // 等待上一个发送完成
-    while (HAL_CAN_GetTxMailboxesFreeLevel(hcan) == 0)
-        ;
-    if (__get_IPSR() != 0)
+    const CAN_FilterEntry* std_list[CAN_MAX_FILTER_ENTRY_NUM];
+    const CAN_FilterEntry* std_mask[CAN_MAX_FILTER_ENTRY_NUM];
+    const CAN_FilterEntry* ext_list[CAN_MAX_FILTER_ENTRY_NUM];
+    const CAN_FilterEntry* ext_mask[CAN_MAX_FILTER_ENTRY_NUM];
+    uint32_t               n_std_list = 0, n_std_mask = 0, n_ext_list = 0, n_ext_mask = 0;
+
+    for (uint32_t i = 0; i < map->filter_entry_count; i++)
     {
-        // 在中断中直接调用
-        if (HAL_CAN_AddTxMessage(hcan, header, data, &mailbox) != HAL_OK)
+        const CAN_FilterEntry* entry = &map->filter_entries[i];
+        if (entry->ide == CAN_ID_STD)
         {
-            CAN_ERROR_HANDLER();
+            if (filter_is_exact(entry))
+                std_list[n_std_list++] = entry;
+            else
+                std_mask[n_std_mask++] = entry;
         }
-    }
-    else
-#ifdef USE_RTOS
-    { // 任务中调用需要加临界保护
-        if (osMutexAcquire(get_can_mutex(), CAN_SEND_TIMEOUT) != osOK)
-            // 超时
-            return CAN_SEND_FAILED;
-        if (HAL_CAN_AddTxMessage(hcan, header, data, &mailbox) != HAL_OK)
+        else
         {
-            CAN_ERROR_HANDLER();
+            if (filter_is_exact(entry))
+                ext_list[n_ext_list++] = entry;
+            else
+                ext_mask[n_ext_mask++] = entry;
         }
-        osMutexRelease(get_can_mutex());
     }
-#else
+
+    // 选择放进 16 位掩码空位的精确 ID 数量 k，使组数最少
+    uint32_t best_k = 0, best_banks = UINT32_MAX;
+    for (uint32_t k = 0; k <= 3 && k <= n_std_list; k++)
     {
-        // 裸机状态下非中断调用需要保护
-        __disable_irq();
-        if (HAL_CAN_AddTxMessage(hcan, header, data, &mailbox) != HAL_OK)
+        const uint32_t banks = div_ceil(n_std_list - k, 4) + div_ceil(n_std_mask + k, 2);
+        if (banks < best_banks)
         {
-            CAN_ERROR_HANDLER();
+            best_banks = banks;
+            best_k     = k;
         }
-        __enable_irq();
     }
+    for (uint32_t i = 0; i < best_k; i++)
+        std_mask[n_std_mask++] = std_list[--n_std_list];
+
+    uint32_t first_bank = 0;
+#if defined(CAN2)
+    if (hcan->Instance == CAN2)
+        first_bank = CAN_SLAVE_START_FILTER_BANK;
 #endif
+    CAN_FilterPlanner planner = { .hcan      = hcan,
+                                  .map       = map,
+                                  .bank      = first_bank,
+                                  .last_bank = first_bank + CAN_FILTER_BANK_NUM,
+                                  .dual_fifo = dual_fifo };
 
-    return mailbox;
+    // 先清空旧的绑定，编号会重新分配
+    memset(map->filter_handlers, 0, sizeof(map->filter_handlers));
+
+    if (!filter_write_banks(
+                &planner, std_list, n_std_list, CAN_FILTERSCALE_16BIT, CAN_FILTERMODE_IDLIST) ||
+        !filter_write_banks(
+                &planner, std_mask, n_std_mask, CAN_FILTERSCALE_16BIT, CAN_FILTERMODE_IDMASK) ||
+        !filter_write_banks(
+                &planner, ext_list, n_ext_list, CAN_FILTERSCALE_32BIT, CAN_FILTERMODE_IDLIST) ||
+        !filter_write_banks(
+                &planner, ext_mask, n_ext_mask, CAN_FILTERSCALE_32BIT, CAN_FILTERMODE_IDMASK))
+        return 0;
+
+    const uint32_t used = planner.bank - first_bank;
+
+    // 关闭剩余的过滤器组
+    for (uint32_t bank = planner.bank; bank < planner.last_bank; bank++)
+    {
+        const CAN_FilterTypeDef filter = { .FilterFIFOAssignment = CAN_FILTER_FIFO0,
+                                           .FilterBank           = bank,
+                                           .FilterMode           = CAN_FILTERMODE_IDMASK,
+                                           .FilterScale          = CAN_FILTERSCALE_32BIT,
+                                           .FilterActivation     = DISABLE,
+                                           .SlaveStartFilterBank = CAN_SLAVE_START_FILTER_BANK };
+        if (HAL_CAN_ConfigFilter(hcan, &filter) != HAL_OK)
+            CAN_ERROR_HANDLER();
+    }
+    return used;
+#endif
 }
 
 /**
- * CAN 初始化
+ * 取消注册 CAN Fifo 处理回调
+ *
+ * @attention 本函数非线程安全，调用时请注意
  * @param hcan can handle
- * @param ActiveITs CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO1_MSG_PENDING
+ * @param filter_match_index 需要取消注册对应的过滤器对应的 id
  */
-void CAN_Start(CAN_HandleTypeDef* hcan, const uint32_t ActiveITs)
+// void CAN_UnregisterCallback(CAN_HandleTypeDef* hcan, const uint32_t filter_match_index)
+// {
+//     CAN_FifoReceiveCallback_t* callbacks = get_callbacks(hcan);
+//     if (callbacks != NULL)
+//         callbacks[filter_match_index] = NULL;
+// }
+
+/**
+ * 将一帧交给对应的回调函数
+ *
+ * 查找顺序：FilterMatchIndex 表 -> ID 范围表 -> 广播回调
+ */
+static void can_dispatch(const CAN_HandleTypeDef*   hcan,
+                         const uint32_t             fifo,
+                         const CAN_RxHeaderTypeDef* header,
+                         const uint8_t              data[])
 {
-    if (HAL_CAN_Start(hcan) != HAL_OK)
+    const CAN_CallbackMap* map = get_map(hcan);
+    if (map == NULL)
+        return;
+
+    if (header->FilterMatchIndex < CAN_FILTER_INDEX_NUM)
     {
-        CAN_ERROR_HANDLER();
+        const uint8_t handler = map->filter_handlers[fifo][header->FilterMatchIndex];
+        if (handler != 0)
+        {
+            map->handlers[handler - 1](hcan, header, data);
+            return;
+        }
     }
 
-    if (HAL_CAN_ActivateNotification(hcan, ActiveITs) != HAL_OK)
+    const uint32_t id = header->IDE == CAN_ID_STD ? header->StdId : header->ExtId;
+    for (uint32_t i = 0; i < map->id_range_count; i++)
     {
-        CAN_ERROR_HANDLER();
+        const CAN_IdRange* range = &map->id_ranges[i];
+        if (range->ide == header->IDE && id >= range->id_min && id <= range->id_max)
+        {
+            map->handlers[range->handler - 1](hcan, header, data);
+            return;
+        }
     }
+
+    for (size_t i = 0; i < map->callback_count; i++)
+        map->callbacks[i](hcan, header, data);
 }
 
 /**
- * 注册 CAN Fifo 处理回调
+ * 取出 FIFO 中所有待处理的帧
  *
- * @attention 本函数非线程安全，调用时请注意
- * @param hcan hcan
- * @param callback 回调函数指针
+ * 一次中断内循环读取直到 FIFO 为空，并通过 FOVR 标志统计溢出次数
+ * @param hcan can handle
+ * @param fifo CAN_RX_FIFO0 或 CAN_RX_FIFO1
+ * @param callback 回调函数，NULL 表示按 can_dispatch 分发
+ * @return 取出的帧数
  */
-void CAN_RegisterCallback(CAN_HandleTypeDef* hcan, const CAN_FifoReceiveCallback_t callback)
+static uint32_t can_receive_fifo(CAN_HandleTypeDef*              hcan,
+                                 const uint32_t                  fifo,
+                                 const CAN_FifoReceiveCallback_t callback)
 {
-    CAN_CallbackMap* map = get_map(hcan);
+    CAN_CallbackMap* map   = get_map(hcan);
+    uint32_t         count = 0;
 
-    if (map == NULL)
+    while (port_rx_fill_level(hcan, fifo) > 0)
     {
-        if (map_size >= CAN_NUM)
+        CAN_RxHeaderTypeDef header;
+        uint8_t             data[CAN_MAX_DATA_LEN];
+        if (port_get_rx_message(hcan, fifo, &header, data) != HAL_OK)
         {
             CAN_ERROR_HANDLER();
-            return;
+            break;
+        }
+        ++count;
+        header.Timestamp = rx_timestamp(map, header.Timestamp);
+#ifdef CAN_CAPTURE
+        capture_rx(hcan, &header, data);
+#endif
+#ifdef CAN_STATS
+        if (map != NULL)
+        {
+            const uint32_t primask = can_enter_critical();
+            stats_count(&map->stats,
+                        false,
+                        header.IDE,
+                        header.IDE == CAN_ID_EXT ? header.ExtId : header.StdId,
+                        header.RTR,
+                        header.DLC);
+            can_exit_critical(primask);
+        }
+#endif
+#ifdef CAN_RX_DEFERRED
+        if (map != NULL)
+        {
+            // 只拷贝原始帧，解包留给 CAN_ProcessRxQueue
+            CAN_RxQueue*   queue = &map->rx_queue;
+            const uint32_t head  = queue->head;
+            if (head - queue->tail >= CAN_RX_QUEUE_SIZE)
+            {
+                map->rx.dropped++;
+                continue;
+            }
+            CAN_RxFrame* frame = &queue->frames[head & (CAN_RX_QUEUE_SIZE - 1)];
+            frame->header      = header;
+            memcpy(frame->data, data, sizeof(data));
+            frame->fifo     = fifo;
+            frame->callback = callback;
+            __DMB(); // 帧内容写入完成后再发布
+            queue->head = head + 1;
+            continue;
         }
-        maps[map_size] =
-                (CAN_CallbackMap) { .hcan = hcan, .callbacks = { NULL }, .callback_count = 0 };
-        map = &maps[map_size];
-        map_size++;
+#endif
+        if (callback != NULL)
+            callback(hcan, &header, data);
+        else
+            can_dispatch(hcan, fifo, &header, data);
     }
-    if (map->callback_count < CAN_MAX_CALLBACK_NUM)
-        map->callbacks[map->callback_count++] = callback;
-    else
-        CAN_ERROR_HANDLER();
+
+    const bool overrun = port_take_overrun(hcan, fifo);
+
+    if (map != NULL)
+    {
+        map->rx.frames += count;
+        if (count > map->rx.max_batch)
+            map->rx.max_batch = count;
+        if (overrun)
+            map->rx.overrun[fifo]++;
+    }
+    return count;
 }
+
 /**
- * 取消注册 CAN Fifo 处理回调
+ * CAN Fifo0 接收处理函数
  *
- * @attention 本函数非线程安全，调用时请注意
+ * 本函数将会根据 hcan 和 rx_header 内部的 FilterMatchIndex 来调用对应的回调函数，
+ * 一次调用会处理 FIFO 内所有的帧
  * @param hcan can handle
- * @param filter_match_index 需要取消注册对应的过滤器对应的 id
  */
-// void CAN_UnregisterCallback(CAN_HandleTypeDef* hcan, const uint32_t filter_match_index)
-// {
-//     CAN_FifoReceiveCallback_t* callbacks = get_callbacks(hcan);
-//     if (callbacks != NULL)
-//         callbacks[filter_match_index] = NULL;
-// }
+void CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan)
+{
+    can_receive_fifo(hcan, CAN_RX_FIFO0, NULL);
+}
 
 /**
- * CAN Fifo0 接收处理函数
+ * CAN Fifo1 接收处理函数
  *
- * 本函数将会根据 hcan 和 rx_header 内部的 filter_id 来调用对应的回调函数
+ * 本函数将会根据 hcan 和 rx_header 内部的 FilterMatchIndex 来调用对应的回调函数，
+ * 一次调用会处理 FIFO 内所有的帧
  * @param hcan can handle
  */
-void CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan)
+void CAN_Fifo1ReceiveCallback(CAN_HandleTypeDef* hcan)
+{
+    can_receive_fifo(hcan, CAN_RX_FIFO1, NULL);
+}
+
+/**
+ * 取出 FIFO 中所有的帧并交给指定的回调函数
+ *
+ * 供驱动自带的 *_CAN_Fifo{0,1}ReceiveCallback 使用，溢出同样计入 CAN_GetRxStats
+ * @param hcan can handle
+ * @param fifo CAN_RX_FIFO0 或 CAN_RX_FIFO1
+ * @param callback 回调函数
+ * @return 取出的帧数
+ */
+uint32_t CAN_ReceiveAll(CAN_HandleTypeDef*              hcan,
+                        const uint32_t                  fifo,
+                        const CAN_FifoReceiveCallback_t callback)
+{
+    return can_receive_fifo(hcan, fifo, callback);
+}
+
+/**
+ * 处理接收队列中的帧
+ *
+ * 仅在 CAN_RX_DEFERRED 模式下有效，只处理调用时已入队的帧，保证同一控制周期内使用同一批反馈。
+ * 应在控制任务中、Motor_PosCtrlUpdate 等控制计算之前调用，且同一总线只能有一个调用者
+ * @param hcan can handle
+ * @return 处理的帧数
+ */
+uint32_t CAN_ProcessRxQueue(CAN_HandleTypeDef* hcan)
 {
-    CAN_RxHeaderTypeDef header;
-    uint8_t             data[8];
-    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &header, data) != HAL_OK)
+#ifdef CAN_RX_DEFERRED
+    CAN_CallbackMap* map = get_map(hcan);
+    if (map == NULL)
+        return 0;
+
+    CAN_RxQueue*   queue = &map->rx_queue;
+    const uint32_t head  = queue->head;
+    __DMB(); // 读取到 head 之后再读取帧内容
+    uint32_t tail  = queue->tail;
+    uint32_t count = 0;
+    for (; tail != head; tail++, count++)
     {
-        CAN_ERROR_HANDLER();
-        return;
+        const CAN_RxFrame* frame = &queue->frames[tail & (CAN_RX_QUEUE_SIZE - 1)];
+        if (frame->callback != NULL)
+            frame->callback(hcan, &frame->header, frame->data);
+        else
+            can_dispatch(hcan, frame->fifo, &frame->header, frame->data);
     }
-    const CAN_CallbackMap* map = get_map(hcan);
-    if (map != NULL)
-        for (size_t i = 0; i < map->callback_count; i++)
-            map->callbacks[i](hcan, &header, data);
+    __DMB(); // 帧处理完成后再释放空间
+    queue->tail = tail;
+    return count;
+#else
+    (void) hcan;
+    return 0;
+#endif
 }
+
 /**
- * CAN Fifo1 接收处理函数
+ * 获取当前时间，与接收时间戳同一时基
  *
- * 本函数将会根据 hcan 和 rx_header 内部的 filter_id 来调用对应的回调函数
+ * 由 DWT 周期计数器累加得到，精度 1 us，约 71 分钟回绕一次，计算时间差请使用无符号减法。
+ * 两次调用间隔超过 DWT 计数器周期（168 MHz 下约 25 s）时退化为 HAL_GetTick 的精度
+ * @attention 必须先调用 CAN_Start 开启 DWT
+ * @return 时间戳 (unit: us)
+ */
+uint32_t CAN_GetTimeUs(void)
+{
+    const uint32_t primask       = can_enter_critical();
+    const uint32_t cycles        = DWT->CYCCNT;
+    const uint32_t tick          = HAL_GetTick();
+    const uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+
+    const uint32_t elapsed_ms = tick - can_clock.tick;
+    if (elapsed_ms < 0xFFFFFFFFU / SystemCoreClock * 1000U / 2U)
+    {
+        const uint32_t elapsed = cycles - can_clock.cycles + can_clock.rem;
+        can_clock.us += elapsed / cycles_per_us;
+        can_clock.rem = elapsed % cycles_per_us;
+    }
+    else
+    {
+        // DWT 计数器可能已回绕，按毫秒补齐
+        can_clock.us += elapsed_ms * 1000U;
+        can_clock.rem = 0;
+    }
+    can_clock.cycles = cycles;
+    can_clock.tick   = tick;
+
+    const uint32_t us = can_clock.us;
+    can_exit_critical(primask);
+    return us;
+}
+
+/**
+ * 获取接收统计信息
  * @param hcan can handle
+ * @param stats 输出
  */
-void CAN_Fifo1ReceiveCallback(CAN_HandleTypeDef* hcan)
+void CAN_GetRxStats(const CAN_HandleTypeDef* hcan, CAN_RxStats_t* stats)
 {
-    CAN_RxHeaderTypeDef header;
-    uint8_t             data[8];
-    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO1, &header, data) != HAL_OK)
+    const CAN_CallbackMap* map = get_map(hcan);
+    if (map == NULL)
     {
-        CAN_ERROR_HANDLER();
+        memset(stats, 0, sizeof(CAN_RxStats_t));
         return;
     }
-    const CAN_CallbackMap* map = get_map(hcan);
-    if (map != NULL)
-        for (size_t i = 0; i < map->callback_count; i++)
-            map->callbacks[i](hcan, &header, data);
+    const uint32_t primask = can_enter_critical();
+    *stats                 = map->rx;
+    can_exit_critical(primask);
+}
+
+#ifdef CAN_STATS
+/**
+ * 获取总线统计快照
+ *
+ * bus_load 为本次与上一次调用（或 CAN_Start / CAN_ResetStats）之间的总线占用率，
+ * 因此应由同一个任务周期性调用，例如每 100 ms 一次
+ * @param hcan can handle
+ * @param stats 输出，ids 中只有前 id_count 项有效
+ */
+void CAN_GetStats(const CAN_HandleTypeDef* hcan, CAN_Stats_t* stats)
+{
+    CAN_CallbackMap* map = get_map(hcan);
+    memset(stats, 0, sizeof(CAN_Stats_t));
+    if (map == NULL)
+        return;
+
+    const uint32_t primask = can_enter_critical();
+    memcpy(stats, &map->stats.counters, offsetof(CAN_Stats_t, ids));
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < CAN_STATS_ID_NUM; i++)
+        if (map->stats.id_used[i])
+            stats->ids[count++] = map->stats.counters.ids[i];
+    can_exit_critical(primask);
+    stats->id_count = count;
+
+    const uint32_t now  = HAL_GetTick();
+    const uint32_t bits = stats->bits - map->stats.window_bits;
+    stats->window_ms    = now - map->stats.window_tick;
+    if (stats->window_ms > 0)
+        stats->bus_load = (float) bits * 100000.0f /
+                          ((float) can_bitrate(hcan) * (float) stats->window_ms);
+    map->stats.window_tick = now;
+    map->stats.window_bits = stats->bits;
+}
+
+/**
+ * 清空总线统计
+ * @param hcan can handle
+ */
+void CAN_ResetStats(const CAN_HandleTypeDef* hcan)
+{
+    CAN_CallbackMap* map = get_map(hcan);
+    if (map == NULL)
+        return;
+
+    const uint32_t primask = can_enter_critical();
+    memset(&map->stats, 0, sizeof(CAN_StatsData));
+    map->stats.window_tick = HAL_GetTick();
+    can_exit_critical(primask);
+}
+#endif
+
+#ifdef CAN_CAPTURE
+/**
+ * 开始录制所有总线的收发帧
+ */
+void CAN_CaptureStart(void)
+{
+    capture.enabled = true;
+}
+
+/**
+ * 停止录制，缓冲区中未导出的记录仍可通过 CAN_CaptureFlush 导出
+ */
+void CAN_CaptureStop(void)
+{
+    capture.enabled = false;
+}
+
+/**
+ * 导出录制缓冲区中的记录
+ *
+ * 每次调用 write 输出一段连续的记录，write 返回 false 时停止，剩余记录保留到下次导出。
+ * 缓冲区空间在 write 返回后立即复用，使用 DMA 发送时 write 需要先把数据拷贝出去。
+ * @attention 只能在一个任务中调用，不要在中断中调用
+ * @param write 输出函数
+ * @return 本次导出的记录数
+ */
+uint32_t CAN_CaptureFlush(const CAN_CaptureWrite_t write)
+{
+    uint32_t flushed = 0;
+    for (;;)
+    {
+        const uint32_t head = capture.head;
+        __DMB(); // 读取到 head 之后再读取记录内容
+        const uint32_t tail  = capture.tail;
+        const uint32_t index = tail & (CAN_CAPTURE_SIZE - 1);
+        uint32_t       count = head - tail;
+        if (count == 0)
+            break;
+        if (count > CAN_CAPTURE_SIZE - index)
+            count = CAN_CAPTURE_SIZE - index; // 只输出到缓冲区末尾，剩余部分下一轮输出
+
+        if (!write((const uint8_t*) &capture.records[index], count * sizeof(CAN_CaptureRecord_t)))
+            break;
+        capture.tail = tail + count;
+        flushed += count;
+    }
+    return flushed;
+}
+
+/**
+ * 获取录制统计信息
+ * @param stats 输出
+ */
+void CAN_GetCaptureStats(CAN_CaptureStats_t* stats)
+{
+    const uint32_t primask = can_enter_critical();
+    stats->recorded        = capture.recorded;
+    stats->dropped         = capture.dropped;
+    stats->pending         = capture.head - capture.tail;
+    can_exit_critical(primask);
 }
+#endif
 
 #ifdef __cplusplus
 }
@@ -25,12 +25,232 @@
 #ifndef CAN_H
 #define CAN_H
 
+#include <stdbool.h>
 #include "main.h"
 
+/**
+ * 只启用了 FDCAN 外设（STM32G4 / H7 等）时自动使用 FDCAN 后端
+ */
+#if defined(HAL_FDCAN_MODULE_ENABLED) && !defined(HAL_CAN_MODULE_ENABLED)
+#    define CAN_USE_FDCAN
+#endif
+
+#ifdef CAN_USE_FDCAN
+/**
+ * FDCAN 兼容层
+ *
+ * 沿用 bxCAN HAL 的类型名和字段，驱动层代码无需修改。DLC 直接表示数据字节数（FD 帧最多 64），
+ * FilterMatchIndex 由 can_driver 按过滤器元素编号换算，未匹配任何过滤器的帧为 CAN_FILTER_INDEX_NUM
+ */
+typedef FDCAN_HandleTypeDef CAN_HandleTypeDef;
+typedef FDCAN_GlobalTypeDef CAN_TypeDef;
+
+typedef struct
+{
+    uint32_t        StdId;
+    uint32_t        ExtId;
+    uint32_t        IDE;      ///< CAN_ID_STD / CAN_ID_EXT
+    uint32_t        RTR;      ///< CAN_RTR_DATA / CAN_RTR_REMOTE
+    uint32_t        DLC;      ///< 数据字节数 0 ~ 8，FD 帧为 0 ~ 64
+    uint32_t        FDFormat; ///< CAN_FD_CLASSIC / CAN_FD_NO_BRS / CAN_FD_BRS
+    FunctionalState TransmitGlobalTime;
+} CAN_TxHeaderTypeDef;
+
+typedef struct
+{
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    uint32_t FDFormat;
+    uint32_t Timestamp;
+    uint32_t FilterMatchIndex;
+} CAN_RxHeaderTypeDef;
+
+/**
+ * bxCAN 格式的过滤器配置，CAN_ConfigFilter 会把它换算成 FDCAN 过滤器元素
+ */
+typedef struct
+{
+    uint32_t FilterIdHigh;
+    uint32_t FilterIdLow;
+    uint32_t FilterMaskIdHigh;
+    uint32_t FilterMaskIdLow;
+    uint32_t FilterFIFOAssignment;
+    uint32_t FilterBank; ///< FDCAN 下忽略，过滤器元素按配置顺序分配
+    uint32_t FilterMode;
+    uint32_t FilterScale;
+    uint32_t FilterActivation;
+    uint32_t SlaveStartFilterBank;
+} CAN_FilterTypeDef;
+
+#    define CAN_ID_STD            (0x00000000U)
+#    define CAN_ID_EXT            (0x00000004U)
+#    define CAN_RTR_DATA          (0x00000000U)
+#    define CAN_RTR_REMOTE        (0x00000002U)
+#    define CAN_RX_FIFO0          (0x00000000U)
+#    define CAN_RX_FIFO1          (0x00000001U)
+#    define CAN_FILTER_FIFO0      (0x00000000U)
+#    define CAN_FILTER_FIFO1      (0x00000001U)
+#    define CAN_FILTERMODE_IDMASK (0x00000000U)
+#    define CAN_FILTERMODE_IDLIST (0x00000001U)
+#    define CAN_FILTERSCALE_16BIT (0x00000000U)
+#    define CAN_FILTERSCALE_32BIT (0x00000001U)
+
+#    define CAN_IT_RX_FIFO0_MSG_PENDING FDCAN_IT_RX_FIFO0_NEW_MESSAGE
+#    define CAN_IT_RX_FIFO1_MSG_PENDING FDCAN_IT_RX_FIFO1_NEW_MESSAGE
+
+#    define CAN_FD_CLASSIC (0U) ///< 经典 CAN 帧
+#    define CAN_FD_NO_BRS  (1U) ///< CAN-FD 帧，不切换波特率
+#    define CAN_FD_BRS     (2U) ///< CAN-FD 帧，数据段切换到数据波特率
+
+/**
+ * 标准帧和扩展帧过滤器元素数量上限（STM32G4 固定为 28 / 8，H7 由 CubeMX 配置），
+ * 扩展帧过滤器元素的 FilterMatchIndex 从 CAN_FDCAN_STD_FILTER_NUM 开始
+ */
+#    ifndef CAN_FDCAN_STD_FILTER_NUM
+#        define CAN_FDCAN_STD_FILTER_NUM (28)
+#    endif
+#    ifndef CAN_FDCAN_EXT_FILTER_NUM
+#        define CAN_FDCAN_EXT_FILTER_NUM (8)
+#    endif
+
+/**
+ * 发送缓冲区数量
+ */
+#    ifdef FDCAN_TX_BUFFER31
+#        define CAN_TX_SLOT_NUM (32)
+#    else
+#        define CAN_TX_SLOT_NUM (3)
+#    endif
+
+#    define CAN_MAX_DATA_LEN (64)
+
+// 需要把多个经典帧打包进一个 64 字节 CAN-FD 帧发送时请启用以下宏，见 CAN_SetFdPacking
+// #define CAN_FD_PACK
+
+#    ifndef CAN_FD_PACK_ID
+/**
+ * CAN_FD_PACK 模式下打包帧的标准帧 ID，由对端网桥 / 固件解包
+ */
+#        define CAN_FD_PACK_ID (0x7F0U)
+#    endif
+#else
+#    define CAN_TX_SLOT_NUM  (3)
+#    define CAN_MAX_DATA_LEN (8)
+#endif
+
+// 希望收发直接读写 bxCAN 邮箱寄存器，跳过 HAL_CAN_AddTxMessage / HAL_CAN_GetRxMessage 的
+// 状态检查和帧头转换时请启用以下宏，只支持 bxCAN 目标板
+// #define CAN_LL
+
+#if defined(CAN_LL) && defined(CAN_USE_FDCAN)
+#    error "CAN_LL only supports bxCAN"
+#endif
+
 #define CAN_ERROR_HANDLER()  Error_Handler()
 #define CAN_SEND_FAILED      (0xFFFF)
+#define CAN_SEND_QUEUED      (0xFFFE)
 #define CAN_SEND_TIMEOUT     (10)
 #define CAN_MAX_CALLBACK_NUM (14)
+#define CAN_MAX_ID_RANGE_NUM (8)
+/**
+ * 每个 FIFO 的过滤器编号 (FilterMatchIndex) 上限：14 个过滤器组，每组最多 4 个过滤器
+ */
+#define CAN_FILTER_INDEX_NUM (56)
+/**
+ * 每条总线可用的过滤器组数量，CAN2 的过滤器组从 CAN_SLAVE_START_FILTER_BANK 开始
+ */
+#define CAN_FILTER_BANK_NUM         (14)
+#define CAN_SLAVE_START_FILTER_BANK (14)
+/**
+ * 每条总线可登记到过滤器规划的 ID 数量上限
+ */
+#define CAN_MAX_FILTER_ENTRY_NUM (32)
+
+// 希望接收中断只拷贝原始帧、在控制任务中统一解包时请启用以下宏
+// 启用后需要在控制周期开始时（如 Motor_PosCtrlUpdate 之前）调用 CAN_ProcessRxQueue
+// #define CAN_RX_DEFERRED
+
+#ifndef CAN_RX_QUEUE_SIZE
+/**
+ * CAN_RX_DEFERRED 模式下每条总线的接收队列长度，必须为 2 的幂
+ */
+#    define CAN_RX_QUEUE_SIZE (32)
+#endif
+
+/**
+ * 接收中断会把 CAN_RxHeaderTypeDef::Timestamp 改写为 32 位时间戳 (unit: us)，与 CAN_GetTimeUs
+ * 同一时基。默认取接收中断中的 DWT 时间；在 CubeMX 中开启 Time Triggered Communication Mode 后
+ * 可以启用以下宏，改用 bxCAN 锁存的 16 位位时间计数器推算，不受中断延迟和 FIFO 排队影响
+ */
+// #define CAN_HW_TIMESTAMP
+
+#ifndef CAN_IRQ_PRIORITY
+/**
+ * CAN 收发中断的抢占优先级（NVIC 优先级数值，越小越优先）
+ *
+ * can_driver 的临界区通过 BASEPRI 只屏蔽优先级数值 >= CAN_IRQ_PRIORITY 的中断，编码器定时器、
+ * 串口 DMA 等更高优先级的中断不受影响。CAN TX / RX0 / RX1 中断以及所有调用 can_driver 接口的中断
+ * 的优先级数值都不能小于该值：CAN_Start 总会检查 CAN 中断，定义 USE_FULL_ASSERT 时还会检查
+ * 调用者。设为 0 或在 Cortex-M0 上退回到屏蔽全部中断 (PRIMASK)
+ */
+#    define CAN_IRQ_PRIORITY (5)
+#endif
+
+#ifndef CAN_TX_QUEUE_SIZE
+/**
+ * 每条总线的软件发送队列长度，必须为 2 的幂
+ */
+#    define CAN_TX_QUEUE_SIZE (32)
+#endif
+
+#ifndef CAN_TX_TELEMETRY_QUEUE_SIZE
+/**
+ * 每条总线的低优先级（遥测）发送队列长度，必须为 2 的幂
+ */
+#    define CAN_TX_TELEMETRY_QUEUE_SIZE (8)
+#endif
+
+#ifndef CAN_TX_TELEMETRY_SLOTS
+/**
+ * 低优先级帧最多同时占用的发送邮箱数，其余邮箱始终留给控制帧
+ */
+#    define CAN_TX_TELEMETRY_SLOTS (1)
+#endif
+
+// 需要录制总线上的帧（用于复现现场问题或回放测试）时请启用以下宏
+// #define CAN_CAPTURE
+
+#ifndef CAN_CAPTURE_SIZE
+/**
+ * CAN_CAPTURE 模式下录制缓冲区可容纳的记录数（所有总线共用），必须为 2 的幂
+ */
+#    define CAN_CAPTURE_SIZE (256)
+#endif
+
+#ifndef CAN_CAPTURE_TIMESTAMP
+/**
+ * 录制时间戳 (unit: us)，默认与接收时间戳同一时基
+ */
+#    define CAN_CAPTURE_TIMESTAMP() (CAN_GetTimeUs())
+#endif
+
+// 需要统计每个 ID 的流量、总线负载和发送延迟时请启用以下宏，延迟由 DWT 周期计数器测量
+// #define CAN_STATS
+
+#ifndef CAN_STATS_ID_NUM
+/**
+ * CAN_STATS 模式下每条总线可分别统计的 ID 数量，必须为 2 的幂
+ */
+#    define CAN_STATS_ID_NUM (32)
+#endif
+
+/**
+ * 延迟直方图的区间数，第 0 格为 0 us，第 k 格为 [2^(k-1), 2^k) us，最后一格包含所有更长的延迟
+ */
+#define CAN_STATS_HIST_BIN_NUM (16)
 
 #ifdef __cplusplus
 extern "C"
@@ -42,18 +262,192 @@ typedef void (*CAN_FifoReceiveCallback_t)(const CAN_HandleTypeDef*   hcan,
                                           const CAN_RxHeaderTypeDef* header,
                                           const uint8_t*             data);
 
+/**
+ * 发送队列满时的处理策略
+ */
+typedef enum
+{
+    CAN_TX_POLICY_DROP_NEWEST = 0U, ///< 丢弃新帧，CAN_SendMessage 返回 CAN_SEND_FAILED
+    CAN_TX_POLICY_OVERWRITE_OLDEST, ///< 覆盖队列中最旧的帧
+} CAN_TxQueuePolicy_t;
+
+/**
+ * 发送优先级，每条总线的每个优先级各有一个发送队列
+ */
+typedef enum
+{
+    CAN_TX_PRIO_CONTROL = 0U, ///< 控制指令，CAN_SendMessage 使用的默认优先级
+    CAN_TX_PRIO_TELEMETRY,    ///< 遥测、调试等，只在控制队列为空时发送
+    CAN_TX_PRIO_NUM,
+} CAN_TxPriority_t;
+
+typedef struct
+{
+    uint32_t dropped;     ///< 因队列满被丢弃的新帧数
+    uint32_t overwritten; ///< 因队列满被覆盖的旧帧数
+    uint32_t high_water;  ///< 队列最高水位
+    uint32_t pending;     ///< 当前排队帧数
+    uint32_t max_wait_us; ///< 最长排队时间 (unit: us)
+} CAN_TxStats_t;
+
+typedef struct
+{
+    uint32_t frames;     ///< 接收到的帧数
+    uint32_t overrun[2]; ///< 各 FIFO 溢出次数 (FOVR)，每次溢出至少丢失一帧
+    uint32_t max_batch;  ///< 单次中断取出的最大帧数
+    uint32_t dropped;    ///< CAN_RX_DEFERRED 模式下因接收队列满丢弃的帧数
+} CAN_RxStats_t;
+
+typedef struct
+{
+    uint32_t ide;       ///< CAN_ID_STD / CAN_ID_EXT
+    uint32_t id;        ///< StdId 或 ExtId
+    uint32_t rx_frames; ///< 接收帧数
+    uint32_t rx_bytes;  ///< 接收数据字节数
+    uint32_t tx_frames; ///< 发送帧数（写入邮箱时计数）
+    uint32_t tx_bytes;  ///< 发送数据字节数
+} CAN_IdStats_t;
+
+/**
+ * 总线统计快照，由 CAN_GetStats 填写
+ */
+typedef struct
+{
+    uint32_t rx_frames;
+    uint32_t rx_bytes;
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    uint32_t bits;      ///< 估算的总线位数（含最坏情况位填充和帧间隔），会回绕
+    uint32_t untracked; ///< ID 表已满、未计入 ids 的帧数
+
+    uint32_t window_ms; ///< 本次与上次 CAN_GetStats 之间的时间
+    float    bus_load;  ///< 该窗口内的总线占用率 (unit: %)
+
+    uint32_t queue_latency[CAN_STATS_HIST_BIN_NUM];   ///< CAN_SendMessage 到写入邮箱的延迟直方图
+    uint32_t mailbox_latency[CAN_STATS_HIST_BIN_NUM]; ///< 写入邮箱到发送完成的延迟直方图
+    uint32_t queue_latency_max;                       ///< (unit: us)
+    uint32_t mailbox_latency_max;                     ///< (unit: us)
+
+    CAN_IdStats_t ids[CAN_STATS_ID_NUM];
+    uint32_t      id_count;
+} CAN_Stats_t;
+
+#define CAN_CAPTURE_MAGIC    (0xC5)
+#define CAN_CAPTURE_FLAG_EXT (0x01) ///< 扩展帧
+#define CAN_CAPTURE_FLAG_RTR (0x02) ///< 远程帧
+#define CAN_CAPTURE_FLAG_TX  (0x04) ///< 本机发出的帧
+
+/**
+ * 录制记录，固定 20 字节，小端序
+ *
+ * 录制文件就是若干条记录直接拼接，magic 用于在串口丢字节后重新对齐
+ */
+typedef struct
+{
+    uint32_t timestamp; ///< 时间戳 (unit: us)
+    uint32_t id;        ///< StdId 或 ExtId
+    uint8_t  bus;       ///< 总线编号 0: CAN1, 1: CAN2, 2: CAN3
+    uint8_t  flags;     ///< CAN_CAPTURE_FLAG_*
+    uint8_t  dlc;       ///< 数据长度
+    uint8_t  magic;     ///< CAN_CAPTURE_MAGIC
+    uint8_t  data[8];
+} CAN_CaptureRecord_t;
+
+typedef struct
+{
+    uint32_t recorded; ///< 已录制的帧数
+    uint32_t dropped;  ///< 因缓冲区满丢弃的帧数
+    uint32_t pending;  ///< 尚未导出的帧数
+} CAN_CaptureStats_t;
+
+/**
+ * 录制数据的输出函数，例如阻塞式串口发送
+ * @param data 数据
+ * @param size 字节数，总是记录大小的整数倍
+ * @return 是否已全部发出；返回 false 时剩余记录保留到下次导出
+ */
+typedef bool (*CAN_CaptureWrite_t)(const uint8_t* data, uint32_t size);
+
 // TODO: 增加更完善的错误返回逻辑
 
 uint32_t CAN_SendMessage(CAN_HandleTypeDef*         hcan,
                          const CAN_TxHeaderTypeDef* header,
                          const uint8_t              data[]);
+uint32_t CAN_SendMessageWithPriority(CAN_HandleTypeDef*         hcan,
+                                     const CAN_TxHeaderTypeDef* header,
+                                     const uint8_t              data[],
+                                     CAN_TxPriority_t           priority);
 void     CAN_Start(CAN_HandleTypeDef* hcan, uint32_t ActiveITs);
 
 void CAN_RegisterCallback(CAN_HandleTypeDef* hcan, CAN_FifoReceiveCallback_t callback);
 
+HAL_StatusTypeDef CAN_ConfigFilter(CAN_HandleTypeDef*        hcan,
+                                   const CAN_FilterTypeDef*  filter,
+                                   CAN_FifoReceiveCallback_t callback);
+void              CAN_RegisterFilterCallback(CAN_HandleTypeDef*        hcan,
+                                             uint32_t                  fifo,
+                                             uint32_t                  filter_match_index,
+                                             CAN_FifoReceiveCallback_t callback);
+void              CAN_RegisterIdRangeCallback(CAN_HandleTypeDef*        hcan,
+                                              uint32_t                  ide,
+                                              uint32_t                  id_min,
+                                              uint32_t                  id_max,
+                                              CAN_FifoReceiveCallback_t callback);
+
+void CAN_SetTxQueuePolicy(const CAN_HandleTypeDef* hcan, CAN_TxQueuePolicy_t policy);
+void CAN_GetTxStats(const CAN_HandleTypeDef* hcan, CAN_TxStats_t* stats);
+void CAN_GetTxQueueStats(const CAN_HandleTypeDef* hcan,
+                         CAN_TxPriority_t         priority,
+                         CAN_TxStats_t*           stats);
+void CAN_TxMailboxCompleteCallback(CAN_HandleTypeDef* hcan);
+
 // void CAN_UnregisterCallback(CAN_HandleTypeDef* hcan, uint32_t filter_match_index);
-void CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan);
-void CAN_Fifo1ReceiveCallback(CAN_HandleTypeDef* hcan);
+void     CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan);
+void     CAN_Fifo1ReceiveCallback(CAN_HandleTypeDef* hcan);
+uint32_t CAN_ReceiveAll(CAN_HandleTypeDef* hcan, uint32_t fifo, CAN_FifoReceiveCallback_t callback);
+void     CAN_GetRxStats(const CAN_HandleTypeDef* hcan, CAN_RxStats_t* stats);
+uint32_t CAN_ProcessRxQueue(CAN_HandleTypeDef* hcan);
+uint32_t CAN_GetTimeUs(void);
+uint8_t  CAN_GetBusIndex(const CAN_HandleTypeDef* hcan);
+
+void     CAN_FilterAddId(CAN_HandleTypeDef*        hcan,
+                         uint32_t                  ide,
+                         uint32_t                  id,
+                         CAN_FifoReceiveCallback_t callback);
+void     CAN_FilterAddMask(CAN_HandleTypeDef*        hcan,
+                           uint32_t                  ide,
+                           uint32_t                  id,
+                           uint32_t                  mask,
+                           CAN_FifoReceiveCallback_t callback);
+uint32_t CAN_FilterApply(CAN_HandleTypeDef* hcan, bool dual_fifo);
+
+#ifdef CAN_STATS
+void CAN_GetStats(const CAN_HandleTypeDef* hcan, CAN_Stats_t* stats);
+void CAN_ResetStats(const CAN_HandleTypeDef* hcan);
+#endif
+
+#ifdef CAN_LL
+HAL_StatusTypeDef CAN_LL_AddTxMessage(CAN_HandleTypeDef*         hcan,
+                                      const CAN_TxHeaderTypeDef* header,
+                                      const uint8_t              data[],
+                                      uint32_t*                  mailbox);
+HAL_StatusTypeDef CAN_LL_GetRxMessage(CAN_HandleTypeDef*   hcan,
+                                      uint32_t             fifo,
+                                      CAN_RxHeaderTypeDef* header,
+                                      uint8_t              data[]);
+#endif
+
+#if defined(CAN_USE_FDCAN) && defined(CAN_FD_PACK)
+void     CAN_SetFdPacking(const CAN_HandleTypeDef* hcan, bool enable);
+uint32_t CAN_FdPackFlush(const CAN_HandleTypeDef* hcan);
+#endif
+
+#ifdef CAN_CAPTURE
+void     CAN_CaptureStart(void);
+void     CAN_CaptureStop(void);
+uint32_t CAN_CaptureFlush(CAN_CaptureWrite_t write);
+void     CAN_GetCaptureStats(CAN_CaptureStats_t* stats);
+#endif
 
 #ifdef __cplusplus
 }
@@ -24,6 +24,7 @@
 #include "DJI.h"
 #include <string.h>
 #include "bsp/can_driver.h"
+#include "cmsis_compiler.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -41,24 +42,65 @@ static void DJI_Eat(DJI_t* dji)
         dji->feedback_snacks--;
 }
 
+/**
+ * 每条总线的电机和控制帧，下标为 CAN_GetBusIndex
+ */
 static DJI_FeedbackMap map[CAN_NUM];
-static size_t          map_size = 0;
 
 /**
  * 电机减速比 map
  */
 static float reduction_rate_map[DJI_MOTOR_TYPE_COUNT] = {
-    [M3508_C620] = (3591.0f / 187.0f),
-    [M2006_C610] = (36.0f),
+    [M3508_C620]     = (3591.0f / 187.0f),
+    [M2006_C610]     = (36.0f),
+    [GM6020_VOLTAGE] = (1.0f),
+    [GM6020_CURRENT] = (1.0f),
 };
 
-static inline DJI_t* getDJIHandle(DJI_t* motors[8], const CAN_RxHeaderTypeDef* header)
+/**
+ * 电调电流反馈换算系数 map (unit: A/LSB)
+ */
+static float current_scale_map[DJI_MOTOR_TYPE_COUNT] = {
+    [M3508_C620]     = (20.0f / 16384.0f),
+    [M2006_C610]     = (10.0f / 10000.0f),
+    [GM6020_VOLTAGE] = (3.0f / 16384.0f),
+    [GM6020_CURRENT] = (3.0f / 16384.0f),
+};
+
+/**
+ * 电机减速箱输出端转矩常数 map (unit: N·m/A)
+ */
+static float torque_const_map[DJI_MOTOR_TYPE_COUNT] = {
+    [M3508_C620]     = (0.3f),
+    [M2006_C610]     = (0.18f),
+    [GM6020_VOLTAGE] = (0.741f),
+    [GM6020_CURRENT] = (0.741f),
+};
+
+/**
+ * 控制帧分组，与 DJI_FeedbackMap::cmd_frames 一一对应，first 为组内第一个电机在反馈表中的下标
+ */
+static const struct
+{
+    uint16_t std_id;
+    uint8_t  first;
+    uint8_t  num;
+} cmd_groups[DJI_CMD_FRAME_NUM] = {
+    { 0x200, 0, 4 }, // C610 / C620 1 ~ 4
+    { 0x1FF, 4, 4 }, // C610 / C620 5 ~ 8，GM6020 电压控制 1 ~ 4
+    { 0x2FF, 8, 3 }, // GM6020 电压控制 5 ~ 7
+    { 0x1FE, 4, 4 }, // GM6020 电流控制 1 ~ 4
+    { 0x2FE, 8, 3 }, // GM6020 电流控制 5 ~ 7
+};
+
+static inline DJI_t* getDJIHandle(DJI_t*                     motors[DJI_FEEDBACK_NUM],
+                                  const CAN_RxHeaderTypeDef* header)
 {
     if (header->IDE != CAN_ID_STD)
         return NULL;
     const uint8_t id0 = header->StdId - 0x201;
     // 不是 DJI 的反馈数据
-    if (id0 >= 8)
+    if (id0 >= DJI_FEEDBACK_NUM)
         return NULL;
     if (motors[id0] == NULL)
     {
@@ -73,6 +115,10 @@ void DJI_Init(DJI_t* hdji, const DJI_Config_t* dji_config)
 {
     memset(hdji, 0, sizeof(DJI_t));
 
+    const float reduction_rate = dji_config->reduction_rate > 0 ? dji_config->reduction_rate
+                                                                : 1.0f; // 外接减速比
+    const float sign           = dji_config->reverse ? -1.0f : 1.0f;
+
     hdji->enable             = true;
     hdji->reverse            = dji_config->reverse;
     hdji->auto_zero          = dji_config->auto_zero;
@@ -80,35 +126,84 @@ void DJI_Init(DJI_t* hdji, const DJI_Config_t* dji_config)
     hdji->id1                = dji_config->id1;
     hdji->motor_type         = dji_config->motor_type;
     hdji->inv_reduction_rate = 1.0f / // 取倒数将除法转为乘法加快运算速度
-                               ((dji_config->reduction_rate > 0 ? dji_config->reduction_rate
-                                                                : 1.0f)        // 外接减速比
-                                * reduction_rate_map[dji_config->motor_type]); // 电机内部减速比
+                               (reduction_rate *
+                                reduction_rate_map[dji_config->motor_type]); // 电机内部减速比
+    // 电流和力矩的换算系数合并反转与减速比，读取时只需一次乘法
+    hdji->current_scale = sign * current_scale_map[dji_config->motor_type];
+    hdji->torque_scale =
+            hdji->current_scale * torque_const_map[dji_config->motor_type] * reduction_rate;
 
     hdji->feedback_snacks = 0;
+    MultiTurn_Init(&hdji->feedback.multi_turn, 8192, 0);
+
+    /* 反馈 ID 与控制帧 ID */
+    if (hdji->motor_type == GM6020_VOLTAGE || hdji->motor_type == GM6020_CURRENT)
+    {
+        if (hdji->id1 < 1 || hdji->id1 > 7)
+        {
+            DJI_ERROR_HANDLER();
+            return;
+        }
+        hdji->fb_id0 = hdji->id1 + 3; // 反馈 ID 为 0x204 + ID
+        if (hdji->motor_type == GM6020_VOLTAGE)
+            hdji->cmd_id = hdji->id1 <= 4 ? 0x1FF : 0x2FF;
+        else
+            hdji->cmd_id = hdji->id1 <= 4 ? 0x1FE : 0x2FE;
+    }
+    else
+    {
+        if (hdji->id1 < 1 || hdji->id1 > 8)
+        {
+            DJI_ERROR_HANDLER();
+            return;
+        }
+        hdji->fb_id0 = hdji->id1 - 1; // 反馈 ID 为 0x200 + ID
+        hdji->cmd_id = hdji->id1 <= 4 ? 0x200 : 0x1FF;
+    }
 
     /* 注册回调 */
-    DJI_t** mapped_motors = NULL;
-    for (int i = 0; i < map_size; i++)
-        if (map[i].can == hdji->can)
-            mapped_motors = map[i].motors;
-    if (mapped_motors == NULL)
+    const uint8_t bus = CAN_GetBusIndex(dji_config->hcan);
+    if (bus >= CAN_NUM)
+    {
+        // 总线编号超出 map 范围，请增大 CAN_NUM
+        DJI_ERROR_HANDLER();
+        return;
+    }
+    DJI_FeedbackMap* bus_map = &map[bus];
+    if (bus_map->can == NULL)
     {
-        // CAN 未被注册，添加到 map
-        map[map_size] = (DJI_FeedbackMap) {
-            .can = hdji->can, .motors = { NULL } // 为了好看
-        };
-        mapped_motors = map[map_size].motors;
-        map_size++;
+        // CAN 未被注册，生成控制帧的帧头
+        bus_map->can = hdji->can;
+        for (int g = 0; g < DJI_CMD_FRAME_NUM; g++)
+            bus_map->cmd_frames[g].header = (CAN_TxHeaderTypeDef) { .StdId = cmd_groups[g].std_id,
+                                                                    .IDE   = CAN_ID_STD,
+                                                                    .RTR   = CAN_RTR_DATA,
+                                                                    .DLC   = 8 };
     }
-    if (mapped_motors[hdji->id1 - 1] != NULL)
+    if (bus_map->motors[hdji->fb_id0] != NULL)
     {
-        // 电调 ID 冲突
+        // 反馈 ID 冲突
         DJI_ERROR_HANDLER();
+        return;
     }
-    else
+    bus_map->motors[hdji->fb_id0] = hdji;
+
+    /* 绑定控制帧中的位置 */
+    for (int g = 0; g < DJI_CMD_FRAME_NUM; g++)
     {
-        mapped_motors[hdji->id1 - 1] = hdji;
+        const uint8_t j = hdji->fb_id0 - cmd_groups[g].first;
+        if (cmd_groups[g].std_id == hdji->cmd_id && j < cmd_groups[g].num)
+        {
+            DJI_CmdFrame_t* frame = &bus_map->cmd_frames[g];
+            frame->motors[j]      = hdji;
+            frame->motor_num++;
+            hdji->cmd_data = &frame->data[j * 2];
+        }
     }
+
+    /* 登记反馈 ID，供 CAN_FilterApply 生成过滤器 */
+    CAN_FilterAddId(
+            dji_config->hcan, CAN_ID_STD, 0x201 + hdji->fb_id0, DJI_CAN_BaseReceiveCallback);
 }
 
 /**
@@ -121,26 +216,34 @@ void DJI_DataDecode(DJI_t* hdji, const uint8_t data[8])
     // 喂狗
     DJI_Feed(hdji);
 
-    const float feedback_angle = (float) ((uint16_t) data[0] << 8 | data[1]) * 360.0f / 8192.0f;
-    const float feedback_rpm   = (int16_t) ((uint16_t) data[2] << 8 | data[3]);
-    // TODO: 堵转电流检测
-    // const float feedback_current = (float)((int16_t)data[4] << 8 | data[5]) / 16384.0f * 20.0f;
+    const uint16_t raw_angle = (uint16_t) data[0] << 8 | data[1];
+    const int16_t  raw_rpm   = (int16_t) ((uint16_t) data[2] << 8 | data[3]);
 
-    // M3508 和 M2006 的转速均不会超过 120 deg/s
-    if (feedback_angle < 90 && hdji->feedback.mech_angle > 270)
-        hdji->feedback.round_cnt++;
-    if (feedback_angle > 270 && hdji->feedback.mech_angle < 90)
-        hdji->feedback.round_cnt--;
+    // 电流和温度只保存原始值，读取时才换算，不增加接收中断的浮点运算
+    hdji->feedback.current     = (int16_t) ((uint16_t) data[4] << 8 | data[5]);
+    hdji->feedback.temperature = (int8_t) data[6];
 
-    hdji->feedback.mech_angle = feedback_angle;
-    hdji->abs_angle           = (hdji->reverse ? -1.0f : 1.0f) * // 反转时需要反转角度输入
-                      ((float) hdji->feedback.round_cnt * 360.0f + hdji->feedback.mech_angle -
-                       hdji->angle_zero) *
-                      hdji->inv_reduction_rate;
+    // 转子转速换算为编码值/s (rpm * 8192 / 60)，用于丢帧时外推跨圈
+    const int32_t velocity = (int32_t) raw_rpm * 2048 / 15;
 
-    hdji->feedback.rpm = feedback_rpm;
-    hdji->velocity     = (hdji->reverse ? -1.0f : 1.0f) * // 反转时需要反转速度输入
-                     hdji->feedback.rpm * hdji->inv_reduction_rate;
+#ifdef DJI_LAZY_DECODE
+    hdji->raw.seq++;
+    __DMB(); // 先标记为正在写入
+    MultiTurn_Update(&hdji->feedback.multi_turn, raw_angle, velocity, hdji->feedback.timestamp);
+    hdji->raw.rpm = raw_rpm;
+    __DMB(); // 写入完成后再发布
+    hdji->raw.seq++;
+#else
+    MultiTurn_Update(&hdji->feedback.multi_turn, raw_angle, velocity, hdji->feedback.timestamp);
+
+    const float sign  = hdji->reverse ? -1.0f : 1.0f; // 反转时需要反转角度和速度输入
+    const float angle = MultiTurn_ToFloat(&hdji->feedback.multi_turn, 360.0f / 8192.0f);
+
+    hdji->feedback.mech_angle = (float) raw_angle * 360.0f / 8192.0f;
+    hdji->feedback.rpm        = raw_rpm;
+    hdji->abs_angle           = sign * angle * hdji->inv_reduction_rate;
+    hdji->velocity            = sign * hdji->feedback.rpm * hdji->inv_reduction_rate;
+#endif
 
     hdji->feedback_count++;
     if (hdji->feedback_count == 50 && hdji->auto_zero)
@@ -156,48 +259,125 @@ void DJI_DataDecode(DJI_t* hdji, const uint8_t data[8])
  */
 void DJI_ResetAngle(DJI_t* hdji)
 {
-    hdji->feedback.round_cnt = 0;
-    hdji->angle_zero         = hdji->feedback.mech_angle;
-    hdji->abs_angle          = 0;
+    MultiTurn_ResetZero(&hdji->feedback.multi_turn);
+#ifdef DJI_LAZY_DECODE
+    hdji->raw.decoded_seq = 1U; // 奇数，使缓存失效
+#endif
+    hdji->abs_angle = 0;
 }
 
+#ifdef DJI_LAZY_DECODE
 /**
- *
+ * 把最新的原始反馈换算为物理量，缓存仍有效时直接返回
+ * @param hdji DJI handle
+ */
+static void DJI_LazyDecode(DJI_t* hdji)
+{
+    uint32_t    seq;
+    MultiTurn_t multi_turn;
+    int16_t     raw_rpm;
+    do
+    {
+        seq = hdji->raw.seq;
+        if (seq == hdji->raw.decoded_seq)
+            return; // 缓存仍有效
+        if ((seq & 1U) != 0)
+            return; // 抢占了正在写入的接收中断，沿用上一次的值
+        __DMB();
+        multi_turn = hdji->feedback.multi_turn;
+        raw_rpm    = hdji->raw.rpm;
+        __DMB();
+    } while (seq != hdji->raw.seq); // 读取期间收到了新的反馈
+
+    const float sign  = hdji->reverse ? -1.0f : 1.0f; // 反转时需要反转角度和速度输入
+    const float angle = MultiTurn_ToFloat(&multi_turn, 360.0f / 8192.0f);
+
+    hdji->feedback.mech_angle = (float) multi_turn.raw * 360.0f / 8192.0f;
+    hdji->feedback.rpm        = raw_rpm;
+    hdji->abs_angle           = sign * angle * hdji->inv_reduction_rate;
+    hdji->velocity            = sign * hdji->feedback.rpm * hdji->inv_reduction_rate;
+    hdji->raw.decoded_seq     = seq;
+}
+
+/**
+ * 获取电机轴输出角度
+ * @param hdji DJI handle
+ * @return 角度 (unit: degree)
+ */
+float DJI_GetAngle(DJI_t* hdji)
+{
+    DJI_LazyDecode(hdji);
+    return hdji->abs_angle;
+}
+
+/**
+ * 获取电机轴输出速度
+ * @param hdji DJI handle
+ * @return 速度 (unit: rpm)
+ */
+float DJI_GetVelocity(DJI_t* hdji)
+{
+    DJI_LazyDecode(hdji);
+    return hdji->velocity;
+}
+#endif
+
+/**
+ * 发送一帧控制指令
  * @param hcan CAN handle
- * @param cmd_group ID 组
+ * @param frame 控制帧
  */
-void DJI_SendSetIqCommand(CAN_HandleTypeDef* hcan, const DJI_IqSetCmdGroup_t cmd_group)
+static void sendCmdFrame(CAN_HandleTypeDef* hcan, const DJI_CmdFrame_t* frame)
 {
-    for (int i = 0; i < map_size; i++)
+    for (int j = 0; j < 4; j++)
     {
-        if (hcan->Instance == map[i].can)
+        if (frame->motors[j] != NULL)
         {
-            uint8_t iq_data[8] = {};
-            for (int j = 0; j < 4; j++)
-            {
-                DJI_t* hdji = map[i].motors[j + cmd_group];
-                if (hdji != NULL)
-                {
-                    // 吃小零食
-                    DJI_Eat(hdji);
-
-                    const int32_t iq_cmd = hdji->reverse ? -hdji->iq_cmd : hdji->iq_cmd;
-                    iq_data[1 + j * 2]   = (uint8_t) (iq_cmd & 0xFF);      // 电流值低 8 位
-                    iq_data[0 + j * 2]   = (uint8_t) (iq_cmd >> 8 & 0xFF); // 电流值高 8 位
-                }
-            }
-            CAN_SendMessage(hcan,
-                            &(CAN_TxHeaderTypeDef) { .StdId = cmd_group == IQ_CMD_GROUP_1_4 ? 0x200
-                                                                                            : 0x1FF,
-                                                     .IDE   = CAN_ID_STD,
-                                                     .RTR   = CAN_RTR_DATA,
-                                                     .DLC   = 8 },
-                            iq_data);
-            return;
+            // 吃小零食
+            DJI_Eat(frame->motors[j]);
         }
     }
+    CAN_SendMessage(hcan, &frame->header, frame->data);
+}
+
+/**
+ * 发送 C610 / C620 一组电机的控制指令
+ * @param hcan CAN handle
+ * @param cmd_group ID 组
+ */
+void DJI_SendSetIqCommand(CAN_HandleTypeDef* hcan, const DJI_IqSetCmdGroup_t cmd_group)
+{
+    const uint8_t bus = CAN_GetBusIndex(hcan);
+    if (bus >= CAN_NUM || map[bus].can == NULL)
+        return;
+    // cmd_frames[0] 为 0x200，cmd_frames[1] 为 0x1FF
+    sendCmdFrame(hcan, &map[bus].cmd_frames[cmd_group == IQ_CMD_GROUP_1_4 ? 0 : 1]);
 }
 
+/**
+ * 发送总线上所有电机的控制指令
+ *
+ * 依次检查 0x200 / 0x1FF / 0x2FF / 0x1FE / 0x2FE 五个控制帧，只发送有电机注册的帧，
+ * 可以代替按组调用 DJI_SendSetIqCommand
+ * @param hcan CAN handle
+ */
+void DJI_SendCommands(CAN_HandleTypeDef* hcan)
+{
+    const uint8_t bus = CAN_GetBusIndex(hcan);
+    if (bus >= CAN_NUM)
+        return;
+    for (int g = 0; g < DJI_CMD_FRAME_NUM; g++)
+        if (map[bus].cmd_frames[g].motor_num > 0)
+            sendCmdFrame(hcan, &map[bus].cmd_frames[g]);
+}
+
+/**
+ * 初始化 DJI CAN 过滤器
+ *
+ * 过滤器匹配到的帧会通过 CAN_Fifo{0,1}ReceiveCallback 直接交给 DJI_CAN_BaseReceiveCallback
+ * @param hcan can handle
+ * @param filter_bank 过滤器编号
+ */
 void DJI_CAN_FilterInit(CAN_HandleTypeDef* hcan, const uint32_t filter_bank)
 {
     const CAN_FilterTypeDef sFilterConfig = { .FilterIdHigh     = 0x200 << 5,
@@ -211,7 +391,7 @@ void DJI_CAN_FilterInit(CAN_HandleTypeDef* hcan, const uint32_t filter_bank)
                                               .FilterScale          = CAN_FILTERSCALE_32BIT,
                                               .FilterActivation     = ENABLE,
                                               .SlaveStartFilterBank = 14 };
-    if (HAL_CAN_ConfigFilter(hcan, &sFilterConfig) != HAL_OK)
+    if (CAN_ConfigFilter(hcan, &sFilterConfig, DJI_CAN_BaseReceiveCallback) != HAL_OK)
     {
         DJI_ERROR_HANDLER();
     }
@@ -227,14 +407,7 @@ void DJI_CAN_FilterInit(CAN_HandleTypeDef* hcan, const uint32_t filter_bank)
  */
 void DJI_CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan)
 {
-    CAN_RxHeaderTypeDef header;
-    uint8_t             data[8];
-    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &header, data) != HAL_OK)
-    {
-        DJI_ERROR_HANDLER();
-        return;
-    }
-    DJI_CAN_BaseReceiveCallback(hcan, &header, data);
+    CAN_ReceiveAll(hcan, CAN_RX_FIFO0, DJI_CAN_BaseReceiveCallback);
 }
 
 /**
@@ -244,14 +417,7 @@ void DJI_CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan)
  */
 void DJI_CAN_Fifo1ReceiveCallback(CAN_HandleTypeDef* hcan)
 {
-    CAN_RxHeaderTypeDef header;
-    uint8_t             data[8];
-    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO1, &header, data) != HAL_OK)
-    {
-        DJI_ERROR_HANDLER();
-        return;
-    }
-    DJI_CAN_BaseReceiveCallback(hcan, &header, data);
+    CAN_ReceiveAll(hcan, CAN_RX_FIFO1, DJI_CAN_BaseReceiveCallback);
 }
 
 /**
@@ -264,15 +430,14 @@ void DJI_CAN_BaseReceiveCallback(const CAN_HandleTypeDef*   hcan,
                                  const CAN_RxHeaderTypeDef* header,
                                  const uint8_t              data[])
 {
-    for (int i = 0; i < map_size; i++)
+    const uint8_t bus = CAN_GetBusIndex(hcan);
+    if (bus >= CAN_NUM)
+        return;
+    DJI_t* hdji = getDJIHandle(map[bus].motors, header);
+    if (hdji != NULL)
     {
-        if (hcan->Instance == map[i].can)
-        {
-            DJI_t* hdji = getDJIHandle(map[i].motors, header);
-            if (hdji != NULL)
-                DJI_DataDecode(hdji, data);
-            return;
-        }
+        hdji->feedback.timestamp = header->Timestamp;
+        DJI_DataDecode(hdji, data);
     }
 }
 
@@ -11,6 +11,7 @@
  * 支持的电机类型
  *  - M3508_C620
  *  - M2006_C610
+ *  - GM6020（电压控制或电流控制）
  *
  * Detailed description (optional).
  *
@@ -43,20 +44,48 @@ extern "C"
 
 #define CAN_NUM (2)
 
-#define DJI_M2006_C610_IQ_MAX (10000)
-#define DJI_M3508_C620_IQ_MAX (16384)
+#define DJI_M2006_C610_IQ_MAX  (10000)
+#define DJI_M3508_C620_IQ_MAX  (16384)
+#define DJI_GM6020_VOLTAGE_MAX (25000)
+#define DJI_GM6020_IQ_MAX      (16384)
+
+/**
+ * 每条总线的反馈 ID 数，反馈 ID 为 0x201 ~ 0x20B
+ *
+ * C610 / C620 的反馈 ID 为 0x200 + ID，GM6020 为 0x204 + ID，二者共用同一张表，ID 不能冲突
+ */
+#define DJI_FEEDBACK_NUM (11)
+
+/**
+ * 每条总线的控制帧数，依次为 0x200 / 0x1FF / 0x2FF / 0x1FE / 0x2FE
+ */
+#define DJI_CMD_FRAME_NUM (5)
+
+/**
+ * 角度、速度等由 Motor_PosCtrlUpdate 等以低于反馈频率读取时可启用以下宏：接收中断只保存原始编码值
+ * 和圈数，读取 __DJI_GET_ANGLE / __DJI_GET_VELOCITY 时才换算为物理量并缓存，直到下一帧反馈到达
+ */
+// #define DJI_LAZY_DECODE
 
 #include <stdbool.h>
-#include "main.h"
+#include "bsp/can_driver.h"
+#include "libs/multi_turn.h"
 
 typedef enum
 {
     M3508_C620 = 0U,
     M2006_C610,
+    GM6020_VOLTAGE, ///< GM6020 电压控制，控制帧 0x1FF / 0x2FF
+    GM6020_CURRENT, ///< GM6020 电流控制，控制帧 0x1FE / 0x2FE
 
     DJI_MOTOR_TYPE_COUNT
 } DJI_MotorType_t;
 
+/**
+ * C610 / C620 控制帧分组，值为组内第一个电机在反馈表中的下标
+ *
+ * 0x1FF 帧同时控制 GM6020 电压控制模式的 1 ~ 4 号电机
+ */
 typedef enum
 {
     IQ_CMD_GROUP_1_4 = 0U,
@@ -71,36 +100,62 @@ typedef struct
 
     DJI_MotorType_t motor_type; //< 电机类型
     CAN_TypeDef*    can;        //< CAN 实例
-    uint8_t         id1;        //< 电调 ID (1 ~ 8)
-    float           angle_zero; //< 零点角度 (unit: degree)
+    uint8_t         id1;        //< 电调 ID (C610 / C620: 1 ~ 8，GM6020: 1 ~ 7)
+    uint8_t         fb_id0;     //< 反馈 ID - 0x201，即在反馈表中的下标
+    uint16_t        cmd_id;     //< 控制帧 ID
 
     float inv_reduction_rate; ///< 减速比
+    float current_scale;      ///< 电流换算系数 (unit: A/LSB)，已包含反转
+    float torque_scale;       ///< 输出轴力矩换算系数 (unit: N·m/LSB)，已包含反转和外接减速比
 
     /* Feedback */
     uint32_t feedback_snacks; ///< 每次发送控制指令 feed--, 接收到控制指令 feed = 10
     uint32_t feedback_count;  //< 接收到的反馈数据数量
     struct
     {
-        float mech_angle; //< 单圈机械角度 (unit: degree)
-        float rpm;        //< 转速
-        // float current; //< 电流大小
-        // float temperature; //< 温度
+        float mech_angle; //< 单圈机械角度 (unit: degree)，DJI_LAZY_DECODE 模式下读取时才更新
+        float   rpm;         //< 转速，DJI_LAZY_DECODE 模式下读取时才更新
+        int16_t current;     //< 原始转矩电流，读取 __DJI_GET_CURRENT 时才换算
+        int8_t  temperature; //< 电机温度 (unit: °C)
 
-        int32_t round_cnt; //< 圈数
+        MultiTurn_t multi_turn; //< 多圈编码值，零点即输出轴零点
+        uint32_t    timestamp;  //< 反馈时间戳 (unit: us)，见 CAN_GetTimeUs
     } feedback;
 
+#ifdef DJI_LAZY_DECODE
+    struct
+    {
+        int16_t  rpm;         ///< 原始转速
+        uint32_t seq;         ///< 接收中断写入时加一，奇数表示正在写入
+        uint32_t decoded_seq; ///< abs_angle / velocity 对应的 seq，奇数表示缓存无效
+    } raw;
+#endif
+
     /* Data */
     float abs_angle; //< 电机轴输出角度 (unit: degree)
     float velocity;  //< 电机轴输出速度 (unit: rpm)
 
     /* Output */
-    uint16_t iq_cmd; //< 电流指令值
+    int16_t  iq_cmd;   //< 电流指令值，GM6020 电压控制模式下为电压指令值
+    uint8_t* cmd_data; //< 该电机在控制帧中的 2 字节，__DJI_SET_IQ_CMD 直接写入，未初始化时为 NULL
 } DJI_t;
 
+/**
+ * 常驻的控制帧，帧头在注册第一个电机时生成，数据由 __DJI_SET_IQ_CMD 直接写入
+ */
+typedef struct
+{
+    CAN_TxHeaderTypeDef header;    //< 帧头
+    uint8_t             data[8];   //< 各电机指令，已按 reverse 取反，大端
+    DJI_t*              motors[4]; //< 帧中的电机
+    uint8_t             motor_num; //< 帧中的电机数，为 0 时 DJI_SendCommands 不发送
+} DJI_CmdFrame_t;
+
 typedef struct
 {
-    CAN_TypeDef* can;       //< CAN 实例
-    DJI_t*       motors[8]; //< 电机指针数组
+    CAN_TypeDef*   can;                           //< CAN 实例，NULL 表示该总线没有电机
+    DJI_t*         motors[DJI_FEEDBACK_NUM];      //< 电机指针数组，下标为反馈 ID - 0x201
+    DJI_CmdFrame_t cmd_frames[DJI_CMD_FRAME_NUM]; //< 控制帧
 } DJI_FeedbackMap;
 
 typedef struct
@@ -109,22 +164,68 @@ typedef struct
     bool               reverse; ///< 是否反转
     DJI_MotorType_t    motor_type;
     CAN_HandleTypeDef* hcan;
-    uint8_t            id1;            ///< 电机编号 1~8
+    uint8_t            id1;            ///< 电机编号 C610 / C620: 1~8，GM6020: 1~7
     float              reduction_rate; ///< 外接减速比
 } DJI_Config_t;
 
+/**
+ * 设置电流值（不发送），按 reverse 取反后以大端写入控制帧
+ * @param hdji DJI handle
+ * @param iq_cmd 电流值
+ */
+static inline void DJI_SetIqCmd(DJI_t* hdji, const int16_t iq_cmd)
+{
+    hdji->iq_cmd = iq_cmd;
+    if (hdji->cmd_data == NULL)
+        return; // 尚未 DJI_Init，没有绑定控制帧
+    const uint16_t cmd = (uint16_t) (hdji->reverse ? -iq_cmd : iq_cmd);
+    hdji->cmd_data[0]  = (uint8_t) (cmd >> 8);   // 电流值高 8 位
+    hdji->cmd_data[1]  = (uint8_t) (cmd & 0xFF); // 电流值低 8 位
+}
+
 /**
  * 设置电流值（不发送）
  * @param __DJI_HANDLE__
- * @param __IQ_CMD__ 设置电流值，int16_t，最大值参考 DJI_[Type]_IQ_MAX
+ * @param __IQ_CMD__ 设置电流值（GM6020 电压控制模式下为电压值），int16_t，
+ *                   最大值参考 DJI_[Type]_IQ_MAX / DJI_GM6020_VOLTAGE_MAX
  */
 #define __DJI_SET_IQ_CMD(__DJI_HANDLE__, __IQ_CMD__)                                               \
-    (((DJI_t*) (__DJI_HANDLE__))->iq_cmd = (int16_t) (__IQ_CMD__))
+    (DJI_SetIqCmd((DJI_t*) (__DJI_HANDLE__), (int16_t) (__IQ_CMD__)))
+
+#ifdef DJI_LAZY_DECODE
+#    define __DJI_GET_ANGLE(__DJI_HANDLE__)    (DJI_GetAngle((DJI_t*) (__DJI_HANDLE__)))
+#    define __DJI_GET_VELOCITY(__DJI_HANDLE__) (DJI_GetVelocity((DJI_t*) (__DJI_HANDLE__)))
+#else
+#    define __DJI_GET_ANGLE(__DJI_HANDLE__)    (((DJI_t*) (__DJI_HANDLE__))->abs_angle)
+#    define __DJI_GET_VELOCITY(__DJI_HANDLE__) (((DJI_t*) (__DJI_HANDLE__))->velocity)
+#endif
+#define __DJI_GET_TIMESTAMP(__DJI_HANDLE__) (((DJI_t*) (__DJI_HANDLE__))->feedback.timestamp)
 
-#define __DJI_GET_ANGLE(__DJI_HANDLE__)    (((DJI_t*) (__DJI_HANDLE__))->abs_angle)
-#define __DJI_GET_VELOCITY(__DJI_HANDLE__) (((DJI_t*) (__DJI_HANDLE__))->velocity)
+/**
+ * 获取转矩电流 (unit: A)
+ *
+ * 接收中断只保存原始值，读取时换算
+ * @param __DJI_HANDLE__
+ */
+#define __DJI_GET_CURRENT(__DJI_HANDLE__)                                                          \
+    ((float) ((DJI_t*) (__DJI_HANDLE__))->feedback.current *                                       \
+     ((DJI_t*) (__DJI_HANDLE__))->current_scale)
+
+/**
+ * 获取输出轴力矩 (unit: N·m)，由转矩电流和电机转矩常数估算
+ * @param __DJI_HANDLE__
+ */
+#define __DJI_GET_TORQUE(__DJI_HANDLE__)                                                           \
+    ((float) ((DJI_t*) (__DJI_HANDLE__))->feedback.current *                                       \
+     ((DJI_t*) (__DJI_HANDLE__))->torque_scale)
+
+#define __DJI_GET_TEMPERATURE(__DJI_HANDLE__) (((DJI_t*) (__DJI_HANDLE__))->feedback.temperature)
 
 void DJI_ResetAngle(DJI_t* hdji);
+#ifdef DJI_LAZY_DECODE
+float DJI_GetAngle(DJI_t* hdji);
+float DJI_GetVelocity(DJI_t* hdji);
+#endif
 void DJI_Init(DJI_t* hdji, const DJI_Config_t* dji_config);
 void DJI_CAN_FilterInit(CAN_HandleTypeDef* hcan, uint32_t filter_bank);
 
@@ -135,6 +236,7 @@ void DJI_CAN_BaseReceiveCallback(const CAN_HandleTypeDef*   hcan,
                                  const uint8_t              data[]);
 
 void DJI_SendSetIqCommand(CAN_HandleTypeDef* hcan, DJI_IqSetCmdGroup_t cmd_group);
+void DJI_SendCommands(CAN_HandleTypeDef* hcan);
 
 static bool DJI_isConnected(const DJI_t* hdji)
 {
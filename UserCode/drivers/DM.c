@@ -1,5 +1,6 @@
 #include "DM.h"
 #include "bsp/can_driver.h"
+#include "cmsis_compiler.h"
 #include "string.h"
 
 #ifdef __cplusplus
@@ -7,42 +8,73 @@ extern "C"
 {
 #endif
 
+/**
+ * 每条总线的电机，下标为 CAN_GetBusIndex
+ */
 static DM_FeedbackMap map[DM_CAN_NUM];
-static size_t         map_size = 0;
 
 static float reduction_rate_map[DM_MOTOR_TYPE_COUNT] = {
     [DM_S3519] = (19.203f),
 };
 
-static inline DM_t* getDMHandle(DM_t*                      motors[8],
+/**
+ * 获取总线对应的 map
+ * @param hcan can handle
+ * @return 总线上没有注册电机时返回 NULL
+ */
+static DM_FeedbackMap* getBusMap(const CAN_HandleTypeDef* hcan)
+{
+    const uint8_t bus = CAN_GetBusIndex(hcan);
+    if (bus >= DM_CAN_NUM || map[bus].hcan == NULL)
+        return NULL;
+    return &map[bus];
+}
+
+static inline DM_t* getDMHandle(DM_t*                      motors[DM_NUM],
                                 const uint8_t*             data,
                                 const CAN_RxHeaderTypeDef* header)
 {
     if (header->IDE != CAN_ID_STD)
         return NULL;
-    const int8_t id0 = (int8_t) (data[0] & 0x0f);
-    // 不是 DM 的反馈数据
-    if (id0 >= 16)
-        return NULL;
-    if (motors[id0] == NULL)
-    {
-        DM_ERROR_HANDLER();
+    DM_t* hdm = motors[data[0] & 0x0F];
+    // 不是 DM 的反馈数据（过滤器按掩码匹配，可能收到其他 id 的帧）
+    if (hdm == NULL || hdm->master_id != header->StdId)
         return NULL;
-    }
-    return motors[id0];
+    return hdm;
 }
 /**
- * @brief can滤波器配置，在此将你在调试助手里设置的master id对应
+ * @brief can滤波器配置，根据该总线上已注册电机的 master id 生成
  *
+ * 所有 master id 相同的位参与匹配，master id 连续分配时一个过滤器组即可覆盖，
+ * 掩码放进来的其他帧由接收回调按 master id 丢弃
+ * @attention 必须在该总线上所有电机 DM_Init 之后调用，没有注册电机时匹配 MST_ID
  * @param hcan can句柄
  * @param filter_bank bank
  */
 void DM_CAN_FilterInit(CAN_HandleTypeDef* hcan, const uint32_t filter_bank)
 {
+    uint32_t                    id      = MST_ID;
+    uint32_t                    mask    = 0x7FF;
+    const DM_FeedbackMap* const bus_map = getBusMap(hcan);
+    if (bus_map != NULL)
+    {
+        const DM_t* first = NULL;
+        for (int j = 0; j < DM_NUM; j++)
+        {
+            const DM_t* hdm = bus_map->motors[j];
+            if (hdm == NULL)
+                continue;
+            if (first == NULL)
+                first = hdm;
+            mask &= ~(uint32_t) (first->master_id ^ hdm->master_id);
+        }
+        if (first != NULL)
+            id = first->master_id & mask;
+    }
     const CAN_FilterTypeDef sFilterConfig = {
-        .FilterIdHigh     = MST_ID << 5, // 务必匹配！
+        .FilterIdHigh     = id << 5,
         .FilterIdLow      = 0x0000,
-        .FilterMaskIdHigh = 0x7FF << 5,
+        .FilterMaskIdHigh = mask << 5,
         .FilterMaskIdLow  = 0x0000,
         .FilterFIFOAssignment =
                 CAN_FILTER_FIFO0, // 根据需要选择，如果同一can线上挂载了不同类型的电机，请使用fifo1避免数据接收异常
@@ -52,7 +84,7 @@ void DM_CAN_FilterInit(CAN_HandleTypeDef* hcan, const uint32_t filter_bank)
         .FilterActivation     = ENABLE,
         .SlaveStartFilterBank = 14
     };
-    if (HAL_CAN_ConfigFilter(hcan, &sFilterConfig) != HAL_OK)
+    if (CAN_ConfigFilter(hcan, &sFilterConfig, DM_CAN_BaseReceiveCallback) != HAL_OK)
     {
         DM_ERROR_HANDLER();
     }
@@ -60,16 +92,15 @@ void DM_CAN_FilterInit(CAN_HandleTypeDef* hcan, const uint32_t filter_bank)
 /**
  * @brief 达妙电机初始化
  *
+ * 只登记电机并标记为等待使能，使能指令由 DM_EnableProcess 统一发送并确认
  * @param hdm 初始化的电机实例`
  * @param dm_config 配置初始化电机的配置实例
  */
 void DM_Init(DM_t* hdm, const DM_Config_t* dm_config)
 {
-    static uint8_t initdata[8] = {
-        0xFF, 0XFF, 0XFF, 0xFF, 0XFF, 0XFF, 0XFF, 0XFC
-    }; // DM电机初始化需要发送的数据
     memset(hdm, 0, sizeof(DM_t));
     hdm->id0                = dm_config->id0;
+    hdm->master_id          = dm_config->master_id != 0 ? dm_config->master_id : MST_ID;
     hdm->hcan               = dm_config->hcan;
     hdm->POS_MAX            = dm_config->POS_MAX_RAD * 180.0f / 3.1416f;
     hdm->VEL_MAX            = dm_config->VEL_MAX_RAD / (2 * 3.1416f);
@@ -77,39 +108,65 @@ void DM_Init(DM_t* hdm, const DM_Config_t* dm_config)
     hdm->VEL_MAX_RAD        = dm_config->VEL_MAX_RAD;
     hdm->T_MAX              = dm_config->T_MAX;
     hdm->mode               = dm_config->mode;
+    hdm->reverse            = dm_config->reverse;
     hdm->inv_reduction_rate = 1.0f / // 取倒数将除法转为乘法加快运算速度
                               ((dm_config->reduction_rate > 0 ? dm_config->reduction_rate
                                                               : 1.0f)        // 外接减速比
                                * reduction_rate_map[dm_config->motor_type]); // 电机内部减速比
+
+    // 反馈数据与 [-MAX, MAX] 成线性关系，预先计算系数，解包时只需整数运算和一次乘法
+    hdm->scale.sign      = hdm->reverse ? -1.0f : 1.0f; // 反转时需要反转角度和速度输入
+    hdm->scale.angle     = hdm->POS_MAX_RAD / 65535.0f;
+    hdm->scale.vel       = hdm->VEL_MAX_RAD / 4095.0f;
+    hdm->scale.T         = hdm->T_MAX / 4095.0f;
+    hdm->scale.abs_angle = hdm->scale.sign * 2.0f * hdm->scale.angle * 180.0f / 3.1416f *
+                           hdm->inv_reduction_rate;
+    hdm->scale.rpm = hdm->scale.sign * hdm->scale.vel / 2.0f / 3.1416f * 60.0f;
+    // 位置编码值 [0, 65535] 对应 [-POS_MAX_RAD, POS_MAX_RAD]，两端为同一位置，回绕周期为 65535
+    MultiTurn_Init(&hdm->multi_turn, 65535, 32768);
     /* 注册回调 */
-    DM_t** mapped_motors = NULL;
-    for (int i = 0; i < map_size; i++)
-        if (map[i].hcan == hdm->hcan)
-            mapped_motors = map[i].motors;
-    if (mapped_motors == NULL)
+    const uint8_t bus = CAN_GetBusIndex(hdm->hcan);
+    if (bus >= DM_CAN_NUM)
     {
-        // CAN 未被注册，添加到 map
-        map[map_size] = (DM_FeedbackMap) {
-            .hcan = hdm->hcan, .motors = { NULL } // 为了好看(
-        };
-        mapped_motors = map[map_size].motors;
-        map_size++;
-    }
-    if (mapped_motors[hdm->id0] != NULL)
-    {
-        // 电调 id0 冲突
+        // 总线编号超出 map 范围，请增大 DM_CAN_NUM
         DM_ERROR_HANDLER();
+        return;
     }
-    else
+    map[bus].hcan = hdm->hcan;
+    DM_t** slot   = &map[bus].motors[hdm->id0 & 0x0F];
+    if (*slot != NULL)
     {
-        mapped_motors[hdm->id0] = hdm;
+        // 反馈中只有 id0 的低 4 位，低 4 位相同的电机无法区分
+        DM_ERROR_HANDLER();
+        return;
     }
-    CAN_SendMessage(dm_config->hcan,
-                    &(CAN_TxHeaderTypeDef) { .StdId = dm_config->mode | hdm->id0,
-                                             .IDE   = CAN_ID_STD,
-                                             .RTR   = CAN_RTR_DATA,
-                                             .DLC   = 8 },
-                    initdata);
+    *slot = hdm;
+    /* 登记反馈 ID，供 CAN_FilterApply 生成过滤器 */
+    CAN_FilterAddId(hdm->hcan, CAN_ID_STD, hdm->master_id, DM_CAN_BaseReceiveCallback);
+    hdm->enable.pending = true;
+}
+
+/**
+ * 把原始反馈换算为物理量
+ * @param hdm DM handle
+ * @param multi_turn 多圈位置
+ * @param raw_vel 原始速度 (12 bit)
+ * @param raw_t 原始力矩 (12 bit)
+ */
+static inline void dm_convert(DM_t*              hdm,
+                              const MultiTurn_t* multi_turn,
+                              const uint16_t     raw_vel,
+                              const uint16_t     raw_t)
+{
+    const int32_t vel = 2 * (int32_t) raw_vel - 4095;
+    // 反馈位置数据，达妙3519和2520反馈的数据是减速前的
+    hdm->feedback.angle = hdm->scale.angle * (float) (2 * (int32_t) multi_turn->raw - 65535);
+    // 反馈速度数据，达妙3519和2520反馈的数据是减速后的
+    hdm->feedback.vel = hdm->scale.vel * (float) vel;
+    hdm->feedback.T   = hdm->scale.T * (float) (2 * (int32_t) raw_t - 4095);
+
+    hdm->abs_angle = MultiTurn_ToFloat(multi_turn, hdm->scale.abs_angle);
+    hdm->vel       = hdm->scale.rpm * (float) vel;
 }
 
 /**
@@ -119,39 +176,26 @@ void DM_Init(DM_t* hdm, const DM_Config_t* dm_config)
  */
 void DM_DataDecode(DM_t* hdm, const uint8_t data[8])
 {
-    const float scale_angle = 2.0f * hdm->POS_MAX_RAD /
-                              65535.0f; // 读取到的浮点数是和16位位置数据成线性关系，计算k值
-    const float scale_vel = 2.0f * hdm->VEL_MAX_RAD /
-                            4095.0f; // 读取到的浮点数是和12位位置数据成线性关系，计算k值
-    const float scale_t = 2.0f * hdm->T_MAX / 4095.0f;
-
-    const float feedback_angle =
-            scale_angle * (float) (uint16_t) (data[1] << 8 | data[2]) -
-            hdm->POS_MAX_RAD; // 反馈位置数据，达妙3519和2520反馈的数据是减速前的
-    const float feedback_vel = scale_vel * (float) (uint16_t) (data[3] << 4 | data[4] >> 4) -
-                               hdm->VEL_MAX_RAD; // 反馈速度数据，达妙3519和2520反馈的数据是减速后的
-    const float feedback_t = scale_t *
-                             (float) (uint16_t) ((data[4] & 0x0F) << 8 | data[5]); // 反馈力矩数据
-    const float angle = feedback_angle * 180.0f / 3.1416f;
-    const float vel   = feedback_vel / 2.0f / 3.1416f * 60.0f;
-
-    if (angle < -90 && hdm->feedback.angle >= 1.5708)
-        hdm->round_cnt++;
-    if (angle > 90 && hdm->feedback.angle < -1.5708)
-        hdm->round_cnt--;
-
-    hdm->feedback.vel     = feedback_vel;
-    hdm->feedback.angle   = feedback_angle;
-    hdm->feedback.T       = feedback_t;
+    const uint16_t raw_pos = (uint16_t) (data[1] << 8 | data[2]);
+    const uint16_t raw_vel = (uint16_t) (data[3] << 4 | data[4] >> 4);
+    const uint16_t raw_t   = (uint16_t) ((data[4] & 0x0F) << 8 | data[5]);
+
+    // 单圈为 2 * POS_MAX_RAD，一般对应多圈机械角度，丢帧数百毫秒才可能误判跨圈，不做速度外推
+#ifdef DM_LAZY_DECODE
+    hdm->raw.seq++;
+    __DMB(); // 先标记为正在写入
+    MultiTurn_Update(&hdm->multi_turn, raw_pos, 0, hdm->feedback.timestamp);
+    hdm->raw.vel = raw_vel;
+    hdm->raw.T   = raw_t;
+    __DMB(); // 写入完成后再发布
+    hdm->raw.seq++;
+#else
+    MultiTurn_Update(&hdm->multi_turn, raw_pos, 0, hdm->feedback.timestamp);
+    dm_convert(hdm, &hdm->multi_turn, raw_vel, raw_t);
+#endif
     hdm->feedback.T_MOS   = (int8_t) data[6];
     hdm->feedback.T_Rotor = (int8_t) data[7];
-    hdm->feedback_count++;
-    hdm->feedback.ERR = data[0] & 0x0F;
-
-    hdm->abs_angle = (hdm->reverse ? -1.0f : 1.0f) * // 反转时需要反转角度输入
-                     ((float) hdm->round_cnt * 360.0f + angle - hdm->angle_zero) *
-                     hdm->inv_reduction_rate;
-    hdm->vel = (hdm->reverse ? -1.0f : 1.0f) * vel;
+    hdm->feedback.ERR     = data[0] >> 4; // 低 4 位为 id0
     hdm->feedback_count++;
 
     if (hdm->feedback_count == 10 && hdm->auto_zero)
@@ -167,11 +211,75 @@ void DM_DataDecode(DM_t* hdm, const uint8_t data[8])
  */
 void DM_ResetAngle(DM_t* hdm)
 {
-    hdm->round_cnt  = 0;
-    hdm->angle_zero = hdm->feedback.angle;
-    hdm->abs_angle  = 0;
+    MultiTurn_ResetZero(&hdm->multi_turn);
+#ifdef DM_LAZY_DECODE
+    hdm->raw.decoded_seq = 1U; // 奇数，使缓存失效
+#endif
+    hdm->abs_angle = 0;
 }
 
+#ifdef DM_LAZY_DECODE
+/**
+ * 把最新的原始反馈换算为物理量，缓存仍有效时直接返回
+ * @param hdm DM handle
+ */
+static void DM_LazyDecode(DM_t* hdm)
+{
+    uint32_t    seq;
+    MultiTurn_t multi_turn;
+    uint16_t    raw_vel, raw_t;
+    do
+    {
+        seq = hdm->raw.seq;
+        if (seq == hdm->raw.decoded_seq)
+            return; // 缓存仍有效
+        if ((seq & 1U) != 0)
+            return; // 抢占了正在写入的接收中断，沿用上一次的值
+        __DMB();
+        multi_turn = hdm->multi_turn;
+        raw_vel    = hdm->raw.vel;
+        raw_t      = hdm->raw.T;
+        __DMB();
+    } while (seq != hdm->raw.seq); // 读取期间收到了新的反馈
+
+    dm_convert(hdm, &multi_turn, raw_vel, raw_t);
+    hdm->raw.decoded_seq = seq;
+}
+
+/**
+ * 获取电机轴输出角度
+ * @param hdm DM handle
+ * @return 角度 (unit: degree)
+ */
+float DM_GetAngle(DM_t* hdm)
+{
+    DM_LazyDecode(hdm);
+    return hdm->abs_angle;
+}
+
+/**
+ * 获取电机轴输出速度
+ * @param hdm DM handle
+ * @return 速度 (unit: rpm)
+ */
+float DM_GetVelocity(DM_t* hdm)
+{
+    DM_LazyDecode(hdm);
+    return hdm->vel;
+}
+
+/**
+ * 获取电机轴输出力矩，已按 reverse 取反
+ * @param hdm DM handle
+ * @return 力矩 (unit: N·m)
+ */
+float DM_GetTorque(DM_t* hdm)
+{
+    DM_LazyDecode(hdm);
+    return hdm->scale.sign * hdm->feedback.T;
+}
+#endif
+
 static void dm_vel_set_command_data(DM_t* hdm, const float value_vel, uint8_t data[])
 {
     uint8_t* vbuf = (uint8_t*) &value_vel;
@@ -198,12 +306,14 @@ static void dm_pos_set_command_data(DM_t*       hdm,
     data[7]       = *(vbuf + 3);
 }
 
-void DM_Vel_SendSetCmd(DM_t* hdm, const float value_vel)
+/**
+ * 发送速度模式指令帧
+ * @param hdm DM handle
+ * @param value_vel_rad 速度 (unit: rad/s)
+ */
+static void send_vel_command(DM_t* hdm, const float value_vel_rad)
 {
-    static uint8_t data[8] = { 0 };
-
-    const float value_vel_rad = value_vel * 2 * 3.1416f /
-                                60.0f; // 达妙电机控制的即为输出轴的速度（uint:rad/s）
+    uint8_t data[8] = { 0 };
     dm_vel_set_command_data(hdm, value_vel_rad, data);
     CAN_SendMessage(hdm->hcan,
                     &(CAN_TxHeaderTypeDef) {
@@ -215,10 +325,14 @@ void DM_Vel_SendSetCmd(DM_t* hdm, const float value_vel)
                     data);
 }
 
-void DM_Pos_SendSetCmd(DM_t* hdm, const float value_pos)
+/**
+ * 发送位置速度模式指令帧
+ * @param hdm DM handle
+ * @param value_pos_rad 位置 (unit: rad)
+ */
+static void send_pos_command(DM_t* hdm, const float value_pos_rad)
 {
-    static uint8_t data[8]       = { 0 };
-    const float    value_pos_rad = value_pos * 3.1416f / 180.0f;
+    uint8_t data[8];
     dm_pos_set_command_data(hdm, hdm->VEL_MAX, value_pos_rad, data);
     CAN_SendMessage(hdm->hcan,
                     &(CAN_TxHeaderTypeDef) {
@@ -230,6 +344,318 @@ void DM_Pos_SendSetCmd(DM_t* hdm, const float value_pos)
                     data);
 }
 
+/**
+ * 把浮点数线性映射为 bits 位无符号整数，超出 [x_min, x_max] 时限幅
+ */
+static uint16_t float_to_uint(const float x, const float x_min, const float x_max, const int bits)
+{
+    const float span = x_max - x_min;
+    const float max  = (float) ((1U << bits) - 1U);
+    const float v    = (x - x_min) * max / span;
+    if (v <= 0.0f)
+        return 0;
+    if (v >= max)
+        return (uint16_t) max;
+    return (uint16_t) v;
+}
+
+/**
+ * 把电机轴输出角度换算为 MIT 指令中的位置
+ *
+ * 与 abs_angle 使用同一零点，结果落在电机当前的 [-POS_MAX_RAD, POS_MAX_RAD] 编码区间内
+ * @param hdm DM handle
+ * @param angle 电机轴输出角度 (unit: degree)
+ * @return 位置 (unit: rad)
+ */
+static float dm_mit_position(const DM_t* hdm, const float angle)
+{
+    const float scale_angle = 2.0f * hdm->scale.angle;
+    // 相对零点转过的编码值
+    const float count = angle / hdm->scale.abs_angle;
+    // 零点相对当前编码区间的编码值
+    const float zero = (float) (hdm->multi_turn.zero_turns - hdm->multi_turn.turns) *
+                               (float) hdm->multi_turn.range +
+                       (float) hdm->multi_turn.zero_raw;
+    return (zero + count) * scale_angle - hdm->POS_MAX_RAD;
+}
+
+/**
+ * 发送 MIT 模式指令帧
+ *
+ * 位置 16 位，速度、Kp、Kd、力矩各 12 位，大端依次排列
+ * @param hdm DM handle
+ * @param pos_rad 位置 (unit: rad)
+ * @param vel_rad 速度 (unit: rad/s)
+ * @param kp 刚度 (unit: N·m/rad)
+ * @param kd 阻尼 (unit: N·m·s/rad)
+ * @param torque 力矩 (unit: N·m)
+ */
+static void send_mit_command(DM_t*       hdm,
+                             const float pos_rad,
+                             const float vel_rad,
+                             const float kp,
+                             const float kd,
+                             const float torque)
+{
+    const uint16_t p = float_to_uint(pos_rad, -hdm->POS_MAX_RAD, hdm->POS_MAX_RAD, 16);
+    const uint16_t v = float_to_uint(vel_rad, -hdm->VEL_MAX_RAD, hdm->VEL_MAX_RAD, 12);
+    const uint16_t k = float_to_uint(kp, 0.0f, DM_MIT_KP_MAX, 12);
+    const uint16_t d = float_to_uint(kd, 0.0f, DM_MIT_KD_MAX, 12);
+    const uint16_t t = float_to_uint(torque, -hdm->T_MAX, hdm->T_MAX, 12);
+
+    uint8_t data[8];
+    data[0] = (uint8_t) (p >> 8);
+    data[1] = (uint8_t) (p & 0xFF);
+    data[2] = (uint8_t) (v >> 4);
+    data[3] = (uint8_t) ((v & 0x0F) << 4 | k >> 8);
+    data[4] = (uint8_t) (k & 0xFF);
+    data[5] = (uint8_t) (d >> 4);
+    data[6] = (uint8_t) ((d & 0x0F) << 4 | t >> 8);
+    data[7] = (uint8_t) (t & 0xFF);
+    CAN_SendMessage(hdm->hcan,
+                    &(CAN_TxHeaderTypeDef) {
+                            .StdId = DM_MODE_MIT | hdm->id0,
+                            .IDE   = CAN_ID_STD,
+                            .RTR   = CAN_RTR_DATA,
+                            .DLC   = 8,
+                    },
+                    data);
+}
+
+#ifdef DM_CMD_COALESCE
+/**
+ * 写入指令槽
+ * @param hdm DM handle
+ * @param mode 指令模式
+ * @param value 指令值
+ */
+static void cmd_slot_write(DM_t* hdm, const DM_MODE_T mode, const float value)
+{
+    hdm->cmd.mode  = mode;
+    hdm->cmd.value = value;
+    hdm->cmd.valid = true;
+}
+#endif
+
+/**
+ * 速度模式指令
+ * @note 定义 DM_CMD_COALESCE 时只写入指令槽，由 DM_FlushCmd 发送
+ * @param hdm DM handle
+ * @param value_vel 速度 (unit: rpm)
+ */
+void DM_Vel_SendSetCmd(DM_t* hdm, const float value_vel)
+{
+    const float value_vel_rad = value_vel * 2 * 3.1416f /
+                                60.0f; // 达妙电机控制的即为输出轴的速度（uint:rad/s）
+#ifdef DM_CMD_COALESCE
+    cmd_slot_write(hdm, DM_MODE_VEL, value_vel_rad);
+#else
+    send_vel_command(hdm, value_vel_rad);
+#endif
+}
+
+/**
+ * 位置速度模式指令
+ * @note 定义 DM_CMD_COALESCE 时只写入指令槽，由 DM_FlushCmd 发送
+ * @param hdm DM handle
+ * @param value_pos 位置 (unit: degree)
+ */
+void DM_Pos_SendSetCmd(DM_t* hdm, const float value_pos)
+{
+    const float value_pos_rad = value_pos * 3.1416f / 180.0f;
+#ifdef DM_CMD_COALESCE
+    cmd_slot_write(hdm, DM_MODE_POS, value_pos_rad);
+#else
+    send_pos_command(hdm, value_pos_rad);
+#endif
+}
+
+/**
+ * MIT 模式指令：力矩 = Kp * (位置 - 当前位置) + Kd * (速度 - 当前速度) + 力矩前馈
+ *
+ * 位置、速度与 abs_angle / vel 使用同一坐标系（含零点和反转），一帧即可完成阻抗控制
+ * @note MIT 指令每个控制周期都应发送，总是立即发送，不经过 DM_CMD_COALESCE 的指令槽
+ * @param hdm DM handle
+ * @param pos 位置 (unit: degree)
+ * @param vel 速度前馈 (unit: rpm)
+ * @param kp 刚度 (unit: N·m/rad)，范围 [0, DM_MIT_KP_MAX]
+ * @param kd 阻尼 (unit: N·m·s/rad)，范围 [0, DM_MIT_KD_MAX]
+ * @param torque 力矩前馈 (unit: N·m)
+ */
+void DM_MIT_SendSetCmd(DM_t*       hdm,
+                       const float pos,
+                       const float vel,
+                       const float kp,
+                       const float kd,
+                       const float torque)
+{
+    // 与 dm_mit_position 使用的 scale.abs_angle 同一符号
+    send_mit_command(hdm,
+                     dm_mit_position(hdm, pos),
+                     hdm->scale.sign * vel * 2 * 3.1416f / 60.0f,
+                     kp,
+                     kd,
+                     hdm->scale.sign * torque);
+}
+
+/**
+ * 发送管理指令
+ * @note 保存零点后电机的编码值以新零点为中心，软件零点随之重置到该位置
+ * @param hdm DM handle
+ * @param cmd 指令
+ */
+void DM_SendCommand(DM_t* hdm, const DM_Command_t cmd)
+{
+    const uint8_t data[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, (uint8_t) cmd };
+    CAN_SendMessage(hdm->hcan,
+                    &(CAN_TxHeaderTypeDef) {
+                            .StdId = hdm->mode | hdm->id0,
+                            .IDE   = CAN_ID_STD,
+                            .RTR   = CAN_RTR_DATA,
+                            .DLC   = 8,
+                    },
+                    data);
+    if (cmd == DM_CMD_DISABLE)
+    {
+        // 主动失能，不再由 DM_EnableProcess 重新使能
+        hdm->enable.pending = false;
+    }
+    else if (cmd == DM_CMD_SAVE_ZERO)
+    {
+        MultiTurn_Init(&hdm->multi_turn, 65535, 32768);
+#ifdef DM_LAZY_DECODE
+        hdm->raw.decoded_seq = 1U; // 奇数，使缓存失效
+#endif
+        hdm->abs_angle = 0;
+    }
+}
+
+/**
+ * 发送使能指令，电机处于错误状态时先清除错误
+ * @param hdm DM handle
+ * @param now 当前时间 (unit: ms)
+ */
+static void dm_send_enable(DM_t* hdm, const uint32_t now)
+{
+    if (hdm->feedback.ERR >= DM_STATE_OVER_VOLTAGE)
+        DM_SendCommand(hdm, DM_CMD_CLEAR_ERROR);
+    DM_SendCommand(hdm, DM_CMD_ENABLE);
+    hdm->enable.sent       = true;
+    hdm->enable.sent_count = hdm->feedback_count;
+    hdm->enable.sent_tick  = now;
+}
+
+/**
+ * 把该总线上所有已注册的 DM 电机重新标记为等待使能
+ *
+ * 用于失能或故障后重新使能，随后由 DM_EnableProcess 发送并确认
+ * @param hcan can handle
+ */
+void DM_EnableAll(const CAN_HandleTypeDef* hcan)
+{
+    DM_FeedbackMap* bus_map = getBusMap(hcan);
+    if (bus_map == NULL)
+        return;
+    for (int j = 0; j < DM_NUM; j++)
+    {
+        DM_t* hdm = bus_map->motors[j];
+        if (hdm == NULL)
+            continue;
+        hdm->enable.pending = true;
+        hdm->enable.sent    = false;
+    }
+}
+
+/**
+ * 使能状态机，非阻塞
+ *
+ * 第一次调用时向所有等待使能的电机连续发送使能指令，之后每次调用检查反馈：
+ * 发送使能后收到状态为 DM_STATE_ENABLED 的反馈即确认完成，反馈为错误状态时立即清除错误并重发，
+ * 超过 DM_ENABLE_RETRY_MS 未确认的电机同样重发。
+ * 电机收到指令后立即回复反馈帧，通常一个控制周期内即可全部确认
+ * @attention 需要在 CAN_Start 之后周期调用（如控制周期的定时器中断回调），直到返回 0
+ * @param hcan can handle
+ * @return 尚未确认使能的电机数
+ */
+uint32_t DM_EnableProcess(const CAN_HandleTypeDef* hcan)
+{
+    DM_FeedbackMap* bus_map = getBusMap(hcan);
+    if (bus_map == NULL)
+        return 0;
+    const uint32_t now     = HAL_GetTick();
+    uint32_t       pending = 0;
+    for (int j = 0; j < DM_NUM; j++)
+    {
+        DM_t* hdm = bus_map->motors[j];
+        if (hdm == NULL || !hdm->enable.pending)
+            continue;
+        // 发送使能指令后是否收到了反馈
+        const bool replied = hdm->enable.sent && hdm->feedback_count != hdm->enable.sent_count;
+        if (replied && hdm->feedback.ERR == DM_STATE_ENABLED)
+        {
+            hdm->enable.pending = false;
+            continue;
+        }
+        if (!hdm->enable.sent || now - hdm->enable.sent_tick >= DM_ENABLE_RETRY_MS ||
+            (replied && hdm->feedback.ERR >= DM_STATE_OVER_VOLTAGE))
+            dm_send_enable(hdm, now);
+        pending++;
+    }
+    return pending;
+}
+
+#ifdef DM_CMD_COALESCE
+/**
+ * 判断指令槽中的指令是否需要发送
+ * @param hdm DM handle
+ * @param now 当前时间 (unit: ms)
+ */
+static bool cmd_need_send(const DM_t* hdm, const uint32_t now)
+{
+    if (!hdm->cmd.valid)
+        return false;
+    if (!hdm->cmd.sent || hdm->cmd.mode != hdm->cmd.sent_mode)
+        return true;
+    // 归零指令（如停车）不受死区影响
+    if (hdm->cmd.value == 0.0f && hdm->cmd.sent_value != 0.0f)
+        return true;
+    const float diff = hdm->cmd.value - hdm->cmd.sent_value;
+    if (diff > DM_CMD_DEADBAND || diff < -DM_CMD_DEADBAND)
+        return true;
+    return now - hdm->cmd.sent_tick >= DM_CMD_KEEPALIVE_MS;
+}
+
+/**
+ * 发送该总线上所有 DM 指令槽中的指令
+ *
+ * 每个电机至多发送一帧，指令与上次发送相比变化超过 DM_CMD_DEADBAND，
+ * 或距上次发送超过 DM_CMD_KEEPALIVE_MS 时才会发送
+ * @attention 需要在控制周期（定时器中断回调）结尾调用一次
+ * @param hcan can handle
+ */
+void DM_FlushCmd(const CAN_HandleTypeDef* hcan)
+{
+    DM_FeedbackMap* bus_map = getBusMap(hcan);
+    if (bus_map == NULL)
+        return;
+    const uint32_t now = HAL_GetTick();
+    for (int j = 0; j < DM_NUM; j++)
+    {
+        DM_t* hdm = bus_map->motors[j];
+        if (hdm == NULL || !cmd_need_send(hdm, now))
+            continue;
+        if (hdm->cmd.mode == DM_MODE_POS)
+            send_pos_command(hdm, hdm->cmd.value);
+        else
+            send_vel_command(hdm, hdm->cmd.value);
+        hdm->cmd.sent       = true;
+        hdm->cmd.sent_mode  = hdm->cmd.mode;
+        hdm->cmd.sent_value = hdm->cmd.value;
+        hdm->cmd.sent_tick  = now;
+    }
+}
+#endif
+
 /**
  * @brief 错误处理
  *
@@ -249,14 +675,7 @@ void DM_ERROR_HANDLER()
  */
 void DM_CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan)
 {
-    CAN_RxHeaderTypeDef header;
-    uint8_t             data[8];
-    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &header, data) != HAL_OK)
-    {
-        DM_ERROR_HANDLER();
-        return;
-    }
-    DM_CAN_BaseReceiveCallback(hcan, &header, data);
+    CAN_ReceiveAll(hcan, CAN_RX_FIFO0, DM_CAN_BaseReceiveCallback);
 }
 
 /**
@@ -266,14 +685,7 @@ void DM_CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan)
  */
 void DM_CAN_Fifo1ReceiveCallback(CAN_HandleTypeDef* hcan)
 {
-    CAN_RxHeaderTypeDef header;
-    uint8_t             data[8];
-    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO1, &header, data) != HAL_OK)
-    {
-        DM_ERROR_HANDLER();
-        return;
-    }
-    DM_CAN_BaseReceiveCallback(hcan, &header, data);
+    CAN_ReceiveAll(hcan, CAN_RX_FIFO1, DM_CAN_BaseReceiveCallback);
 }
 
 /**
@@ -286,15 +698,14 @@ void DM_CAN_BaseReceiveCallback(const CAN_HandleTypeDef*   hcan,
                                 const CAN_RxHeaderTypeDef* header,
                                 const uint8_t              data[])
 {
-    for (int i = 0; i < map_size; i++)
+    DM_FeedbackMap* bus_map = getBusMap(hcan);
+    if (bus_map == NULL)
+        return;
+    DM_t* hdm = getDMHandle(bus_map->motors, data, header);
+    if (hdm != NULL)
     {
-        if (hcan == map[i].hcan)
-        {
-            DM_t* hdm = getDMHandle(map[i].motors, data, header);
-            if (hdm != NULL)
-                DM_DataDecode(hdm, data);
-            return;
-        }
+        hdm->feedback.timestamp = header->Timestamp;
+        DM_DataDecode(hdm, data);
     }
 }
 
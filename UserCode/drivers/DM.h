@@ -1,7 +1,8 @@
 #ifndef DM_H
 #define DM_H
 
-#include "main.h"
+#include "bsp/can_driver.h"
+#include "libs/multi_turn.h"
 #include "stdbool.h"
 
 #ifdef __cplusplus
@@ -9,9 +10,57 @@ extern "C"
 {
 #endif
 
-#define MST_ID     0x114 // 反馈id，如果不喜欢这个数字可以自己改（
+#define MST_ID     0x114 // 默认反馈id（master_id 为 0 时使用），如果不喜欢这个数字可以自己改（
 #define DM_CAN_NUM (2)
-#define DM_NUM     (16) // 达妙电机数量上限
+#define DM_NUM     (16) // 每条总线上达妙电机数量上限，反馈帧 data[0] 低 4 位为 id0 的低 4 位
+
+/**
+ * 控制环一个周期内可能多次调用 DM_Vel_SendSetCmd / DM_Pos_SendSetCmd，启用以下宏后它们只把指令写入
+ * 电机的指令槽（后写覆盖先写），由 DM_FlushCmd 在控制周期结尾统一发送，每个电机每周期至多一帧
+ */
+// #define DM_CMD_COALESCE
+
+#ifndef DM_CMD_DEADBAND
+/**
+ * DM_CMD_COALESCE 模式下的指令死区 (unit: rad/s 或 rad)，指令变化不超过死区时不发送
+ */
+#    define DM_CMD_DEADBAND (0.0f)
+#endif
+
+#ifndef DM_CMD_KEEPALIVE_MS
+/**
+ * DM_CMD_COALESCE 模式下指令未变化时的重发间隔 (unit: ms)，电机设置了 CAN 超时时必须小于超时时间
+ */
+#    define DM_CMD_KEEPALIVE_MS (50U)
+#endif
+
+#ifndef DM_ENABLE_RETRY_MS
+/**
+ * DM_EnableProcess 重发使能指令的间隔 (unit: ms)
+ */
+#    define DM_ENABLE_RETRY_MS (20U)
+#endif
+
+#ifndef DM_MIT_KP_MAX
+/**
+ * MIT 模式刚度 Kp 的上限 (unit: N·m/rad)，与电机固件一致，Kp 以 12 位编码 [0, DM_MIT_KP_MAX]
+ */
+#    define DM_MIT_KP_MAX (500.0f)
+#endif
+
+#ifndef DM_MIT_KD_MAX
+/**
+ * MIT 模式阻尼 Kd 的上限 (unit: N·m·s/rad)，与电机固件一致，Kd 以 12 位编码 [0, DM_MIT_KD_MAX]
+ */
+#    define DM_MIT_KD_MAX (5.0f)
+#endif
+
+/**
+ * 角度、速度、力矩读取频率低于反馈频率时可启用以下宏：接收中断只保存原始编码值和圈数，
+ * 读取 __DM_GET_ANGLE / __DM_GET_VELOCITY / __DM_GET_TORQUE 时才换算为物理量并缓存，
+ * 直到下一帧反馈到达
+ */
+// #define DM_LAZY_DECODE
 
 typedef enum
 {
@@ -27,24 +76,53 @@ typedef enum
     DM_MODE_MIT = 0x000
 } DM_MODE_T;
 
+/**
+ * 管理指令，数据为 7 个 0xFF 加指令字节，发往当前模式的指令 ID
+ */
+typedef enum
+{
+    DM_CMD_ENABLE      = 0xFC, ///< 使能
+    DM_CMD_DISABLE     = 0xFD, ///< 失能
+    DM_CMD_SAVE_ZERO   = 0xFE, ///< 把当前位置保存为零点，需要在失能状态下发送
+    DM_CMD_CLEAR_ERROR = 0xFB, ///< 清除错误
+} DM_Command_t;
+
+/**
+ * 反馈帧 data[0] 高 4 位的电机状态
+ */
+typedef enum
+{
+    DM_STATE_DISABLED       = 0x0,
+    DM_STATE_ENABLED        = 0x1,
+    DM_STATE_OVER_VOLTAGE   = 0x8,
+    DM_STATE_UNDER_VOLTAGE  = 0x9,
+    DM_STATE_OVER_CURRENT   = 0xA,
+    DM_STATE_MOS_OVER_TEMP  = 0xB,
+    DM_STATE_COIL_OVER_TEMP = 0xC,
+    DM_STATE_COMM_LOST      = 0xD,
+    DM_STATE_OVERLOAD       = 0xE,
+} DM_State_t;
+
 typedef struct
 {
     uint32_t feedback_count;
-    bool     reverse;   // 是否反转
+    bool     reverse;   // 是否反转，由 DM_Config_t::reverse 设置，初始化后修改无效
     bool     auto_zero; //  是否自动判断零点
-    float    angle_zero;
     struct
     {
-        float   angle;   // 目前单圈位置信息
-        float   vel;     // 反馈速度信息
-        float   T;       // 反馈力矩信息
+        float   angle;   // 目前单圈位置信息，DM_LAZY_DECODE 模式下读取时才更新
+        float   vel;     // 反馈速度信息，DM_LAZY_DECODE 模式下读取时才更新
+        float   T;       // 反馈力矩信息，DM_LAZY_DECODE 模式下读取时才更新
         int8_t  T_MOS;   // 反馈mos温度
         int8_t  T_Rotor; // 反馈电机内部线圈平均温度
-        uint8_t ERR;     // 电机目前状态
+        uint8_t ERR;     // 电机目前状态，见 DM_State_t
+
+        uint32_t timestamp; // 反馈时间戳 (unit: us)，见 CAN_GetTimeUs
 
     } feedback;
-    int32_t            round_cnt;
-    uint8_t            id0;  // 电机id
+    MultiTurn_t        multi_turn; // 多圈位置，以 ±POS_MAX_RAD 的 16 位编码值为单圈
+    uint8_t            id0;        // 电机id
+    uint16_t           master_id;  // 反馈id (Master ID)
     CAN_HandleTypeDef* hcan; // 电机挂载的can线
 
     // param
@@ -59,18 +137,67 @@ typedef struct
     float          vel;                // 电机轴输出速度 (unit: rpm)
     DM_MotorType_t motor_type;         //< 电机类型
     float          inv_reduction_rate; ///< 减速比
+
+    /**
+     * 反馈换算系数，DM_Init 中计算。编码值先在整数域中心化为 2 * raw - (2^bits - 1)，
+     * 再乘以系数即得到物理量
+     */
+    struct
+    {
+        float angle;     ///< 单圈位置 (unit: rad)
+        float vel;       ///< 速度 (unit: rad/s)
+        float T;         ///< 力矩 (unit: N·m)
+        float abs_angle; ///< 多圈编码值 → 电机轴输出角度 (unit: degree)，含反转和减速比
+        float rpm;       ///< 电机轴输出速度 (unit: rpm)，含反转
+        float sign;      ///< 反转时为 -1，否则为 1
+    } scale;
+
+    /**
+     * 使能状态，见 DM_EnableProcess
+     */
+    struct
+    {
+        bool     pending;    ///< 是否等待使能确认
+        uint32_t sent_count; ///< 发送使能指令时的反馈数，之后的反馈才能用于确认
+        uint32_t sent_tick;  ///< 发送使能指令的时间 (unit: ms)
+        bool     sent;       ///< 是否发送过使能指令
+    } enable;
+
+#ifdef DM_LAZY_DECODE
+    struct
+    {
+        uint16_t vel;         ///< 原始速度 (12 bit)
+        uint16_t T;           ///< 原始力矩 (12 bit)
+        uint32_t seq;         ///< 接收中断写入时加一，奇数表示正在写入
+        uint32_t decoded_seq; ///< abs_angle / vel 对应的 seq，奇数表示缓存无效
+    } raw;
+#endif
+
+#ifdef DM_CMD_COALESCE
+    struct
+    {
+        bool      valid;      ///< 指令槽中是否有指令
+        bool      sent;       ///< 是否发送过指令
+        DM_MODE_T mode;       ///< 最新指令模式 (DM_MODE_VEL / DM_MODE_POS)
+        float     value;      ///< 最新指令值 (unit: rad/s 或 rad)
+        DM_MODE_T sent_mode;  ///< 上次发送的指令模式
+        float     sent_value; ///< 上次发送的指令值
+        uint32_t  sent_tick;  ///< 上次发送的时间 (unit: ms)
+    } cmd;
+#endif
 } DM_t;
 
 typedef struct
 {
-    CAN_HandleTypeDef* hcan;      //< CAN 实例
-    DM_t*              motors[8]; //< 电机指针数组
+    CAN_HandleTypeDef* hcan;           //< CAN 实例
+    DM_t*              motors[DM_NUM]; //< 电机指针数组，下标为 id0 的低 4 位
 } DM_FeedbackMap;
 
 typedef struct
 {
     CAN_HandleTypeDef* hcan;
     uint8_t            id0;
+    uint16_t           master_id; ///< 反馈id (Master ID)，与上位机中的设置一致，为 0 时使用 MST_ID
     float              setvel;
     float              setpos;
     float              POS_MAX_RAD;
@@ -79,13 +206,30 @@ typedef struct
     DM_MODE_T          mode;
     DM_MotorType_t     motor_type;     //< 电机类型
     float              reduction_rate; ///< 外接减速比
+    bool               reverse;        ///< 是否反转，反转角度、速度、力矩的反馈和指令
 } DM_Config_t;
 
-#define __DM_GET_ANGLE(__DM_HANDLE__)    (((DM_t*) (__DM_HANDLE__))->abs_angle)
-#define __DM_GET_VELOCITY(__DM_HANDLE__) (((DM_t*) (__DM_HANDLE__))->vel)
+#ifdef DM_LAZY_DECODE
+#    define __DM_GET_ANGLE(__DM_HANDLE__)    (DM_GetAngle((DM_t*) (__DM_HANDLE__)))
+#    define __DM_GET_VELOCITY(__DM_HANDLE__) (DM_GetVelocity((DM_t*) (__DM_HANDLE__)))
+#    define __DM_GET_TORQUE(__DM_HANDLE__)   (DM_GetTorque((DM_t*) (__DM_HANDLE__)))
+#else
+#    define __DM_GET_ANGLE(__DM_HANDLE__)    (((DM_t*) (__DM_HANDLE__))->abs_angle)
+#    define __DM_GET_VELOCITY(__DM_HANDLE__) (((DM_t*) (__DM_HANDLE__))->vel)
+/**
+ * 获取输出轴力矩 (unit: N·m)，feedback.T 为电机自身方向，按 reverse 取反后返回
+ * @param __DM_HANDLE__
+ */
+#    define __DM_GET_TORQUE(__DM_HANDLE__)                                                         \
+        (((DM_t*) (__DM_HANDLE__))->scale.sign * ((DM_t*) (__DM_HANDLE__))->feedback.T)
+#endif
+#define __DM_GET_TIMESTAMP(__DM_HANDLE__) (((DM_t*) (__DM_HANDLE__))->feedback.timestamp)
 
 void DM_ERROR_HANDLER();
 void DM_CAN_FilterInit(CAN_HandleTypeDef* hcan, const uint32_t filter_bank);
+/**
+ * @attention DM_Init 只登记电机，不会使能电机，必须在 CAN_Start 之后周期调用 DM_EnableProcess
+ */
 void DM_Init(DM_t* hdm, const DM_Config_t* dm_config);
 void DM_DataDecode(DM_t* hdm, const uint8_t data[8]);
 void DM_CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan);
@@ -95,7 +239,24 @@ void DM_CAN_BaseReceiveCallback(const CAN_HandleTypeDef*   hcan,
                                 const uint8_t              data[]);
 void DM_Vel_SendSetCmd(DM_t* hdm, const float value_vel);
 void DM_Pos_SendSetCmd(DM_t* hdm, const float value_pos);
-void DM_ResetAngle(DM_t* hdm);
+void DM_MIT_SendSetCmd(DM_t*       hdm,
+                       const float pos,
+                       const float vel,
+                       const float kp,
+                       const float kd,
+                       const float torque);
+#ifdef DM_CMD_COALESCE
+void DM_FlushCmd(const CAN_HandleTypeDef* hcan);
+#endif
+void     DM_ResetAngle(DM_t* hdm);
+void     DM_SendCommand(DM_t* hdm, DM_Command_t cmd);
+void     DM_EnableAll(const CAN_HandleTypeDef* hcan);
+uint32_t DM_EnableProcess(const CAN_HandleTypeDef* hcan);
+#ifdef DM_LAZY_DECODE
+float DM_GetAngle(DM_t* hdm);
+float DM_GetVelocity(DM_t* hdm);
+float DM_GetTorque(DM_t* hdm);
+#endif
 
 #ifdef __cplusplus
 }
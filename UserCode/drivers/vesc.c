@@ -25,6 +25,7 @@
 
 #include <string.h>
 #include "bsp/can_driver.h"
+#include "cmsis_compiler.h"
 #include "main.h"
 
 #ifdef __cplusplus
@@ -32,6 +33,8 @@ extern "C"
 {
 #endif
 
+#define VESC_CAN_STATUS_FILTER_MASK (0x1FFFE0FFU)
+
 static VESC_FeedbackMap map[VESC_CAN_NUM];
 static size_t           map_size = 0;
 
@@ -40,21 +43,21 @@ static inline int to_map_id(const int id)
     return id - VESC_ID_OFFSET;
 }
 
-static inline VESC_t* get_vesc_handle(VESC_t* motors[VESC_NUM], const CAN_RxHeaderTypeDef* header)
+static inline VESC_t* get_vesc_by_id(VESC_t* motors[VESC_NUM], const uint8_t id)
 {
-    if (header->IDE != CAN_ID_EXT)
-        return NULL;
-    const uint8_t id = header->ExtId & 0xFF;
     // 不在注册范围内
     if (id < VESC_ID_OFFSET || id >= VESC_ID_OFFSET + VESC_NUM)
         return NULL;
-    if (motors[to_map_id(id)] == NULL)
-    {
-        return NULL;
-    }
     return motors[to_map_id(id)];
 }
 
+static inline VESC_t* get_vesc_handle(VESC_t* motors[VESC_NUM], const CAN_RxHeaderTypeDef* header)
+{
+    if (header->IDE != CAN_ID_EXT)
+        return NULL;
+    return get_vesc_by_id(motors, header->ExtId & 0xFF);
+}
+
 static float clamp_value(const float value, const float max)
 {
     if (value > max)
@@ -65,50 +68,60 @@ static float clamp_value(const float value, const float max)
 }
 
 /**
- * 获取 CAN 指令数据 ( - | int32 ) 类
+ * 编码 CAN 指令数据 ( - | int32 ) 类
  * @param pocket_id vesc can pocket id (set)
  * @param value 参数值
- * @param data 数据缓冲区
+ * @param data_value 编码后的指令值
+ * @return 是否为支持的指令类型
  */
-static void get_set_command_data(VESC_t*                    hvesc,
-                                 const VESC_CAN_PocketSet_t pocket_id,
-                                 const float                value,
-                                 uint8_t                    data[])
+static bool get_set_command_value(VESC_t*                    hvesc,
+                                  const VESC_CAN_PocketSet_t pocket_id,
+                                  const float                value,
+                                  int32_t*                   data_value)
 {
-    int32_t data_value;
     switch (pocket_id)
     {
     case VESC_CAN_SET_DUTY:
         // 设置占空比, Data: Duty Circle * 100,000 (int32)
-        data_value = (int32_t) (clamp_value(value, VESC_SET_DUTY_MAX) * 1e5f);
+        *data_value = (int32_t) (clamp_value(value, VESC_SET_DUTY_MAX) * 1e5f);
         break;
     case VESC_CAN_SET_CURRENT:
         // 设置电流, Data: current * 1000 (int32)
-        data_value = (int32_t) (clamp_value(value, VESC_SET_CURRENT_MAX) * 1e3f);
+        *data_value = (int32_t) (clamp_value(value, VESC_SET_CURRENT_MAX) * 1e3f);
         break;
     case VESC_CAN_SET_CURRENT_BRAKE:
         // 设置刹车电流, Data: current * 1000 (int32)
-        data_value = (int32_t) (clamp_value(value, VESC_SET_CURRENT_BRAKE_MAX) * 1e3f);
+        *data_value = (int32_t) (clamp_value(value, VESC_SET_CURRENT_BRAKE_MAX) * 1e3f);
         break;
     case VESC_CAN_SET_RPM:
         // 设置转速, Data: ERPM (int32)
-        data_value = (int32_t) (clamp_value(value, VESC_SET_RPM_MAX)) * hvesc->electrodes;
+        *data_value = (int32_t) (clamp_value(value, VESC_SET_RPM_MAX)) * hvesc->electrodes;
         break;
     case VESC_CAN_SET_POS:
         // 设置位置, Data: pos * 1,000,000 (int32) unit: ?
-        data_value = (int32_t) (clamp_value(value, VESC_SET_POS_MAX) * 1e6f);
+        *data_value = (int32_t) (clamp_value(value, VESC_SET_POS_MAX) * 1e6f);
         break;
     case VESC_CAN_SET_CURRENT_REL:
         // 设置相对电流，Data: ratio (-1 to 1) * 100,000 (int32). 相对于最大值和最小值
-        data_value = (int32_t) (clamp_value(value, VESC_SET_CURRENT_REL_MAX) * 1e5);
+        *data_value = (int32_t) (clamp_value(value, VESC_SET_CURRENT_REL_MAX) * 1e5);
         break;
     case VESC_CAN_SET_CURRENT_BRAKE_REL:
         // 设置相对电流，Data: ratio (-1 to 1) * 100,000 (int32). 相对于最大值和最小值
-        data_value = (int32_t) (clamp_value(value, VESC_SET_CURRENT_BRAKE_REL_MAX) * 1e5);
+        *data_value = (int32_t) (clamp_value(value, VESC_SET_CURRENT_BRAKE_REL_MAX) * 1e5);
         break;
     default:
-        return;
+        return false;
     }
+    return true;
+}
+
+/**
+ * 获取 CAN 指令数据 ( - | int32 ) 类
+ * @param data_value 编码后的指令值
+ * @param data 数据缓冲区
+ */
+static void get_set_command_data(const int32_t data_value, uint8_t data[])
+{
     data[0] = data_value >> 24;
     data[1] = data_value >> 16;
     data[2] = data_value >> 8;
@@ -119,28 +132,30 @@ static void get_set_command_data(VESC_t*                    hvesc,
     data[7] = 0x00;
 }
 
-static void get_conf_command_data(const VESC_CAN_PocketConf_t pocket_id,
-                                  const float                 value0,
-                                  const float                 value1,
-                                  uint8_t                     data[8])
+/**
+ * 获取 CAN 配置指令数据 ( int32 | int32 ) 类
+ * @param data_value0 编码后的第一个参数（电流下限）
+ * @param data_value1 编码后的第二个参数（电流上限）
+ * @param data 数据缓冲区
+ */
+static void get_conf_command_data(const int32_t data_value0,
+                                  const int32_t data_value1,
+                                  uint8_t       data[8])
 {
-#warning "not implemented!";
-    int16_t data_value0, data_value1;
-    switch (pocket_id)
-    {
-    case VESC_CAN_CONF_CURRENT_LIMITS:
-        break;
-    case VESC_CAN_CONF_STORE_CURRENT_LIMITS:
-        break;
-    case VESC_CAN_CONF_CURRENT_LIMITS_IN:
-        break;
-    case VESC_CAN_CONF_STORE_CURRENT_LIMITS_IN:
-        break;
-    }
+    data[0] = data_value0 >> 24;
+    data[1] = data_value0 >> 16;
+    data[2] = data_value0 >> 8;
+    data[3] = data_value0;
+    data[4] = data_value1 >> 24;
+    data[5] = data_value1 >> 16;
+    data[6] = data_value1 >> 8;
+    data[7] = data_value1;
 }
 
 /**
  * 初始化 VESC CAN 过滤器
+ *
+ * 过滤器匹配到的帧会通过 CAN_Fifo{0,1}ReceiveCallback 直接交给 VESC_CAN_BaseReceiveCallback
  * @param hcan can handle
  * @param filter_bank 过滤器编号
  * @retval HAL_StatusTypeDef
@@ -157,7 +172,7 @@ HAL_StatusTypeDef VESC_CAN_FilterInit(CAN_HandleTypeDef* hcan, const uint32_t fi
                                               .FilterScale          = CAN_FILTERSCALE_32BIT,
                                               .FilterActivation     = ENABLE,
                                               .SlaveStartFilterBank = 14 };
-    return HAL_CAN_ConfigFilter(hcan, &sFilterConfig);
+    return CAN_ConfigFilter(hcan, &sFilterConfig, VESC_CAN_BaseReceiveCallback);
 }
 
 static int32_t be_to_i32(const uint8_t* bytes)
@@ -170,6 +185,38 @@ static int16_t be_to_i16(const uint8_t* bytes)
     return (int16_t) ((uint16_t) bytes[0] << 8 | (uint16_t) bytes[1]);
 }
 
+/**
+ * CRC16 (XMODEM)，与 VESC 固件的 crc16 相同
+ * @param data 数据
+ * @param len 长度
+ * @return CRC
+ */
+static uint16_t crc16(const uint8_t* data, const uint16_t len)
+{
+    uint16_t crc = 0;
+    for (uint16_t i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t) data[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (uint16_t) (crc << 1 ^ 0x1021) : (uint16_t) (crc << 1);
+    }
+    return crc;
+}
+
+/**
+ * 把 ERPM 换算为每秒转过的位置编码值 (pos * 50)，用于多圈外推
+ * @param erpm 电转速
+ * @param electrodes 电极数
+ * @return 速度 (unit: 编码值/s)
+ */
+static int32_t vesc_count_velocity(const int32_t erpm, const uint8_t electrodes)
+{
+    if (electrodes == 0)
+        return 0;
+    // 18000 编码值 / 圈，rpm 换算为每秒需除以 60
+    return (int32_t) ((int64_t) erpm * 300 / electrodes);
+}
+
 /**
  * VESC 反馈数据解算
  * @param hvesc vesc handle
@@ -185,10 +232,18 @@ void VESC_CAN_DataDecode(VESC_t*                       hvesc,
     switch (pocket_id)
     {
     case VESC_CAN_STATUS:
-        hvesc->feedback.erpm          = (float) be_to_i32(data + 0);
+#ifdef VESC_LAZY_DECODE
+        hvesc->raw.seq++;
+        __DMB(); // 先标记为正在写入
+        hvesc->raw.erpm = be_to_i32(data + 0);
+        __DMB(); // 写入完成后再发布
+        hvesc->raw.seq++;
+#else
+        hvesc->feedback.erpm = (float) be_to_i32(data + 0);
+        hvesc->velocity      = hvesc->feedback.erpm / (float) hvesc->electrodes;
+#endif
         hvesc->feedback.current_motor = (float) be_to_i16(data + 4) / 10.0f;
         hvesc->feedback.duty          = (float) be_to_i16(data + 6) / 1000.0f;
-        hvesc->velocity               = hvesc->feedback.erpm / (float) hvesc->electrodes;
         break;
     case VESC_CAN_STATUS_2:
         hvesc->feedback.amp_hours         = (float) be_to_i32(data + 0) / 10000.0f;
@@ -202,15 +257,25 @@ void VESC_CAN_DataDecode(VESC_t*                       hvesc,
         hvesc->feedback.mos_temperature   = (float) be_to_i16(data + 0) / 10.0f;
         hvesc->feedback.motor_temperature = (float) be_to_i16(data + 2) / 10.0f;
         hvesc->feedback.current_in        = (float) be_to_i16(data + 4) / 10.0f;
-        const float new_pos               = (float) be_to_i16(data + 6) / 50.0f;
-        // 统计旋转圈数，反馈频率必须 > 转速(rpm) / 30
-        if (new_pos < 90 && hvesc->feedback.pos > 270)
-            hvesc->feedback.round_cnt++;
-        if (new_pos > 270 && hvesc->feedback.pos < 90)
-            hvesc->feedback.round_cnt--;
-        hvesc->feedback.pos = new_pos;
-        hvesc->abs_angle    = (float) hvesc->feedback.round_cnt * 360.0f + hvesc->feedback.pos -
-                           hvesc->angle_zero;
+        const uint16_t new_pos = (uint16_t) be_to_i16(data + 6);
+#ifdef VESC_LAZY_DECODE
+        hvesc->raw.seq++;
+        __DMB(); // 先标记为正在写入
+        // 用最新的转速外推，丢帧时也能判断出正确的圈数
+        MultiTurn_Update(&hvesc->feedback.multi_turn,
+                         new_pos,
+                         vesc_count_velocity(hvesc->raw.erpm, hvesc->electrodes),
+                         hvesc->feedback.timestamp);
+        __DMB(); // 写入完成后再发布
+        hvesc->raw.seq++;
+#else
+        MultiTurn_Update(&hvesc->feedback.multi_turn,
+                         new_pos,
+                         vesc_count_velocity((int32_t) hvesc->feedback.erpm, hvesc->electrodes),
+                         hvesc->feedback.timestamp);
+        hvesc->feedback.pos = (float) new_pos / 50.0f;
+        hvesc->abs_angle    = MultiTurn_ToFloat(&hvesc->feedback.multi_turn, 1.0f / 50.0f);
+#endif
         break;
     case VESC_CAN_STATUS_5:
         hvesc->feedback.tachometer_value = (float) be_to_i32(data + 0);
@@ -223,17 +288,209 @@ void VESC_CAN_DataDecode(VESC_t*                       hvesc,
         VESC_ResetAngle(hvesc);
 }
 
+/**
+ * COMM_GET_VALUES 回复中解析的部分的长度 (不含指令字节)，较新固件在其后追加的字段不解析
+ */
+#define VESC_VALUES_LEN (57U)
+
+/**
+ * 解析 COMM_GET_VALUES 的回复
+ * @param values 解析结果
+ * @param data 回复数据（不含指令字节）
+ * @param len 数据长度
+ * @param timestamp 回复结束帧的时间戳 (unit: us)
+ */
+static void decode_values(VESC_Values_t* values,
+                          const uint8_t* data,
+                          const uint16_t len,
+                          const uint32_t timestamp)
+{
+    if (len < VESC_VALUES_LEN)
+        return;
+    values->mos_temperature    = (float) be_to_i16(data + 0) / 10.0f;
+    values->motor_temperature  = (float) be_to_i16(data + 2) / 10.0f;
+    values->current_motor      = (float) be_to_i32(data + 4) / 100.0f;
+    values->current_in         = (float) be_to_i32(data + 8) / 100.0f;
+    values->id                 = (float) be_to_i32(data + 12) / 100.0f;
+    values->iq                 = (float) be_to_i32(data + 16) / 100.0f;
+    values->duty               = (float) be_to_i16(data + 20) / 1000.0f;
+    values->erpm               = (float) be_to_i32(data + 22);
+    values->vin                = (float) be_to_i16(data + 26) / 10.0f;
+    values->amp_hours          = (float) be_to_i32(data + 28) / 10000.0f;
+    values->amp_hours_charged  = (float) be_to_i32(data + 32) / 10000.0f;
+    values->watt_hours         = (float) be_to_i32(data + 36) / 10000.0f;
+    values->watt_hours_charged = (float) be_to_i32(data + 40) / 10000.0f;
+    values->tachometer         = be_to_i32(data + 44);
+    values->tachometer_abs     = be_to_i32(data + 48);
+    values->fault_code         = data[52];
+    values->pid_pos            = (float) be_to_i32(data + 53) / 1e6f;
+    values->timestamp          = timestamp;
+    values->count++;
+}
+
+/**
+ * 处理 VESC 通过缓冲区发来的数据包
+ * @param bus_map 总线
+ * @param sender 发送方 id
+ * @param packet 数据包，第一个字节为指令
+ * @param len 数据包长度
+ * @param timestamp 结束帧的时间戳 (unit: us)
+ */
+static void process_packet(VESC_FeedbackMap* bus_map,
+                           const uint8_t     sender,
+                           const uint8_t*    packet,
+                           const uint16_t    len,
+                           const uint32_t    timestamp)
+{
+    VESC_t* hvesc = get_vesc_by_id(bus_map->motors, sender);
+    if (hvesc == NULL || len == 0)
+        return;
+    switch (packet[0])
+    {
+    case VESC_COMM_GET_VALUES:
+        decode_values(&hvesc->values, packet + 1, len - 1, timestamp);
+        break;
+    default: // 其他数据包不解析
+        break;
+    }
+}
+
+/**
+ * 把一个分片写入接收缓冲区
+ * @param buffer 接收缓冲区
+ * @param offset 分片在数据包中的偏移
+ * @param data 分片数据
+ * @param len 分片长度
+ */
+static void fill_rx_buffer(VESC_RxBuffer_t* buffer,
+                           const uint16_t   offset,
+                           const uint8_t*   data,
+                           const uint8_t    len)
+{
+    if (offset == 0)
+        buffer->len = 0; // 新的数据包
+    // 超出缓冲区或缺少前面的分片时丢弃，结束帧的长度检查会使整个数据包作废
+    if (offset + len > VESC_RX_BUFFER_SIZE || offset > buffer->len)
+        return;
+    memcpy(buffer->data + offset, data, len);
+    if (offset + len > buffer->len)
+        buffer->len = offset + len;
+}
+
+/**
+ * 处理发往 VESC_HOST_ID 的缓冲区帧
+ * @param bus_map 总线
+ * @param pocket_id 数据包类型
+ * @param header 帧头
+ * @param data 数据
+ */
+static void receive_buffer(VESC_FeedbackMap*          bus_map,
+                           const uint32_t             pocket_id,
+                           const CAN_RxHeaderTypeDef* header,
+                           const uint8_t              data[])
+{
+    VESC_RxBuffer_t* buffer = &bus_map->rx_buffer;
+    const uint8_t    dlc    = header->DLC <= 8 ? header->DLC : 8;
+    switch (pocket_id)
+    {
+    case VESC_CAN_FILL_RX_BUFFER:
+        // Data: offset (uint8), 至多 7 字节数据
+        if (dlc > 1)
+            fill_rx_buffer(buffer, data[0], data + 1, dlc - 1);
+        break;
+    case VESC_CAN_FILL_RX_BUFFER_LONG:
+        // Data: offset (uint16), 至多 6 字节数据
+        if (dlc > 2)
+            fill_rx_buffer(buffer, (uint16_t) (data[0] << 8 | data[1]), data + 2, dlc - 2);
+        break;
+    case VESC_CAN_PROCESS_RX_BUFFER:
+    {
+        // Data: 发送方 id, send, 长度 (uint16), CRC (uint16)
+        if (dlc < 6)
+            break;
+        const uint16_t len = (uint16_t) (data[2] << 8 | data[3]);
+        const uint16_t crc = (uint16_t) (data[4] << 8 | data[5]);
+        if (len <= buffer->len && crc16(buffer->data, len) == crc)
+            process_packet(bus_map, data[0], buffer->data, len, header->Timestamp);
+        buffer->len = 0;
+        break;
+    }
+    case VESC_CAN_PROCESS_SHORT_BUFFER:
+        // Data: 发送方 id, send, 至多 6 字节数据
+        if (dlc > 2)
+            process_packet(bus_map, data[0], data + 2, dlc - 2, header->Timestamp);
+        break;
+    default:
+        break;
+    }
+}
+
 /**
  * 清零 VESC 输出角度
  * @param hvesc vesc handle
  */
 void VESC_ResetAngle(VESC_t* hvesc)
 {
-    hvesc->feedback.round_cnt = 0;
-    hvesc->angle_zero         = hvesc->feedback.pos;
-    hvesc->abs_angle          = 0;
+    MultiTurn_ResetZero(&hvesc->feedback.multi_turn);
+#ifdef VESC_LAZY_DECODE
+    hvesc->raw.decoded_seq = 1U; // 奇数，使缓存失效
+#endif
+    hvesc->abs_angle = 0;
+}
+
+#ifdef VESC_LAZY_DECODE
+/**
+ * 把最新的原始反馈换算为物理量，缓存仍有效时直接返回
+ * @param hvesc vesc handle
+ */
+static void vesc_lazy_decode(VESC_t* hvesc)
+{
+    uint32_t    seq;
+    int32_t     raw_erpm;
+    MultiTurn_t multi_turn;
+    do
+    {
+        seq = hvesc->raw.seq;
+        if (seq == hvesc->raw.decoded_seq)
+            return; // 缓存仍有效
+        if ((seq & 1U) != 0)
+            return; // 抢占了正在写入的接收中断，沿用上一次的值
+        __DMB();
+        raw_erpm   = hvesc->raw.erpm;
+        multi_turn = hvesc->feedback.multi_turn;
+        __DMB();
+    } while (seq != hvesc->raw.seq); // 读取期间收到了新的状态包
+
+    hvesc->feedback.erpm   = (float) raw_erpm;
+    hvesc->feedback.pos    = (float) multi_turn.raw / 50.0f;
+    hvesc->velocity        = hvesc->feedback.erpm / (float) hvesc->electrodes;
+    hvesc->abs_angle       = MultiTurn_ToFloat(&multi_turn, 1.0f / 50.0f);
+    hvesc->raw.decoded_seq = seq;
 }
 
+/**
+ * 获取电机角度
+ * @param hvesc vesc handle
+ * @return 角度 (unit: degree)
+ */
+float VESC_GetAngle(VESC_t* hvesc)
+{
+    vesc_lazy_decode(hvesc);
+    return hvesc->abs_angle;
+}
+
+/**
+ * 获取电机转速
+ * @param hvesc vesc handle
+ * @return 转速 (unit: rpm)
+ */
+float VESC_GetVelocity(VESC_t* hvesc)
+{
+    vesc_lazy_decode(hvesc);
+    return hvesc->velocity;
+}
+#endif
+
 /**
  * 初始化 VESC
  * @param hvesc vesc handle
@@ -248,6 +505,15 @@ void VESC_Init(VESC_t* hvesc, const VESC_Config_t* config)
     hvesc->electrodes = config->electrodes;
     hvesc->enable     = true;
     hvesc->auto_zero  = config->auto_zero;
+    // 位置反馈为 0 ~ 360 度乘以 50
+    MultiTurn_Init(&hvesc->feedback.multi_turn, 18000, 0);
+
+    if (hvesc->id == VESC_HOST_ID)
+    {
+        // 与本机 id 冲突，请修改 VESC_HOST_ID
+        Error_Handler();
+        return;
+    }
 
     VESC_t** mapped_motors = NULL;
     for (int i = 0; i < map_size; i++)
@@ -269,28 +535,192 @@ void VESC_Init(VESC_t* hvesc, const VESC_Config_t* config)
     {
         mapped_motors[to_map_id(hvesc->id)] = hvesc;
     }
+
+    /**
+     * 登记反馈 ID，供 CAN_FilterApply 生成过滤器
+     * ExtId = pocket_id << 8 | id，状态包的 pocket_id 均小于 32，匹配 id 和 pocket_id 的高位
+     */
+    CAN_FilterAddMask(hvesc->hcan,
+                      CAN_ID_EXT,
+                      hvesc->id,
+                      VESC_CAN_STATUS_FILTER_MASK,
+                      VESC_CAN_BaseReceiveCallback);
+    // 发往本机的缓冲区帧，pocket_id 同样小于 32
+    CAN_FilterAddMask(hvesc->hcan,
+                      CAN_ID_EXT,
+                      VESC_HOST_ID,
+                      VESC_CAN_STATUS_FILTER_MASK,
+                      VESC_CAN_BaseReceiveCallback);
+}
+
+/**
+ * 发送编码后的指令帧
+ * @param hvesc vesc handle
+ * @param pocket_id 数据包类型
+ * @param data_value 编码后的指令值
+ */
+static void send_set_command(const VESC_t*              hvesc,
+                             const VESC_CAN_PocketSet_t pocket_id,
+                             const int32_t              data_value)
+{
+    uint8_t data[8];
+    get_set_command_data(data_value, data);
+    CAN_SendMessage(hvesc->hcan,
+                    &(CAN_TxHeaderTypeDef) {
+                            .ExtId = pocket_id << 8 | hvesc->id,
+                            .IDE   = CAN_ID_EXT,
+                            .RTR   = CAN_RTR_DATA,
+                            .DLC   = 4,
+                    },
+                    data);
 }
 
 /**
  * 发送指令
+ * @note 定义 VESC_CMD_COALESCE 时只写入指令槽，由 VESC_FlushCmd 发送
  * @param hvesc vesc handle
  * @param pocket_id 数据包类型
  * @param value 指令值
  */
 void VESC_SendSetCmd(VESC_t* hvesc, const VESC_CAN_PocketSet_t pocket_id, const float value)
 {
-    static uint8_t data[8] = { 0 };
-    get_set_command_data(hvesc, pocket_id, value, data);
+    int32_t data_value;
+    if (!get_set_command_value(hvesc, pocket_id, value, &data_value))
+        return;
+#ifdef VESC_CMD_COALESCE
+    hvesc->cmd.pocket_id = pocket_id;
+    hvesc->cmd.value     = data_value;
+    hvesc->cmd.valid     = true;
+#else
+    send_set_command(hvesc, pocket_id, data_value);
+#endif
+}
+
+/**
+ * 设置电流限制
+ *
+ * 编码后的限制与上次成功发送（含进入软件发送队列）的相同时不再发送；
+ * 要求写入 EEPROM 而上次没有写入时仍会发送。
+ * 不写入 EEPROM 的限制在电调重新上电后恢复为 vesctool 中的设置
+ * @note 配置指令总是立即发送，不经过 VESC_CMD_COALESCE 的指令槽
+ * @param hvesc vesc handle
+ * @param pocket_id 数据包类型，VESC_CAN_CONF_CURRENT_LIMITS(_IN) 只修改运行参数，
+ *                  VESC_CAN_CONF_STORE_CURRENT_LIMITS(_IN) 同时写入 EEPROM
+ * @param min 电流下限 (unit: A)，一般为负值（刹车 / 回充电流）
+ * @param max 电流上限 (unit: A)
+ */
+void VESC_SetCurrentLimits(VESC_t*                     hvesc,
+                           const VESC_CAN_PocketConf_t pocket_id,
+                           const float                 min,
+                           const float                 max)
+{
+    if (pocket_id < VESC_CAN_CONF_CURRENT_LIMITS ||
+        pocket_id > VESC_CAN_CONF_STORE_CURRENT_LIMITS_IN)
+        return;
+    // 21 / 22 为电机电流，23 / 24 为输入电流，22 / 24 写入 EEPROM
+    const bool    store    = pocket_id == VESC_CAN_CONF_STORE_CURRENT_LIMITS ||
+                             pocket_id == VESC_CAN_CONF_STORE_CURRENT_LIMITS_IN;
+    const int     index    = pocket_id >= VESC_CAN_CONF_CURRENT_LIMITS_IN ? 1 : 0;
+    const int32_t data_min = (int32_t) (clamp_value(min, VESC_SET_CURRENT_MAX) * 1e3f);
+    const int32_t data_max = (int32_t) (clamp_value(max, VESC_SET_CURRENT_MAX) * 1e3f);
+
+    VESC_CurrentLimits_t* limits = &hvesc->current_limits[index];
+    if (limits->sent && limits->min == data_min && limits->max == data_max &&
+        (!store || limits->stored))
+        return;
+
+    uint8_t data[8];
+    get_conf_command_data(data_min, data_max, data);
+    const CAN_TxHeaderTypeDef header = {
+        .ExtId = pocket_id << 8 | hvesc->id,
+        .IDE   = CAN_ID_EXT,
+        .RTR   = CAN_RTR_DATA,
+        .DLC   = 8,
+    };
+    // 发送失败时不记录，下次调用会重新发送
+    if (CAN_SendMessage(hvesc->hcan, &header, data) == CAN_SEND_FAILED)
+        return;
+    limits->sent   = true;
+    limits->stored = store;
+    limits->min    = data_min;
+    limits->max    = data_max;
+}
+
+/**
+ * 请求 COMM_GET_VALUES 运行数据
+ *
+ * 以 PROCESS_SHORT_BUFFER 发送，VESC 以长数据包回复到 VESC_HOST_ID，约 10 帧，
+ * 解析结果写入 hvesc->values，完成后 values.count 加一。按需读取详细数据时，
+ * 可以在 vesctool 中只保留控制需要的 STATUS 包，节省总线带宽
+ * @attention 同一总线上的回复共用一个接收缓冲区，上一个请求的回复收到之前不要请求另一个电调
+ * @param hvesc vesc handle
+ */
+void VESC_RequestValues(const VESC_t* hvesc)
+{
+    // Data: 回复的目标 id, send = 0（处理后通过 CAN 回复）, 数据包
+    const uint8_t data[8] = { VESC_HOST_ID, 0, VESC_COMM_GET_VALUES };
     CAN_SendMessage(hvesc->hcan,
                     &(CAN_TxHeaderTypeDef) {
-                            .ExtId = pocket_id << 8 | hvesc->id,
+                            .ExtId = VESC_CAN_PROCESS_SHORT_BUFFER << 8 | hvesc->id,
                             .IDE   = CAN_ID_EXT,
                             .RTR   = CAN_RTR_DATA,
-                            .DLC   = 4,
+                            .DLC   = 3,
                     },
                     data);
 }
 
+#ifdef VESC_CMD_COALESCE
+/**
+ * 判断指令槽中的指令是否需要发送
+ * @param hvesc vesc handle
+ * @param now 当前时间 (unit: ms)
+ */
+static bool cmd_need_send(const VESC_t* hvesc, const uint32_t now)
+{
+    if (!hvesc->cmd.valid)
+        return false;
+    if (!hvesc->cmd.sent || hvesc->cmd.pocket_id != hvesc->cmd.sent_pocket_id)
+        return true;
+    // 归零指令（如停车）不受死区影响
+    if (hvesc->cmd.value == 0 && hvesc->cmd.sent_value != 0)
+        return true;
+    const int64_t diff = (int64_t) hvesc->cmd.value - hvesc->cmd.sent_value;
+    if (diff > VESC_CMD_DEADBAND || diff < -VESC_CMD_DEADBAND)
+        return true;
+    return now - hvesc->cmd.sent_tick >= VESC_CMD_KEEPALIVE_MS;
+}
+
+/**
+ * 发送该总线上所有 VESC 指令槽中的指令
+ *
+ * 每个电机至多发送一帧，编码后的指令与上次发送相比变化超过 VESC_CMD_DEADBAND，
+ * 或距上次发送超过 VESC_CMD_KEEPALIVE_MS 时才会发送
+ * @attention 需要在控制周期（定时器中断回调）结尾调用一次
+ * @param hcan can handle
+ */
+void VESC_FlushCmd(const CAN_HandleTypeDef* hcan)
+{
+    const uint32_t now = HAL_GetTick();
+    for (int i = 0; i < map_size; i++)
+    {
+        if (map[i].hcan != hcan)
+            continue;
+        for (int j = 0; j < VESC_NUM; j++)
+        {
+            VESC_t* hvesc = map[i].motors[j];
+            if (hvesc == NULL || !cmd_need_send(hvesc, now))
+                continue;
+            send_set_command(hvesc, hvesc->cmd.pocket_id, hvesc->cmd.value);
+            hvesc->cmd.sent           = true;
+            hvesc->cmd.sent_pocket_id = hvesc->cmd.pocket_id;
+            hvesc->cmd.sent_value     = hvesc->cmd.value;
+            hvesc->cmd.sent_tick      = now;
+        }
+        return;
+    }
+}
+#endif
+
 /**
  * CAN FIFO0 接收回调函数
  * @attention 必须*注册*回调函数或者在更高级的回调函数内调用此回调函数
@@ -301,13 +731,7 @@ void VESC_SendSetCmd(VESC_t* hvesc, const VESC_CAN_PocketSet_t pocket_id, const
  */
 void VESC_CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan)
 {
-    CAN_RxHeaderTypeDef header;
-    uint8_t             data[8];
-    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &header, data) != HAL_OK)
-    {
-        return;
-    }
-    VESC_CAN_BaseReceiveCallback(hcan, &header, data);
+    CAN_ReceiveAll(hcan, CAN_RX_FIFO0, VESC_CAN_BaseReceiveCallback);
 }
 
 /**
@@ -316,7 +740,7 @@ void VESC_CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan)
  * @param header
  * @param data
  */
-void VESC_CAN_BaseReceiveCallback(CAN_HandleTypeDef*         hcan,
+void VESC_CAN_BaseReceiveCallback(const CAN_HandleTypeDef*   hcan,
                                   const CAN_RxHeaderTypeDef* header,
                                   const uint8_t              data[])
 {
@@ -324,9 +748,17 @@ void VESC_CAN_BaseReceiveCallback(CAN_HandleTypeDef*         hcan,
     {
         if (hcan == map[i].hcan)
         {
+            if (header->IDE == CAN_ID_EXT && (header->ExtId & 0xFF) == VESC_HOST_ID)
+            {
+                receive_buffer(&map[i], header->ExtId >> 8, header, data);
+                return;
+            }
             VESC_t* hvesc = get_vesc_handle(map[i].motors, header);
             if (hvesc != NULL)
+            {
+                hvesc->feedback.timestamp = header->Timestamp;
                 VESC_CAN_DataDecode(hvesc, header->ExtId >> 8, data);
+            }
             return;
         }
     }
@@ -29,7 +29,8 @@
 
 #include <stdbool.h>
 
-#include "main.h"
+#include "bsp/can_driver.h"
+#include "libs/multi_turn.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -58,6 +59,50 @@ extern "C"
 #    define VESC_ID_OFFSET (0)
 #endif
 
+#ifndef VESC_HOST_ID
+/**
+ * 本机在 VESC CAN 总线上的 id。VESC 把 VESC_RequestValues 等请求的回复发往这个 id，
+ * 不能与已注册的电调 id 相同
+ */
+#    define VESC_HOST_ID (0xFE)
+#endif
+
+#ifndef VESC_RX_BUFFER_SIZE
+/**
+ * 每条总线的长数据包接收缓冲区大小 (unit: byte)，COMM_GET_VALUES 的回复约 74 字节，
+ * 更长的数据包会被丢弃
+ */
+#    define VESC_RX_BUFFER_SIZE (128)
+#endif
+
+/**
+ * 控制环一个周期内可能多次调用 VESC_SendSetCmd，启用以下宏后它只把指令写入电机的指令槽
+ * （后写覆盖先写），由 VESC_FlushCmd 在控制周期结尾统一发送，每个电机每周期至多一帧
+ */
+// #define VESC_CMD_COALESCE
+
+#ifndef VESC_CMD_DEADBAND
+/**
+ * VESC_CMD_COALESCE 模式下的指令死区，单位为数据包的最小刻度（如 SET_RPM 为 1 ERPM，SET_CURRENT 为
+ * 1 mA），编码后的指令变化不超过死区时不发送
+ */
+#    define VESC_CMD_DEADBAND (0)
+#endif
+
+#ifndef VESC_CMD_KEEPALIVE_MS
+/**
+ * VESC_CMD_COALESCE 模式下指令未变化时的重发间隔 (unit: ms)，
+ * 必须小于 vesctool 中设置的 CAN 超时时间
+ */
+#    define VESC_CMD_KEEPALIVE_MS (50U)
+#endif
+
+/**
+ * 角度、速度读取频率低于状态包频率时可启用以下宏：接收中断只保存原始 ERPM、位置和圈数，
+ * 读取 __VESC_GET_ANGLE / __VESC_GET_VELOCITY 时才换算为物理量并缓存，直到下一帧状态包到达
+ */
+// #define VESC_LAZY_DECODE
+
 /* 参数范围限制 */
 #define VESC_SET_DUTY_MAX              (1.0f)
 #define VESC_SET_CURRENT_MAX           (2e6f)
@@ -88,28 +133,33 @@ typedef enum
      * current limits, command 22 sets the operating current limits and sends
      * them to EEPROM
      */
-    VESC_CAN_CONF_CURRENT_LIMITS = 21U, ///< 设置电流限制, Data: Max Current Limit * 1000 (int32),
-                                        ///< Min Current Limit * 1000 (int32)
-    VESC_CAN_CONF_STORE_CURRENT_LIMITS = 22U, ///< 设置电流限制, Data: Max Current Limit * 1000
-                                              ///< (int32), Min Current Limit * 1000 (int32)
+    VESC_CAN_CONF_CURRENT_LIMITS = 21U, ///< 设置电流限制, Data: Min Current Limit * 1000 (int32),
+                                        ///< Max Current Limit * 1000 (int32)
+    VESC_CAN_CONF_STORE_CURRENT_LIMITS = 22U, ///< 设置电流限制, Data: Min Current Limit * 1000
+                                              ///< (int32), Max Current Limit * 1000 (int32)
 
     /**
      * There are two versions of this command, command 23 sets the operating
      * current limits, command 24 sets the operating current limits and sends
      * them to EEPROM
      */
-    VESC_CAN_CONF_CURRENT_LIMITS_IN = 23U, ///< 设置输入电流限制, Data: Max Current Limit * 1000
-                                           ///< (int32), Min Current Limit * 1000 (int32)
-    VESC_CAN_CONF_STORE_CURRENT_LIMITS_IN = 24U, ///< 设置输入电流限制, Data: Max Current Limit *
-                                                 ///< 1000 (int32), Min Current Limit * 1000 (int32)
+    VESC_CAN_CONF_CURRENT_LIMITS_IN = 23U, ///< 设置输入电流限制, Data: Min Current Limit * 1000
+                                           ///< (int32), Max Current Limit * 1000 (int32)
+    VESC_CAN_CONF_STORE_CURRENT_LIMITS_IN = 24U, ///< 设置输入电流限制, Data: Min Current Limit *
+                                                 ///< 1000 (int32), Max Current Limit * 1000 (int32)
 } VESC_CAN_PocketConf_t;
 
 typedef enum
 {
-    VESC_CAN_FILL_RX_BUFFER       = 5U, ///< unknown
-    VESC_CAN_FILL_RX_BUFFER_LONG  = 6U, ///< unknown
-    VESC_CAN_PROCESS_RX_BUFFER    = 7U, ///< unknown
-    VESC_CAN_PROCESS_SHORT_BUFFER = 8U, ///< unknown
+    /**
+     * 长数据包（超过 6 字节）依次用 FILL_RX_BUFFER（偏移 0 ~ 255）和 FILL_RX_BUFFER_LONG 分片发送，
+     * 最后由 PROCESS_RX_BUFFER 给出长度和 CRC16 (XMODEM)；
+     * 不超过 6 字节的数据包用 PROCESS_SHORT_BUFFER 一帧发送。ExtId 的低 8 位是接收方的 id
+     */
+    VESC_CAN_FILL_RX_BUFFER       = 5U, ///< Data: offset (uint8), 至多 7 字节数据
+    VESC_CAN_FILL_RX_BUFFER_LONG  = 6U, ///< Data: offset (uint16), 至多 6 字节数据
+    VESC_CAN_PROCESS_RX_BUFFER    = 7U, ///< Data: 发送方 id, send, 长度 (uint16), CRC (uint16)
+    VESC_CAN_PROCESS_SHORT_BUFFER = 8U, ///< Data: 发送方 id, send, 至多 6 字节数据
 
     VESC_CAN_SET_CURRENT_HANDBRAKE     = 12U, ///< unknown
     VESC_CAN_SET_CURRENT_HANDBRAKE_REL = 13U, ///< unknown
@@ -170,6 +220,61 @@ typedef enum
     VESC_CAN_STATUS_5 = 27U,
 } VESC_CAN_PocketStatus_t;
 
+/**
+ * 通过缓冲区传输的数据包的指令字节，与 vesctool 的串口协议相同
+ */
+typedef enum
+{
+    VESC_COMM_GET_VALUES = 4U, ///< 读取运行数据，回复解析到 VESC_Values_t
+} VESC_CommPacket_t;
+
+/**
+ * COMM_GET_VALUES 的回复
+ */
+typedef struct
+{
+    float   mos_temperature;    ///< MOSFET 温度 (unit: °C)
+    float   motor_temperature;  ///< 电机温度 (unit: °C)
+    float   current_motor;      ///< 电机电流 (unit: A)
+    float   current_in;         ///< 输入电流 (unit: A)
+    float   id;                 ///< d 轴电流 (unit: A)
+    float   iq;                 ///< q 轴电流 (unit: A)
+    float   duty;               ///< 占空比
+    float   erpm;               ///< 电转速
+    float   vin;                ///< 输入电压 (unit: V)
+    float   amp_hours;          ///< AH
+    float   amp_hours_charged;  ///< 回充 AH
+    float   watt_hours;         ///< WH
+    float   watt_hours_charged; ///< 回充 WH
+    int32_t tachometer;         ///< 转过的换相数
+    int32_t tachometer_abs;     ///< 转过的换相数的绝对值之和
+    uint8_t fault_code;         ///< 故障码，0 为无故障
+    float   pid_pos;            ///< 位置 (unit: degree)
+
+    uint32_t count;     ///< 收到的回复数，每次解析完成后加一
+    uint32_t timestamp; ///< 最近一次回复结束帧的时间戳 (unit: us)，见 CAN_GetTimeUs
+} VESC_Values_t;
+
+/**
+ * 长数据包接收缓冲区
+ */
+typedef struct
+{
+    uint8_t  data[VESC_RX_BUFFER_SIZE];
+    uint16_t len; ///< 已收到数据的末尾
+} VESC_RxBuffer_t;
+
+/**
+ * 上次发送的电流限制（已编码）
+ */
+typedef struct
+{
+    bool    sent;   ///< 是否发送过
+    bool    stored; ///< 上次发送是否写入了 EEPROM
+    int32_t min;    ///< 电流下限 * 1000
+    int32_t max;    ///< 电流上限 * 1000
+} VESC_CurrentLimits_t;
+
 typedef struct
 {
     bool enable;    // 是否启用
@@ -178,13 +283,12 @@ typedef struct
     CAN_HandleTypeDef* hcan;
     uint8_t            id;         ///< 控制器 id，0xFF 代表广播
     uint8_t            electrodes; ///< 电极数
-    float              angle_zero; ///< 零点角度
 
     uint32_t feedback_count; ///< 反馈数
     struct
     {
-        float erpm;          ///< 电转速
-        float pos;           ///< 绝对角度 0~360
+        float erpm;          ///< 电转速，VESC_LAZY_DECODE 模式下读取时才更新
+        float pos;           ///< 绝对角度 0~360，VESC_LAZY_DECODE 模式下读取时才更新
         float duty;          ///< 占空比
         float current_motor; ///< 电机电流
         float current_in;    ///< 输入电流
@@ -200,11 +304,41 @@ typedef struct
         float vin; ///< 输入电压
         float tachometer_value;
 
-        int32_t round_cnt; ///< 圈数统计
+        MultiTurn_t multi_turn; ///< 多圈位置，单圈编码值为 pos * 50
+        uint32_t    timestamp;  ///< 最近一帧状态包的时间戳 (unit: us)，见 CAN_GetTimeUs
     } feedback;
 
+#ifdef VESC_LAZY_DECODE
+    struct
+    {
+        int32_t  erpm;        ///< 原始 ERPM
+        uint32_t seq;         ///< 接收中断写入时加一，奇数表示正在写入
+        uint32_t decoded_seq; ///< abs_angle / velocity 对应的 seq，奇数表示缓存无效
+    } raw;
+#endif
+
     float velocity;
     float abs_angle;
+
+    /**
+     * 上次发送的电流限制，[0] 为电机电流，[1] 为输入电流，见 VESC_SetCurrentLimits
+     */
+    VESC_CurrentLimits_t current_limits[2];
+
+    VESC_Values_t values; ///< VESC_RequestValues 的回复，在接收中断中更新
+
+#ifdef VESC_CMD_COALESCE
+    struct
+    {
+        bool                 valid;          ///< 指令槽中是否有指令
+        bool                 sent;           ///< 是否发送过指令
+        VESC_CAN_PocketSet_t pocket_id;      ///< 最新指令类型
+        int32_t              value;          ///< 最新指令值（已编码）
+        VESC_CAN_PocketSet_t sent_pocket_id; ///< 上次发送的指令类型
+        int32_t              sent_value;     ///< 上次发送的指令值（已编码）
+        uint32_t             sent_tick;      ///< 上次发送的时间 (unit: ms)
+    } cmd;
+#endif
 } VESC_t;
 
 typedef struct
@@ -219,17 +353,38 @@ typedef struct
 {
     CAN_HandleTypeDef* hcan;
     VESC_t*            motors[VESC_NUM];
+    VESC_RxBuffer_t    rx_buffer; ///< 发往 VESC_HOST_ID 的长数据包，同一时刻只能接收一个
 } VESC_FeedbackMap;
 
-#define __VESC_GET_ANGLE(__VESC_HANDLE__)    (((VESC_t*) (__VESC_HANDLE__))->abs_angle)
-#define __VESC_GET_VELOCITY(__VESC_HANDLE__) (((VESC_t*) (__VESC_HANDLE__))->velocity)
+#ifdef VESC_LAZY_DECODE
+#    define __VESC_GET_ANGLE(__VESC_HANDLE__)    (VESC_GetAngle((VESC_t*) (__VESC_HANDLE__)))
+#    define __VESC_GET_VELOCITY(__VESC_HANDLE__) (VESC_GetVelocity((VESC_t*) (__VESC_HANDLE__)))
+#else
+#    define __VESC_GET_ANGLE(__VESC_HANDLE__)    (((VESC_t*) (__VESC_HANDLE__))->abs_angle)
+#    define __VESC_GET_VELOCITY(__VESC_HANDLE__) (((VESC_t*) (__VESC_HANDLE__))->velocity)
+#endif
+#define __VESC_GET_TIMESTAMP(__VESC_HANDLE__) (((VESC_t*) (__VESC_HANDLE__))->feedback.timestamp)
+#define __VESC_GET_CURRENT(__VESC_HANDLE__)                                                        \
+    (((VESC_t*) (__VESC_HANDLE__))->feedback.current_motor)
 
 void              VESC_Init(VESC_t* hvesc, const VESC_Config_t* config);
 HAL_StatusTypeDef VESC_CAN_FilterInit(CAN_HandleTypeDef* hcan, uint32_t filter_bank);
 void              VESC_ResetAngle(VESC_t* hvesc);
+#ifdef VESC_LAZY_DECODE
+float VESC_GetAngle(VESC_t* hvesc);
+float VESC_GetVelocity(VESC_t* hvesc);
+#endif
 void              VESC_SendSetCmd(VESC_t* hvesc, VESC_CAN_PocketSet_t pocket_id, float value);
+void              VESC_RequestValues(const VESC_t* hvesc);
+void              VESC_SetCurrentLimits(VESC_t*               hvesc,
+                                        VESC_CAN_PocketConf_t pocket_id,
+                                        float                 min,
+                                        float                 max);
+#ifdef VESC_CMD_COALESCE
+void VESC_FlushCmd(const CAN_HandleTypeDef* hcan);
+#endif
 void              VESC_CAN_Fifo0ReceiveCallback(CAN_HandleTypeDef* hcan);
-void              VESC_CAN_BaseReceiveCallback(CAN_HandleTypeDef*         hcan,
+void              VESC_CAN_BaseReceiveCallback(const CAN_HandleTypeDef*   hcan,
                                                const CAN_RxHeaderTypeDef* header,
                                                const uint8_t              data[]);
 
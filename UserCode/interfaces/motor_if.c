@@ -37,6 +37,7 @@ extern "C"
  * 2. motor_send_internal_velocity, 对于无内部速度控制的电机可忽略
  * 3. motor_send_internal_position, 对于无内部位置控制的电机可忽略
  * 4. get_default_ctrl_mode: 最好和当前一样通过 宏 定义默认值
+ * 5. motor_send_internal_impedance, 对于无内部阻抗控制的电机可忽略
  ****************************************/
 
 /**
@@ -127,6 +128,38 @@ static inline void motor_send_internal_position(const MotorType_t motor_type,
     }
 }
 
+#ifdef MOTOR_IF_INTERNAL_MIT
+/**
+ * 发送电机内部阻抗控制指令
+ * @param motor_type 电机类型
+ * @param hmotor 电机对象
+ * @param position 位置 (unit: degree)
+ * @param velocity 速度 (unit: rpm)
+ * @param kp 刚度 (unit: N·m/rad)
+ * @param kd 阻尼 (unit: N·m·s/rad)
+ * @param torque 力矩前馈 (unit: N·m)
+ */
+static inline void motor_send_internal_impedance(const MotorType_t motor_type,
+                                                 void*             hmotor,
+                                                 const float       position,
+                                                 const float       velocity,
+                                                 const float       kp,
+                                                 const float       kd,
+                                                 const float       torque)
+{
+    switch (motor_type)
+    {
+#    ifdef USE_DM
+    case MOTOR_TYPE_DM:
+        DM_MIT_SendSetCmd(hmotor, position, velocity, kp, kd, torque);
+        break;
+#    endif
+    default:
+        break;
+    }
+}
+#endif
+
 static inline MotorCtrlMode_t get_default_ctrl_mode(const MotorType_t motor_type)
 {
     switch (motor_type)
@@ -170,6 +203,19 @@ static inline void motor_posctrl_mode_init(Motor_PosCtrl_t*             hctrl,
         break;
 #endif
 
+#ifdef MOTOR_IF_INTERNAL_MIT
+    case MOTOR_CTRL_INTERNAL_MIT:
+        // 使用电机内部阻抗控制，外部PID全部禁用
+        memset(&hctrl->velocity_pid, 0, sizeof(MotorPID_t));
+        memset(&hctrl->position_pid, 0, sizeof(MotorPID_t));
+        hctrl->pos_vel_freq_ratio = 1;
+        hctrl->impedance.kp       = config->impedance.kp;
+        hctrl->impedance.kd       = config->impedance.kd;
+        hctrl->impedance.velocity = 0;
+        hctrl->impedance.torque   = 0;
+        break;
+#endif
+
 #ifdef MOTOR_IF_INTERNAL_VEL
     case MOTOR_CTRL_INTERNAL_VEL:
         // 使用电调内部速度环，仅位置环有效
@@ -199,7 +245,7 @@ void Motor_PosCtrl_Init(Motor_PosCtrl_t* hctrl, const Motor_PosCtrlConfig_t* con
     hctrl->motor_type = config->motor_type;
     hctrl->motor      = config->motor;
 #ifdef USE_CUSTOM_CTRL_MODE
-    hctrl->ctrl_mode = config.ctrl_mode;
+    hctrl->ctrl_mode = config->ctrl_mode;
 #else
     hctrl->ctrl_mode = get_default_ctrl_mode(config->motor_type);
 #endif
@@ -230,6 +276,13 @@ static inline void motor_velctrl_mode_init(Motor_VelCtrl_t*             hctrl,
         // 使用电调内部速度环
         memset(&hctrl->pid, 0, sizeof(MotorPID_t));
         break;
+#endif
+#ifdef MOTOR_IF_INTERNAL_MIT
+    case MOTOR_CTRL_INTERNAL_MIT:
+        // 使用电机内部阻抗控制，刚度为 0 即为纯阻尼速度控制
+        memset(&hctrl->pid, 0, sizeof(MotorPID_t));
+        hctrl->impedance_kd = config->impedance.kd;
+        break;
 #endif
     default:
         // 完全外部PID控制
@@ -249,7 +302,7 @@ void Motor_VelCtrl_Init(Motor_VelCtrl_t* hctrl, const Motor_VelCtrlConfig_t* con
     hctrl->motor_type = config->motor_type;
     hctrl->motor      = config->motor;
 #ifdef USE_CUSTOM_CTRL_MODE
-    hctrl->ctrl_mode = config.ctrl_mode;
+    hctrl->ctrl_mode = config->ctrl_mode;
 #else
     hctrl->ctrl_mode = get_default_ctrl_mode(config->motor_type);
 #endif
@@ -286,6 +339,23 @@ void Motor_PosCtrlUpdate(Motor_PosCtrl_t* hctrl)
     }
 #endif
 
+#ifdef MOTOR_IF_INTERNAL_MIT
+    if (hctrl->ctrl_mode == MOTOR_CTRL_INTERNAL_MIT)
+    {
+        // 每周期一帧，位置环和速度环都由电机完成
+        motor_send_internal_impedance(hctrl->motor_type,
+                                      hctrl->motor,
+                                      hctrl->position,
+                                      hctrl->impedance.velocity,
+                                      hctrl->impedance.kp,
+                                      hctrl->impedance.kd,
+                                      hctrl->impedance.torque);
+        hctrl->position_pid.ref = hctrl->position; // 用于就位判断
+        hctrl->count            = 0;
+        return;
+    }
+#endif
+
     if (hctrl->count == hctrl->pos_vel_freq_ratio)
     {
         hctrl->position_pid.ref = hctrl->position;
@@ -327,6 +397,20 @@ void Motor_VelCtrlUpdate(Motor_VelCtrl_t* hctrl)
     }
 #endif
 
+#ifdef MOTOR_IF_INTERNAL_MIT
+    if (hctrl->ctrl_mode == MOTOR_CTRL_INTERNAL_MIT)
+    {
+        motor_send_internal_impedance(hctrl->motor_type,
+                                      hctrl->motor,
+                                      0.0f,
+                                      hctrl->velocity,
+                                      0.0f,
+                                      hctrl->impedance_kd,
+                                      0.0f);
+        return;
+    }
+#endif
+
     hctrl->pid.ref = hctrl->velocity;
     hctrl->pid.fdb = Motor_GetVelocity(hctrl->motor_type, hctrl->motor);
     MotorPID_Calculate(&hctrl->pid);
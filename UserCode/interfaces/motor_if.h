@@ -47,10 +47,14 @@
  *      #define MOTOR_IF_INTERNAL_VEL_POS
  *    如果有增加使用 `内部速度控制` + `外部位置控制的电机`，在引入头文件时添加此项
  *      #define MOTOR_IF_INTERNAL_VEL_POS
+ *    如果有增加支持 `内部阻抗控制`（MIT 模式）的电机，在引入头文件时添加此项
+ *      #define MOTOR_IF_INTERNAL_MIT
  * 3. 在 MotorType_t 里增加条件编译的电机类型
  * 4. 通过宏定义新增 电机控制模式 默认值
  * 5. 实现 Motor_GetAngle
  * 6. 实现 Motor_GetVelocity
+ * 7. 实现 Motor_GetFeedbackAge
+ * 8. 有电流反馈的电机实现 Motor_GetCurrent / Motor_GetTorque
  ****************************************/
 
 // #define USE_DJI
@@ -74,6 +78,11 @@
 #ifdef USE_DM
 #    include "drivers/DM.h"
 #    define MOTOR_IF_INTERNAL_VEL_POS
+#    define MOTOR_IF_INTERNAL_MIT
+#endif
+
+#if defined(USE_DJI) || defined(USE_VESC) || defined(USE_DM)
+#    include "bsp/can_driver.h"
 #endif
 
 #ifdef __cplusplus
@@ -108,8 +117,24 @@ typedef enum
 #ifdef MOTOR_IF_INTERNAL_VEL_POS
     MOTOR_CTRL_INTERNAL_VEL_POS, ///< 内部位置环和速度环控制
 #endif
+#ifdef MOTOR_IF_INTERNAL_MIT
+    MOTOR_CTRL_INTERNAL_MIT, ///< 内部阻抗控制，位置、速度、刚度、阻尼、力矩合为一帧
+#endif
 } MotorCtrlMode_t;
 
+#ifdef MOTOR_IF_INTERNAL_MIT
+/**
+ * 阻抗控制 (MOTOR_CTRL_INTERNAL_MIT) 参数
+ *
+ * 电机输出力矩 = kp * (位置 - 当前位置) + kd * (速度 - 当前速度) + 力矩前馈
+ */
+typedef struct
+{
+    float kp; ///< 刚度 (unit: N·m/rad)，速度环控制时不使用
+    float kd; ///< 阻尼 (unit: N·m·s/rad)
+} MotorImpedance_Config_t;
+#endif
+
 // 电机控制模式的默认值
 #if defined(USE_DJI) && !defined(MOTOR_DEFAULT_MODE_DJI)
 #    define MOTOR_DEFAULT_MODE_DJI MOTOR_CTRL_EXTERNAL_PID
@@ -151,6 +176,15 @@ typedef struct
         uint32_t counter;         ///< 就位计数
     } settle;                     ///< 就位判断
 
+#ifdef MOTOR_IF_INTERNAL_MIT
+    struct
+    {
+        float kp;       ///< 刚度 (unit: N·m/rad)
+        float kd;       ///< 阻尼 (unit: N·m·s/rad)
+        float velocity; ///< 速度前馈 (unit: rpm)
+        float torque;   ///< 力矩前馈 (unit: N·m)
+    } impedance; ///< 阻抗控制参数
+#endif
 } Motor_PosCtrl_t;
 
 /**
@@ -169,6 +203,9 @@ typedef struct
 
     float    error_threshold;  ///< 允许的误差范围
     uint32_t settle_count_max; ///< 在误差内多少周期认为就位
+#ifdef MOTOR_IF_INTERNAL_MIT
+    MotorImpedance_Config_t impedance; ///< 阻抗控制参数，仅 MOTOR_CTRL_INTERNAL_MIT 模式使用
+#endif
 } Motor_PosCtrlConfig_t;
 
 /**
@@ -182,6 +219,9 @@ typedef struct
     void*           motor;      //< 受控电机
     MotorPID_t      pid;        //< 速度环
     float           velocity;   //< 当前控制的速度
+#ifdef MOTOR_IF_INTERNAL_MIT
+    float impedance_kd; ///< 阻抗控制的阻尼 (unit: N·m·s/rad)
+#endif
 } Motor_VelCtrl_t;
 
 /**
@@ -195,6 +235,9 @@ typedef struct
 #endif
     void*             motor; //< 受控电机
     MotorPID_Config_t pid;
+#ifdef MOTOR_IF_INTERNAL_MIT
+    MotorImpedance_Config_t impedance; ///< 阻抗控制参数，仅 MOTOR_CTRL_INTERNAL_MIT 模式使用
+#endif
 } Motor_VelCtrlConfig_t;
 
 void Motor_PosCtrl_Init(Motor_PosCtrl_t* hctrl, const Motor_PosCtrlConfig_t* config);
@@ -251,6 +294,22 @@ static inline void Motor_PosCtrl_SetRef(Motor_PosCtrl_t* hctrl, const float ref)
 #endif
 }
 
+#ifdef MOTOR_IF_INTERNAL_MIT
+/**
+ * 设置阻抗控制的前馈量，仅 MOTOR_CTRL_INTERNAL_MIT 模式有效
+ * @param hctrl 受控对象
+ * @param velocity 速度前馈 (unit: rpm)
+ * @param torque 力矩前馈 (unit: N·m)
+ */
+static inline void Motor_PosCtrl_SetFeedforward(Motor_PosCtrl_t* hctrl,
+                                                const float      velocity,
+                                                const float      torque)
+{
+    hctrl->impedance.velocity = velocity;
+    hctrl->impedance.torque   = torque;
+}
+#endif
+
 /**
  * 设置速度环目标值
  * @param hctrl 受控对象
@@ -331,7 +390,7 @@ static inline void Motor_ResetAngle(const MotorType_t motor_type, void* hmotor)
 #endif
 #ifdef USE_DM
     case MOTOR_TYPE_DM:
-
+        DM_ResetAngle(hmotor);
         break;
 #endif
     default:;
@@ -374,6 +433,90 @@ static inline float Motor_GetVelocity(const MotorType_t motor_type, void* hmotor
 #define MotorCtrl_GetVelocity(__ctrl__)                                                            \
     (Motor_GetVelocity((__ctrl__)->motor_type, (__ctrl__)->motor))
 
+/**
+ * 获取反馈数据的时效，即最近一帧反馈的接收时间到当前的间隔
+ * @note 在控制周期内调用，可用于补偿反馈延迟或判断反馈是否过期；
+ *       尚未收到反馈时返回值没有意义。TB6612 等在控制时刻采样的电机返回 0
+ * @param motor_type 电机类型
+ * @param hmotor 电机数据
+ * @return 反馈时效 (unit: us)
+ */
+static inline uint32_t Motor_GetFeedbackAge(const MotorType_t motor_type, void* hmotor)
+{
+    switch (motor_type)
+    {
+#ifdef USE_DJI
+    case MOTOR_TYPE_DJI:
+        return CAN_GetTimeUs() - __DJI_GET_TIMESTAMP(hmotor);
+#endif
+#ifdef USE_VESC
+    case MOTOR_TYPE_VESC:
+        return CAN_GetTimeUs() - __VESC_GET_TIMESTAMP(hmotor);
+#endif
+#ifdef USE_DM
+    case MOTOR_TYPE_DM:
+        return CAN_GetTimeUs() - __DM_GET_TIMESTAMP(hmotor);
+#endif
+    default:
+        return 0;
+    }
+}
+
+#define MotorCtrl_GetFeedbackAge(__ctrl__)                                                         \
+    (Motor_GetFeedbackAge((__ctrl__)->motor_type, (__ctrl__)->motor))
+
+/**
+ * 获取电机转矩电流，可用于堵转检测
+ * @note 没有电流反馈的电机返回 0
+ * @param motor_type 电机类型
+ * @param hmotor 电机数据
+ * @return 电流 (unit: A)
+ */
+static inline float Motor_GetCurrent(const MotorType_t motor_type, void* hmotor)
+{
+    switch (motor_type)
+    {
+#ifdef USE_DJI
+    case MOTOR_TYPE_DJI:
+        return __DJI_GET_CURRENT(hmotor);
+#endif
+#ifdef USE_VESC
+    case MOTOR_TYPE_VESC:
+        return __VESC_GET_CURRENT(hmotor);
+#endif
+    default:
+        return 0.0f;
+    }
+}
+
+#define MotorCtrl_GetCurrent(__ctrl__) (Motor_GetCurrent((__ctrl__)->motor_type, (__ctrl__)->motor))
+
+/**
+ * 获取电机轴输出力矩，可用于力矩前馈
+ * @note 达妙电机直接取力矩反馈，其他电机由电流和转矩常数估算；不知道转矩常数的电机返回 0
+ * @param motor_type 电机类型
+ * @param hmotor 电机数据
+ * @return 力矩 (unit: N·m)
+ */
+static inline float Motor_GetTorque(const MotorType_t motor_type, void* hmotor)
+{
+    switch (motor_type)
+    {
+#ifdef USE_DJI
+    case MOTOR_TYPE_DJI:
+        return __DJI_GET_TORQUE(hmotor);
+#endif
+#ifdef USE_DM
+    case MOTOR_TYPE_DM:
+        return __DM_GET_TORQUE(hmotor);
+#endif
+    default:
+        return 0.0f;
+    }
+}
+
+#define MotorCtrl_GetTorque(__ctrl__) (Motor_GetTorque((__ctrl__)->motor_type, (__ctrl__)->motor))
+
 #ifdef __cplusplus
 }
 #endif
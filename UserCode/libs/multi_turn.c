@@ -0,0 +1,111 @@
+/**
+ * @file    multi_turn.c
+ * @author  syhanjin
+ * @date    2025-10-17
+ *
+ * --------------------------------------------------------------------------
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Project repository: https://github.com/HITSZ-WTR2026/motor_drivers
+ */
+#include "multi_turn.h"
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * 初始化
+ * @param mt multi-turn handle
+ * @param range 单圈编码值数，编码值在 [0, range) 内回绕
+ * @param zero_raw 初始零点的单圈编码值
+ */
+void MultiTurn_Init(MultiTurn_t* mt, const uint32_t range, const uint32_t zero_raw)
+{
+    memset(mt, 0, sizeof(MultiTurn_t));
+    mt->range    = range;
+    mt->zero_raw = zero_raw;
+}
+
+/**
+ * 根据新的单圈编码值更新圈数
+ *
+ * 在 delta + k * range 中选出与速度外推值最接近的一个作为本帧转过的编码值，
+ * velocity 为 0 时即为最短路径
+ * @param mt multi-turn handle
+ * @param raw 单圈编码值 [0, range)
+ * @param velocity 当前速度 (unit: 编码值/s)，未知时传 0
+ * @param timestamp 编码值的时间戳 (unit: us)
+ */
+void MultiTurn_Update(MultiTurn_t*   mt,
+                      const uint32_t raw,
+                      const int32_t  velocity,
+                      const uint32_t timestamp)
+{
+    const uint32_t dt = timestamp - mt->timestamp;
+    mt->timestamp     = timestamp;
+    if (!mt->valid)
+    {
+        mt->raw   = raw;
+        mt->valid = true;
+        return;
+    }
+
+    // 预计转过的编码值，乘以 2147 / 2^31 近似除以 10^6，限幅后可以只用 32 位运算
+    int32_t expected = 0;
+    if (velocity != 0 && dt <= MULTI_TURN_EXTRAPOLATE_MAX_US)
+    {
+        const int64_t e = (int64_t) velocity * dt * 2147 >> 31;
+        expected        = e > INT32_MAX / 2    ? INT32_MAX / 2
+                          : e < -INT32_MAX / 2 ? -INT32_MAX / 2
+                                               : (int32_t) e;
+    }
+
+    const int32_t range = (int32_t) mt->range;
+    const int32_t half  = range / 2;
+    const int32_t delta = (int32_t) raw - (int32_t) mt->raw;
+    const int32_t diff  = expected - delta;
+    if (diff > half)
+        mt->turns += (diff + half) / range;
+    else if (diff < -half)
+        mt->turns += (diff - half) / range;
+    mt->raw = raw;
+}
+
+/**
+ * 以当前位置为零点
+ * @param mt multi-turn handle
+ */
+void MultiTurn_ResetZero(MultiTurn_t* mt)
+{
+    mt->zero_turns = mt->turns;
+    mt->zero_raw   = mt->raw;
+}
+
+/**
+ * 获取相对零点的多圈编码值
+ * @param mt multi-turn handle
+ * @return 编码值
+ */
+int64_t MultiTurn_GetCount(const MultiTurn_t* mt)
+{
+    return (int64_t) (mt->turns - mt->zero_turns) * mt->range + (int64_t) mt->raw -
+           (int64_t) mt->zero_raw;
+}
+
+#ifdef __cplusplus
+}
+#endif
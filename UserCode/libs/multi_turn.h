@@ -0,0 +1,77 @@
+/**
+ * @file    multi_turn.h
+ * @author  syhanjin
+ * @date    2025-10-17
+ * @brief   integer multi-turn position accumulator for single-turn encoders
+ *
+ * 把单圈编码值累加为多圈位置。圈数和单圈编码值都以整数保存，行程再长精度也不会下降。
+ * 相邻两帧之间转过不到半圈时按最短路径判断跨圈；丢帧时由调用者提供的速度外推本次转过的编码值，
+ * 从而选出正确的圈数。
+ *
+ * --------------------------------------------------------------------------
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Project repository: https://github.com/HITSZ-WTR2026/motor_drivers
+ */
+#ifndef MULTI_TURN_H
+#define MULTI_TURN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * 速度外推的最长间隔 (unit: us)，两帧间隔更长时退化为最短路径判断
+ */
+#define MULTI_TURN_EXTRAPOLATE_MAX_US (1000000U)
+
+typedef struct
+{
+    uint32_t range;      ///< 单圈编码值数，编码值在 [0, range) 内回绕
+    uint32_t raw;        ///< 最新的单圈编码值
+    int32_t  turns;      ///< 圈数
+    uint32_t zero_raw;   ///< 零点的单圈编码值
+    int32_t  zero_turns; ///< 零点的圈数
+    uint32_t timestamp;  ///< 最新编码值的时间戳 (unit: us)
+    bool     valid;      ///< 是否已收到编码值
+} MultiTurn_t;
+
+void    MultiTurn_Init(MultiTurn_t* mt, uint32_t range, uint32_t zero_raw);
+void    MultiTurn_Update(MultiTurn_t* mt, uint32_t raw, int32_t velocity, uint32_t timestamp);
+void    MultiTurn_ResetZero(MultiTurn_t* mt);
+int64_t MultiTurn_GetCount(const MultiTurn_t* mt);
+
+/**
+ * 把相对零点的位置换算为物理量
+ *
+ * 圈数和单圈部分分别转换后再相加，只需两次 32 位整数转浮点，不涉及 64 位运算
+ * @param mt multi-turn handle
+ * @param scale 每个编码值对应的物理量（如 360.0f / 8192 degree）
+ * @return 相对零点的位置
+ */
+static inline float MultiTurn_ToFloat(const MultiTurn_t* mt, const float scale)
+{
+    return (float) (mt->turns - mt->zero_turns) * ((float) mt->range * scale) +
+           (float) ((int32_t) mt->raw - (int32_t) mt->zero_raw) * scale;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MULTI_TURN_H
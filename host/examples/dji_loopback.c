@@ -0,0 +1,108 @@
+/**
+ * @file    dji_loopback.c
+ * @author  syhanjin
+ * @date    2025-10-17
+ * @brief   run the DJI driver and a velocity loop against a simulated C620 on the virtual bus
+ *
+ * --------------------------------------------------------------------------
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Project repository: https://github.com/HITSZ-WTR2026/motor_drivers
+ */
+#include <stdio.h>
+
+#include "bsp/can_driver.h"
+#include "drivers/DJI.h"
+#include "interfaces/motor_if.h"
+#include "virtual_can.h"
+
+CAN_HandleTypeDef hcan1;
+
+DJI_t           dji;
+Motor_VelCtrl_t vel_dji;
+
+/**
+ * 模拟的 C620 电调 + M3508 电机：转速按一阶惯性跟随电流
+ */
+static struct
+{
+    float rpm;   ///< 转子转速
+    float angle; ///< 转子角度 (unit: degree)
+} sim;
+
+static void sim_on_tx(const uint32_t bus, const VCAN_Frame_t* frame, void* user)
+{
+    (void) user;
+    if (frame->id != 0x200)
+        return;
+    const int16_t iq = (int16_t) (frame->data[0] << 8 | frame->data[1]);
+    // 1 ms 一步：目标转速与电流成正比，时间常数 20 ms
+    sim.rpm += ((float) iq * 0.5f - sim.rpm) * 0.05f;
+    sim.angle += sim.rpm * 6.0f * 0.001f;
+    while (sim.angle >= 360.0f)
+        sim.angle -= 360.0f;
+    while (sim.angle < 0.0f)
+        sim.angle += 360.0f;
+
+    const uint16_t ecd      = (uint16_t) (sim.angle / 360.0f * 8192.0f);
+    const int16_t  rpm      = (int16_t) sim.rpm;
+    VCAN_Frame_t   feedback = {
+          .id   = 0x201,
+          .ide  = CAN_ID_STD,
+          .rtr  = CAN_RTR_DATA,
+          .dlc  = 8,
+          .data = { ecd >> 8, ecd & 0xFF, (uint16_t) rpm >> 8, (uint16_t) rpm & 0xFF },
+    };
+    VCAN_Inject(bus, &feedback);
+}
+
+int main(void)
+{
+    VCAN_SetManualClock(true);
+    VCAN_Attach(&hcan1, CAN1, 0);
+    VCAN_SetTxHook(0, sim_on_tx, NULL);
+
+    DJI_Init(&dji, &(DJI_Config_t) {
+                           .hcan       = &hcan1,
+                           .motor_type = M3508_C620,
+                           .id1        = 1,
+                   });
+    CAN_FilterApply(&hcan1, false);
+    HAL_CAN_RegisterCallback(&hcan1, HAL_CAN_RX_FIFO0_MSG_PENDING_CB_ID, CAN_Fifo0ReceiveCallback);
+    CAN_Start(&hcan1, CAN_IT_RX_FIFO0_MSG_PENDING);
+
+    Motor_VelCtrl_Init(&vel_dji, &(Motor_VelCtrlConfig_t) {
+                                         .motor_type = MOTOR_TYPE_DJI,
+                                         .motor      = &dji,
+                                         .pid        = { .Kp             = 4.7f,
+                                                         .Ki             = 0.15f,
+                                                         .Kd             = 0.0f,
+                                                         .abs_output_max = 8000.0f },
+                                 });
+    __MOTOR_CTRL_ENABLE(&vel_dji);
+    Motor_VelCtrl_SetRef(&vel_dji, 60.0f);
+
+    for (uint32_t tick = 0; tick < 1000; tick++)
+    {
+        Motor_VelCtrlUpdate(&vel_dji);
+        DJI_SendSetIqCommand(&hcan1, IQ_CMD_GROUP_1_4);
+        VCAN_Poll();
+        VCAN_AdvanceTime(1000);
+
+        if (tick % 100 == 99)
+            printf("t = %4u ms, velocity = %8.3f rpm, feedback = %u\n", tick + 1,
+                   Motor_GetVelocity(MOTOR_TYPE_DJI, &dji), dji.feedback_count);
+    }
+    return 0;
+}
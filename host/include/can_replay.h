@@ -0,0 +1,62 @@
+/**
+ * @file    can_replay.h
+ * @author  syhanjin
+ * @date    2025-10-17
+ * @brief   replay CAN_CAPTURE recordings into the drivers on a PC
+ *
+ * 读取单片机通过 CAN_CaptureFlush 导出的录制文件，按原速或加速把接收帧重新交给驱动：
+ *  - callback 为 NULL 时，帧被注入到虚拟总线（编号与录制的总线编号相同），
+ *    依次经过过滤器、FilterMatchIndex 和 can_driver 的分发，与单片机上的路径一致
+ *  - callback 不为 NULL 时，直接调用该回调（如 DJI_CAN_BaseReceiveCallback），用于测量解包性能
+ *
+ * --------------------------------------------------------------------------
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Project repository: https://github.com/HITSZ-WTR2026/motor_drivers
+ */
+#ifndef CAN_REPLAY_H
+#define CAN_REPLAY_H
+
+#include <stddef.h>
+#include "bsp/can_driver.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define CAN_REPLAY_BUS_NUM (3)
+
+typedef struct
+{
+    CAN_FifoReceiveCallback_t callback; ///< NULL 表示注入虚拟总线
+    /**
+     * 直接调用回调时传入的句柄，按录制的总线编号索引，可以为 NULL
+     */
+    const CAN_HandleTypeDef* hcan[CAN_REPLAY_BUS_NUM];
+    float                    speed;      ///< 回放倍速，1 为原速，0 表示不等待
+    bool                     include_tx; ///< 是否同时回放本机发出的帧（默认跳过）
+} CAN_ReplayConfig_t;
+
+size_t CAN_ReplayLoad(const char* path, CAN_CaptureRecord_t** records);
+size_t CAN_ReplayParse(const uint8_t* data, size_t size, CAN_CaptureRecord_t* records);
+size_t CAN_Replay(const CAN_ReplayConfig_t*  config,
+                  const CAN_CaptureRecord_t* records,
+                  size_t                     count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAN_REPLAY_H
@@ -0,0 +1,114 @@
+/**
+ * @file    cmsis_compiler.h
+ * @author  syhanjin
+ * @date    2025-10-17
+ * @brief   host-side replacement of the CMSIS core intrinsics
+ *
+ * 中断屏蔽状态 (PRIMASK / BASEPRI) 保存在全局变量中，虚拟 CAN 总线在屏蔽期间不会执行中断回调；
+ * __get_IPSR 在虚拟中断回调执行期间返回非 0。
+ *
+ * --------------------------------------------------------------------------
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Project repository: https://github.com/HITSZ-WTR2026/motor_drivers
+ */
+#ifndef CMSIS_COMPILER_H
+#define CMSIS_COMPILER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define __STATIC_INLINE      static inline
+#define __STATIC_FORCEINLINE static inline __attribute__((always_inline))
+#define __WEAK               __attribute__((weak))
+#define __PACKED             __attribute__((packed))
+
+extern volatile uint32_t host_primask;
+extern volatile uint32_t host_basepri;
+extern volatile uint32_t host_ipsr;
+
+__STATIC_FORCEINLINE uint32_t __get_IPSR(void)
+{
+    return host_ipsr;
+}
+
+__STATIC_FORCEINLINE uint32_t __get_PRIMASK(void)
+{
+    return host_primask;
+}
+
+__STATIC_FORCEINLINE void __set_PRIMASK(const uint32_t primask)
+{
+    host_primask = primask;
+}
+
+__STATIC_FORCEINLINE uint32_t __get_BASEPRI(void)
+{
+    return host_basepri;
+}
+
+__STATIC_FORCEINLINE void __set_BASEPRI(const uint32_t basepri)
+{
+    host_basepri = basepri & 0xFFU;
+}
+
+/**
+ * 只在新值屏蔽更多中断时写入，与 Cortex-M 的 BASEPRI_MAX 一致
+ */
+__STATIC_FORCEINLINE void __set_BASEPRI_MAX(const uint32_t basepri)
+{
+    const uint32_t value = basepri & 0xFFU;
+    if (value != 0U && (host_basepri == 0U || value < host_basepri))
+        host_basepri = value;
+}
+
+__STATIC_FORCEINLINE void __disable_irq(void)
+{
+    host_primask = 1U;
+}
+
+__STATIC_FORCEINLINE void __enable_irq(void)
+{
+    host_primask = 0U;
+}
+
+__STATIC_FORCEINLINE uint8_t __CLZ(const uint32_t value)
+{
+    return value == 0U ? 32U : (uint8_t) __builtin_clz(value);
+}
+
+__STATIC_FORCEINLINE void __DMB(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+__STATIC_FORCEINLINE void __DSB(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+__STATIC_FORCEINLINE void __ISB(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CMSIS_COMPILER_H
@@ -0,0 +1,359 @@
+/**
+ * @file    main.h
+ * @author  syhanjin
+ * @date    2025-10-17
+ * @brief   host-side replacement of the STM32CubeMX main.h
+ *
+ * 在 PC 上编译 UserCode 时代替 Core/Inc/main.h，只提供驱动用到的 STM32 HAL CAN 子集。
+ * 类型、宏和寄存器布局与 STM32F4 HAL 保持一致，函数由 src/virtual_can.c 基于虚拟 CAN 总线实现。
+ *
+ * --------------------------------------------------------------------------
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Project repository: https://github.com/HITSZ-WTR2026/motor_drivers
+ */
+#ifndef MAIN_H
+#define MAIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define HAL_CAN_MODULE_ENABLED
+#define USE_HAL_CAN_REGISTER_CALLBACKS 1U
+
+typedef enum
+{
+    HAL_OK      = 0x00U,
+    HAL_ERROR   = 0x01U,
+    HAL_BUSY    = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+    DISABLE = 0U,
+    ENABLE  = !DISABLE
+} FunctionalState;
+
+/* ------------------------------- registers ------------------------------- */
+
+typedef struct
+{
+    volatile uint32_t TIR;
+    volatile uint32_t TDTR;
+    volatile uint32_t TDLR;
+    volatile uint32_t TDHR;
+} CAN_TxMailBox_TypeDef;
+
+typedef struct
+{
+    volatile uint32_t RIR;
+    volatile uint32_t RDTR;
+    volatile uint32_t RDLR;
+    volatile uint32_t RDHR;
+} CAN_FIFOMailBox_TypeDef;
+
+typedef struct
+{
+    volatile uint32_t FR1;
+    volatile uint32_t FR2;
+} CAN_FilterRegister_TypeDef;
+
+typedef struct
+{
+    volatile uint32_t          MCR;
+    volatile uint32_t          MSR;
+    volatile uint32_t          TSR;
+    volatile uint32_t          RF0R;
+    volatile uint32_t          RF1R;
+    volatile uint32_t          IER;
+    volatile uint32_t          ESR;
+    volatile uint32_t          BTR;
+    uint32_t                   RESERVED0[88];
+    CAN_TxMailBox_TypeDef      sTxMailBox[3];
+    CAN_FIFOMailBox_TypeDef    sFIFOMailBox[2];
+    uint32_t                   RESERVED1[12];
+    volatile uint32_t          FMR;
+    volatile uint32_t          FM1R;
+    uint32_t                   RESERVED2;
+    volatile uint32_t          FS1R;
+    uint32_t                   RESERVED3;
+    volatile uint32_t          FFA1R;
+    uint32_t                   RESERVED4;
+    volatile uint32_t          FA1R;
+    uint32_t                   RESERVED5[8];
+    CAN_FilterRegister_TypeDef sFilterRegister[28];
+} CAN_TypeDef;
+
+extern CAN_TypeDef host_can1_regs;
+extern CAN_TypeDef host_can2_regs;
+
+#define CAN1 (&host_can1_regs)
+#define CAN2 (&host_can2_regs)
+
+#define CAN_FMR_CAN2SB_Pos (8U)
+#define CAN_FMR_CAN2SB     (0x3FUL << CAN_FMR_CAN2SB_Pos)
+
+#define CAN_BTR_BRP_Pos (0U)
+#define CAN_BTR_BRP     (0x3FFUL << CAN_BTR_BRP_Pos)
+#define CAN_BTR_TS1_Pos (16U)
+#define CAN_BTR_TS1     (0xFUL << CAN_BTR_TS1_Pos)
+#define CAN_BTR_TS2_Pos (20U)
+#define CAN_BTR_TS2     (0x7UL << CAN_BTR_TS2_Pos)
+
+#define CAN_RF0R_FMP0  (0x3UL << 0U)
+#define CAN_RF0R_FULL0 (0x1UL << 3U)
+#define CAN_RF0R_FOVR0 (0x1UL << 4U)
+#define CAN_RF0R_RFOM0 (0x1UL << 5U)
+
+/* --------------------------------- HAL CAN -------------------------------- */
+
+typedef struct
+{
+    uint32_t        Prescaler;
+    uint32_t        Mode;
+    uint32_t        SyncJumpWidth;
+    uint32_t        TimeSeg1;
+    uint32_t        TimeSeg2;
+    FunctionalState TimeTriggeredMode;
+    FunctionalState AutoBusOff;
+    FunctionalState AutoWakeUp;
+    FunctionalState AutoRetransmission;
+    FunctionalState ReceiveFifoLocked;
+    FunctionalState TransmitFifoPriority;
+} CAN_InitTypeDef;
+
+typedef enum
+{
+    HAL_CAN_STATE_RESET         = 0x00U,
+    HAL_CAN_STATE_READY         = 0x01U,
+    HAL_CAN_STATE_LISTENING     = 0x02U,
+    HAL_CAN_STATE_SLEEP_PENDING = 0x03U,
+    HAL_CAN_STATE_SLEEP_ACTIVE  = 0x04U,
+    HAL_CAN_STATE_ERROR         = 0x05U
+} HAL_CAN_StateTypeDef;
+
+typedef struct
+{
+    uint32_t        StdId;
+    uint32_t        ExtId;
+    uint32_t        IDE;
+    uint32_t        RTR;
+    uint32_t        DLC;
+    FunctionalState TransmitGlobalTime;
+} CAN_TxHeaderTypeDef;
+
+typedef struct
+{
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    uint32_t Timestamp;
+    uint32_t FilterMatchIndex;
+} CAN_RxHeaderTypeDef;
+
+typedef struct
+{
+    uint32_t FilterIdHigh;
+    uint32_t FilterIdLow;
+    uint32_t FilterMaskIdHigh;
+    uint32_t FilterMaskIdLow;
+    uint32_t FilterFIFOAssignment;
+    uint32_t FilterBank;
+    uint32_t FilterMode;
+    uint32_t FilterScale;
+    uint32_t FilterActivation;
+    uint32_t SlaveStartFilterBank;
+} CAN_FilterTypeDef;
+
+typedef struct __CAN_HandleTypeDef
+{
+    CAN_TypeDef*                  Instance;
+    CAN_InitTypeDef               Init;
+    volatile HAL_CAN_StateTypeDef State;
+    volatile uint32_t             ErrorCode;
+
+    void (*TxMailbox0CompleteCallback)(struct __CAN_HandleTypeDef* hcan);
+    void (*TxMailbox1CompleteCallback)(struct __CAN_HandleTypeDef* hcan);
+    void (*TxMailbox2CompleteCallback)(struct __CAN_HandleTypeDef* hcan);
+    void (*TxMailbox0AbortCallback)(struct __CAN_HandleTypeDef* hcan);
+    void (*TxMailbox1AbortCallback)(struct __CAN_HandleTypeDef* hcan);
+    void (*TxMailbox2AbortCallback)(struct __CAN_HandleTypeDef* hcan);
+    void (*RxFifo0MsgPendingCallback)(struct __CAN_HandleTypeDef* hcan);
+    void (*RxFifo0FullCallback)(struct __CAN_HandleTypeDef* hcan);
+    void (*RxFifo1MsgPendingCallback)(struct __CAN_HandleTypeDef* hcan);
+    void (*RxFifo1FullCallback)(struct __CAN_HandleTypeDef* hcan);
+    void (*ErrorCallback)(struct __CAN_HandleTypeDef* hcan);
+} CAN_HandleTypeDef;
+
+typedef enum
+{
+    HAL_CAN_TX_MAILBOX0_COMPLETE_CB_ID = 0x00U,
+    HAL_CAN_TX_MAILBOX1_COMPLETE_CB_ID = 0x01U,
+    HAL_CAN_TX_MAILBOX2_COMPLETE_CB_ID = 0x02U,
+    HAL_CAN_TX_MAILBOX0_ABORT_CB_ID    = 0x03U,
+    HAL_CAN_TX_MAILBOX1_ABORT_CB_ID    = 0x04U,
+    HAL_CAN_TX_MAILBOX2_ABORT_CB_ID    = 0x05U,
+    HAL_CAN_RX_FIFO0_MSG_PENDING_CB_ID = 0x06U,
+    HAL_CAN_RX_FIFO0_FULL_CB_ID        = 0x07U,
+    HAL_CAN_RX_FIFO1_MSG_PENDING_CB_ID = 0x08U,
+    HAL_CAN_RX_FIFO1_FULL_CB_ID        = 0x09U,
+    HAL_CAN_ERROR_CB_ID                = 0x0CU,
+} HAL_CAN_CallbackIDTypeDef;
+
+typedef void (*pCAN_CallbackTypeDef)(CAN_HandleTypeDef* hcan);
+
+#define CAN_ID_STD     (0x00000000U)
+#define CAN_ID_EXT     (0x00000004U)
+#define CAN_RTR_DATA   (0x00000000U)
+#define CAN_RTR_REMOTE (0x00000002U)
+
+#define CAN_RX_FIFO0 (0x00000000U)
+#define CAN_RX_FIFO1 (0x00000001U)
+
+#define CAN_TX_MAILBOX0 (0x00000001U)
+#define CAN_TX_MAILBOX1 (0x00000002U)
+#define CAN_TX_MAILBOX2 (0x00000004U)
+
+#define CAN_FILTERMODE_IDMASK  (0x00000000U)
+#define CAN_FILTERMODE_IDLIST  (0x00000001U)
+#define CAN_FILTERSCALE_16BIT  (0x00000000U)
+#define CAN_FILTERSCALE_32BIT  (0x00000001U)
+#define CAN_FILTER_DISABLE     (0x00000000U)
+#define CAN_FILTER_ENABLE      (0x00000001U)
+#define CAN_FILTER_FIFO0       (0x00000000U)
+#define CAN_FILTER_FIFO1       (0x00000001U)
+
+#define CAN_IT_TX_MAILBOX_EMPTY     (0x00000001U)
+#define CAN_IT_RX_FIFO0_MSG_PENDING (0x00000002U)
+#define CAN_IT_RX_FIFO0_FULL        (0x00000004U)
+#define CAN_IT_RX_FIFO0_OVERRUN     (0x00000008U)
+#define CAN_IT_RX_FIFO1_MSG_PENDING (0x00000010U)
+#define CAN_IT_RX_FIFO1_FULL        (0x00000020U)
+#define CAN_IT_RX_FIFO1_OVERRUN     (0x00000040U)
+
+#define CAN_FLAG_FF0  (0x00000203U)
+#define CAN_FLAG_FOV0 (0x00000204U)
+#define CAN_FLAG_FF1  (0x00000403U)
+#define CAN_FLAG_FOV1 (0x00000404U)
+
+#define CAN_FLAG_MASK (0x000000FFU)
+
+#define __HAL_CAN_GET_FLAG(__HANDLE__, __FLAG__)                                                   \
+    ((((__FLAG__) >> 8U) == 2U)   ? ((((__HANDLE__)->Instance->RF0R) &                             \
+                                    (1UL << ((__FLAG__) & CAN_FLAG_MASK))) != 0U)                  \
+     : (((__FLAG__) >> 8U) == 4U) ? ((((__HANDLE__)->Instance->RF1R) &                             \
+                                      (1UL << ((__FLAG__) & CAN_FLAG_MASK))) != 0U)                \
+                                  : 0U)
+
+#define __HAL_CAN_CLEAR_FLAG(__HANDLE__, __FLAG__)                                                 \
+    ((((__FLAG__) >> 8U) == 2U)   ? (((__HANDLE__)->Instance->RF0R) &=                             \
+                                   ~(1UL << ((__FLAG__) & CAN_FLAG_MASK)))                         \
+     : (((__FLAG__) >> 8U) == 4U) ? (((__HANDLE__)->Instance->RF1R) &=                             \
+                                     ~(1UL << ((__FLAG__) & CAN_FLAG_MASK)))                       \
+                                  : 0U)
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef*       hcan,
+                                       const CAN_FilterTypeDef* sFilterConfig);
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef* hcan);
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef* hcan);
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef* hcan, uint32_t ActiveITs);
+HAL_StatusTypeDef HAL_CAN_DeactivateNotification(CAN_HandleTypeDef* hcan, uint32_t InactiveITs);
+HAL_StatusTypeDef HAL_CAN_RegisterCallback(CAN_HandleTypeDef*        hcan,
+                                           HAL_CAN_CallbackIDTypeDef CallbackID,
+                                           pCAN_CallbackTypeDef      pCallback);
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef*         hcan,
+                                       const CAN_TxHeaderTypeDef* pHeader,
+                                       const uint8_t              aData[],
+                                       uint32_t*                  pTxMailbox);
+uint32_t          HAL_CAN_GetTxMailboxesFreeLevel(const CAN_HandleTypeDef* hcan);
+uint32_t          HAL_CAN_IsTxMessagePending(const CAN_HandleTypeDef* hcan, uint32_t TxMailboxes);
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef*   hcan,
+                                       uint32_t             RxFifo,
+                                       CAN_RxHeaderTypeDef* pHeader,
+                                       uint8_t              aData[]);
+uint32_t          HAL_CAN_GetRxFifoFillLevel(const CAN_HandleTypeDef* hcan, uint32_t RxFifo);
+
+/* ---------------------------------- core ---------------------------------- */
+
+#define __CORTEX_M       (4U)
+#define __NVIC_PRIO_BITS (4U)
+
+typedef enum
+{
+    CAN1_TX_IRQn  = 19,
+    CAN1_RX0_IRQn = 20,
+    CAN1_RX1_IRQn = 21,
+    CAN2_TX_IRQn  = 63,
+    CAN2_RX0_IRQn = 64,
+    CAN2_RX1_IRQn = 65,
+} IRQn_Type;
+
+/**
+ * 虚拟 NVIC：所有中断均已开启，优先级均为 host_nvic_priority，默认与 CAN_IRQ_PRIORITY 相同
+ */
+extern uint32_t host_nvic_priority;
+
+uint32_t NVIC_GetEnableIRQ(IRQn_Type IRQn);
+uint32_t NVIC_GetPriority(IRQn_Type IRQn);
+
+/* ------------------------------- core debug ------------------------------- */
+
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+    volatile uint32_t DHCSR;
+    volatile uint32_t DCRSR;
+    volatile uint32_t DCRDR;
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+/**
+ * 每次访问 DWT 时按虚拟总线时钟刷新 CYCCNT，频率为 SystemCoreClock
+ */
+DWT_Type* host_dwt(void);
+
+extern CoreDebug_Type host_core_debug;
+
+#define DWT       (host_dwt())
+#define CoreDebug (&host_core_debug)
+
+#define DWT_CTRL_CYCCNTENA_Msk     (0x1UL)
+#define CoreDebug_DEMCR_TRCENA_Msk (0x1UL << 24U)
+
+/* ---------------------------------- misc ---------------------------------- */
+
+extern uint32_t SystemCoreClock;
+
+uint32_t HAL_GetTick(void);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+void     Error_Handler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MAIN_H
@@ -0,0 +1,86 @@
+/**
+ * @file    virtual_can.h
+ * @author  syhanjin
+ * @date    2025-10-17
+ * @brief   in-process virtual CAN bus for running the drivers on a PC
+ *
+ * 虚拟总线模拟 bxCAN 的行为：3 个发送邮箱、深度为 3 的接收 FIFO、过滤器组与 FilterMatchIndex，
+ * 因此 bsp/can_driver.c 和各电机驱动可以不做任何修改地在 PC 上运行。
+ *
+ * 使用方法：
+ *  1. 调用 VCAN_Attach 把 CAN_HandleTypeDef 挂到某条虚拟总线上（代替 CubeMX 的 MX_CANx_Init）
+ *  2. 按照在单片机上的方式调用 CAN_Start、DJI_Init 等
+ *  3. 在主循环中调用 VCAN_Poll，完成发送、接收和中断回调
+ *
+ * 模拟电机时，通过 VCAN_SetTxHook 监听控制器发出的帧，再用 VCAN_Inject 把反馈帧放到总线上。
+ * 定义 VCAN_USE_SOCKETCAN 后可以用 VCAN_BindSocketCAN 把虚拟总线桥接到 Linux 的 can/vcan 网口。
+ *
+ * @attention 整个模型是单线程的：中断回调只会在 VCAN_Poll 内执行，且不会在 __disable_irq 期间执行
+ *
+ * --------------------------------------------------------------------------
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Project repository: https://github.com/HITSZ-WTR2026/motor_drivers
+ */
+#ifndef VIRTUAL_CAN_H
+#define VIRTUAL_CAN_H
+
+#include <stdbool.h>
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define VCAN_MAX_BUS_NUM    (4)
+#define VCAN_MAX_NODE_NUM   (4)
+#define VCAN_RX_FIFO_SIZE   (3)
+#define VCAN_TX_MAILBOX_NUM (3)
+
+typedef struct
+{
+    uint32_t id;   ///< StdId 或 ExtId
+    uint32_t ide;  ///< CAN_ID_STD / CAN_ID_EXT
+    uint32_t rtr;  ///< CAN_RTR_DATA / CAN_RTR_REMOTE
+    uint8_t  dlc;  ///< 数据长度
+    uint8_t  data[8];
+} VCAN_Frame_t;
+
+/**
+ * 控制器发出帧时的回调
+ * @param bus 总线编号
+ * @param frame 帧
+ * @param user VCAN_SetTxHook 传入的用户参数
+ */
+typedef void (*VCAN_TxHook_t)(uint32_t bus, const VCAN_Frame_t* frame, void* user);
+
+void     VCAN_Attach(CAN_HandleTypeDef* hcan, CAN_TypeDef* instance, uint32_t bus);
+void     VCAN_SetTxHook(uint32_t bus, VCAN_TxHook_t hook, void* user);
+void     VCAN_Inject(uint32_t bus, const VCAN_Frame_t* frame);
+uint32_t VCAN_Poll(void);
+
+void     VCAN_SetManualClock(bool manual);
+void     VCAN_AdvanceTime(uint32_t us);
+uint32_t VCAN_GetTimeUs(void);
+
+#ifdef VCAN_USE_SOCKETCAN
+bool VCAN_BindSocketCAN(uint32_t bus, const char* ifname);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIRTUAL_CAN_H
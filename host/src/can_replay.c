@@ -0,0 +1,180 @@
+/**
+ * @file    can_replay.c
+ * @author  syhanjin
+ * @date    2025-10-17
+ * @brief   replay CAN_CAPTURE recordings into the drivers on a PC
+ *
+ * --------------------------------------------------------------------------
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Project repository: https://github.com/HITSZ-WTR2026/motor_drivers
+ */
+#include "can_replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "virtual_can.h"
+
+#define RECORD_SIZE  (sizeof(CAN_CaptureRecord_t))
+#define MAGIC_OFFSET (offsetof(CAN_CaptureRecord_t, magic))
+
+/**
+ * 从字节流中解析录制记录
+ *
+ * magic 不匹配时逐字节向后查找，跳过串口传输中丢失或多出的字节
+ * @param data 字节流
+ * @param size 字节数
+ * @param records 输出，至少能容纳 size / sizeof(CAN_CaptureRecord_t) 条记录
+ * @return 解析出的记录数
+ */
+size_t CAN_ReplayParse(const uint8_t* data, const size_t size, CAN_CaptureRecord_t* records)
+{
+    size_t count = 0;
+    size_t pos   = 0;
+    while (pos + RECORD_SIZE <= size)
+    {
+        CAN_CaptureRecord_t record;
+        memcpy(&record, data + pos, RECORD_SIZE);
+        if (data[pos + MAGIC_OFFSET] != CAN_CAPTURE_MAGIC || record.dlc > 8 ||
+            record.bus >= CAN_REPLAY_BUS_NUM)
+        {
+            pos++;
+            continue;
+        }
+        records[count++] = record;
+        pos += RECORD_SIZE;
+    }
+    return count;
+}
+
+/**
+ * 读取录制文件
+ * @param path 文件路径
+ * @param records 输出，由 malloc 分配，使用完毕后需要 free
+ * @return 记录数，失败时返回 0 且 *records 为 NULL
+ */
+size_t CAN_ReplayLoad(const char* path, CAN_CaptureRecord_t** records)
+{
+    *records = NULL;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return 0;
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size <= 0)
+    {
+        fclose(file);
+        return 0;
+    }
+
+    uint8_t* data = malloc((size_t) size);
+    if (data == NULL || fread(data, 1, (size_t) size, file) != (size_t) size)
+    {
+        free(data);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+
+    *records     = malloc((size_t) size / RECORD_SIZE * RECORD_SIZE + RECORD_SIZE);
+    size_t count = *records != NULL ? CAN_ReplayParse(data, (size_t) size, *records) : 0;
+    free(data);
+    if (count == 0)
+    {
+        free(*records);
+        *records = NULL;
+    }
+    return count;
+}
+
+/**
+ * 等待到回放时刻 target (unit: us, 虚拟总线时钟)
+ */
+static void wait_until(const uint32_t target)
+{
+    int32_t remain = (int32_t) (target - VCAN_GetTimeUs());
+    if (remain <= 0)
+        return;
+    // 手动时钟下直接推进时间，实时时钟下睡眠
+    VCAN_AdvanceTime((uint32_t) remain);
+    while ((remain = (int32_t) (target - VCAN_GetTimeUs())) > 0)
+    {
+        const struct timespec ts = { .tv_sec  = remain / 1000000,
+                                     .tv_nsec = (long) (remain % 1000000) * 1000L };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void deliver(const CAN_ReplayConfig_t* config, const CAN_CaptureRecord_t* record)
+{
+    const uint32_t ide = (record->flags & CAN_CAPTURE_FLAG_EXT) ? CAN_ID_EXT : CAN_ID_STD;
+    const uint32_t rtr = (record->flags & CAN_CAPTURE_FLAG_RTR) ? CAN_RTR_REMOTE : CAN_RTR_DATA;
+
+    if (config->callback == NULL)
+    {
+        VCAN_Frame_t frame = { .id = record->id, .ide = ide, .rtr = rtr, .dlc = record->dlc };
+        memcpy(frame.data, record->data, sizeof(frame.data));
+        VCAN_Inject(record->bus, &frame);
+        VCAN_Poll();
+        return;
+    }
+
+    const CAN_RxHeaderTypeDef header = {
+        .StdId     = ide == CAN_ID_STD ? record->id : 0U,
+        .ExtId     = ide == CAN_ID_EXT ? record->id : 0U,
+        .IDE       = ide,
+        .RTR       = rtr,
+        .DLC       = record->dlc,
+        .Timestamp = record->timestamp & 0xFFFFU,
+    };
+    config->callback(config->hcan[record->bus], &header, record->data);
+}
+
+/**
+ * 回放录制记录
+ *
+ * 按记录的时间间隔除以 speed 等待后投递，speed 为 0 时不等待，用于测量解包吞吐量
+ * @param config 回放配置
+ * @param records 记录
+ * @param count 记录数
+ * @return 投递的帧数
+ */
+size_t CAN_Replay(const CAN_ReplayConfig_t*  config,
+                  const CAN_CaptureRecord_t* records,
+                  const size_t               count)
+{
+    if (count == 0)
+        return 0;
+
+    const uint32_t record_start = records[0].timestamp;
+    const uint32_t replay_start = VCAN_GetTimeUs();
+    size_t         delivered    = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const CAN_CaptureRecord_t* record = &records[i];
+        if ((record->flags & CAN_CAPTURE_FLAG_TX) && !config->include_tx)
+            continue;
+        if (config->speed > 0)
+            wait_until(replay_start +
+                       (uint32_t) ((double) (record->timestamp - record_start) / config->speed));
+        deliver(config, record);
+        delivered++;
+    }
+    return delivered;
+}
@@ -0,0 +1,780 @@
+/**
+ * @file    virtual_can.c
+ * @author  syhanjin
+ * @date    2025-10-17
+ * @brief   in-process virtual CAN bus and the HAL CAN subset built on it
+ *
+ * --------------------------------------------------------------------------
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Project repository: https://github.com/HITSZ-WTR2026/motor_drivers
+ */
+#include "virtual_can.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cmsis_compiler.h"
+
+#ifdef VCAN_USE_SOCKETCAN
+#    include <fcntl.h>
+#    include <linux/can.h>
+#    include <net/if.h>
+#    include <sys/ioctl.h>
+#    include <sys/socket.h>
+#    include <unistd.h>
+#endif
+
+#define FILTER_BANK_TOTAL (28)
+#define FMR_FINIT         (0x1UL)
+
+CAN_TypeDef host_can1_regs = { .FMR = 0x2A1C0E01U };
+CAN_TypeDef host_can2_regs;
+
+volatile uint32_t host_primask = 0;
+volatile uint32_t host_basepri = 0;
+volatile uint32_t host_ipsr    = 0;
+
+uint32_t host_nvic_priority = 5U;
+
+uint32_t       SystemCoreClock = 168000000U;
+CoreDebug_Type host_core_debug;
+
+static DWT_Type host_dwt_regs;
+
+typedef struct
+{
+    VCAN_Frame_t frame;
+    uint32_t     fmi;
+    uint32_t     timestamp;
+} VCAN_RxSlot;
+
+typedef struct
+{
+    CAN_HandleTypeDef* hcan;
+    uint32_t           bus;
+    bool               started;
+    uint32_t           active_its;
+
+    bool         tx_pending[VCAN_TX_MAILBOX_NUM];
+    VCAN_Frame_t tx_mailbox[VCAN_TX_MAILBOX_NUM];
+
+    VCAN_RxSlot rx[2][VCAN_RX_FIFO_SIZE];
+    uint32_t    rx_count[2];
+} VCAN_Node;
+
+typedef struct
+{
+    VCAN_TxHook_t hook;
+    void*         user;
+#ifdef VCAN_USE_SOCKETCAN
+    int socket;
+#endif
+} VCAN_Bus;
+
+static VCAN_Node nodes[VCAN_MAX_NODE_NUM];
+static uint32_t  node_count = 0;
+static VCAN_Bus  buses[VCAN_MAX_BUS_NUM];
+
+static bool     manual_clock = false;
+static uint32_t manual_time_us;
+
+/* ---------------------------------- clock --------------------------------- */
+
+void VCAN_SetManualClock(const bool manual)
+{
+    manual_time_us = VCAN_GetTimeUs();
+    manual_clock   = manual;
+}
+
+void VCAN_AdvanceTime(const uint32_t us)
+{
+    manual_time_us += us;
+}
+
+uint32_t VCAN_GetTimeUs(void)
+{
+    if (manual_clock)
+        return manual_time_us;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ((uint64_t) ts.tv_sec * 1000000U + (uint64_t) ts.tv_nsec / 1000U);
+}
+
+uint32_t HAL_GetTick(void)
+{
+    return VCAN_GetTimeUs() / 1000U;
+}
+
+/**
+ * 与 STM32F407 默认时钟树一致：SYSCLK 168 MHz，APB1 42 MHz
+ */
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+    return SystemCoreClock / 4U;
+}
+
+DWT_Type* host_dwt(void)
+{
+    host_dwt_regs.CYCCNT = VCAN_GetTimeUs() * (SystemCoreClock / 1000000U);
+    return &host_dwt_regs;
+}
+
+uint32_t NVIC_GetEnableIRQ(const IRQn_Type IRQn)
+{
+    (void) IRQn;
+    return 1U;
+}
+
+uint32_t NVIC_GetPriority(const IRQn_Type IRQn)
+{
+    (void) IRQn;
+    return host_nvic_priority;
+}
+
+void Error_Handler(void)
+{
+    fprintf(stderr, "Error_Handler() called\n");
+    abort();
+}
+
+/* ------------------------------ node helpers ------------------------------ */
+
+static VCAN_Node* get_node(const CAN_HandleTypeDef* hcan)
+{
+    for (uint32_t i = 0; i < node_count; i++)
+        if (nodes[i].hcan == hcan)
+            return &nodes[i];
+    return NULL;
+}
+
+static void update_fifo_register(const VCAN_Node* node, const uint32_t fifo)
+{
+    volatile uint32_t* rfr   = fifo == CAN_RX_FIFO0 ? &node->hcan->Instance->RF0R
+                                                    : &node->hcan->Instance->RF1R;
+    const uint32_t     count = node->rx_count[fifo];
+
+    *rfr = (*rfr & CAN_RF0R_FOVR0) | count |
+           (count == VCAN_RX_FIFO_SIZE ? CAN_RF0R_FULL0 : 0U);
+}
+
+/**
+ * 把帧转换为 32 位过滤器的比较格式：STID[31:21] EXID[20:3] IDE RTR
+ */
+static uint32_t frame_to_filter32(const VCAN_Frame_t* frame)
+{
+    const uint32_t id = frame->ide == CAN_ID_EXT ? frame->id << 3 : frame->id << 21;
+    return id | frame->ide | frame->rtr;
+}
+
+/**
+ * 把帧转换为 16 位过滤器的比较格式：STID[15:5] RTR IDE EXID[17:15]
+ */
+static uint32_t frame_to_filter16(const VCAN_Frame_t* frame)
+{
+    if (frame->ide == CAN_ID_EXT)
+        return (frame->id >> 18) << 5 | (frame->rtr ? 0x10U : 0U) | 0x08U |
+               ((frame->id >> 15) & 0x7U);
+    return frame->id << 5 | (frame->rtr ? 0x10U : 0U);
+}
+
+/**
+ * 按 bxCAN 的过滤器规则为帧选择 FIFO 和 FilterMatchIndex
+ *
+ * 优先级：32 位过滤器优先于 16 位，列表模式优先于掩码模式，编号小的优先
+ * @param node 接收节点
+ * @param frame 帧
+ * @param fifo 匹配的 FIFO
+ * @param fmi 匹配的 FilterMatchIndex
+ * @return 是否通过过滤器
+ */
+static bool filter_match(const VCAN_Node* node, const VCAN_Frame_t* frame, uint32_t* fifo,
+                         uint32_t* fmi)
+{
+    const CAN_TypeDef* can_ip     = CAN1;
+    const uint32_t     slave      = (can_ip->FMR & CAN_FMR_CAN2SB) >> CAN_FMR_CAN2SB_Pos;
+    const bool         is_can2    = node->hcan->Instance == CAN2;
+    const uint32_t     first_bank = is_can2 ? slave : 0;
+    const uint32_t     last_bank  = is_can2 ? FILTER_BANK_TOTAL : slave;
+
+    const uint32_t reg32 = frame_to_filter32(frame);
+    const uint32_t reg16 = frame_to_filter16(frame);
+
+    uint32_t next_index[2] = { 0, 0 };
+    uint32_t best_rank     = UINT32_MAX;
+
+    for (uint32_t bank = first_bank; bank < last_bank; bank++)
+    {
+        const uint32_t bit       = 1UL << bank;
+        const bool     scale32   = (can_ip->FS1R & bit) != 0;
+        const bool     list      = (can_ip->FM1R & bit) != 0;
+        const uint32_t bank_fifo = (can_ip->FFA1R & bit) != 0 ? CAN_RX_FIFO1 : CAN_RX_FIFO0;
+        const uint32_t fr1       = can_ip->sFilterRegister[bank].FR1;
+        const uint32_t fr2       = can_ip->sFilterRegister[bank].FR2;
+        const uint32_t base      = next_index[bank_fifo];
+
+        next_index[bank_fifo] += scale32 ? (list ? 2 : 1) : (list ? 4 : 2);
+        if ((can_ip->FA1R & bit) == 0)
+            continue;
+
+        int32_t hit = -1;
+        if (scale32 && list)
+            hit = reg32 == fr1 ? 0 : reg32 == fr2 ? 1 : -1;
+        else if (scale32)
+            hit = ((reg32 ^ fr1) & fr2) == 0 ? 0 : -1;
+        else if (list)
+        {
+            const uint32_t ids[4] = { fr1 & 0xFFFFU, fr1 >> 16, fr2 & 0xFFFFU, fr2 >> 16 };
+            for (int32_t i = 0; i < 4 && hit < 0; i++)
+                if (reg16 == ids[i])
+                    hit = i;
+        }
+        else
+        {
+            if (((reg16 ^ fr1) & (fr1 >> 16) & 0xFFFFU) == 0)
+                hit = 0;
+            else if (((reg16 ^ fr2) & (fr2 >> 16) & 0xFFFFU) == 0)
+                hit = 1;
+        }
+        if (hit < 0)
+            continue;
+
+        const uint32_t rank = (scale32 ? 0U : 2U) + (list ? 0U : 1U);
+        if (rank < best_rank)
+        {
+            best_rank = rank;
+            *fifo     = bank_fifo;
+            *fmi      = base + (uint32_t) hit;
+        }
+    }
+    return best_rank != UINT32_MAX;
+}
+
+static void node_receive(VCAN_Node* node, const VCAN_Frame_t* frame)
+{
+    uint32_t fifo, fmi;
+    if (!node->started || !filter_match(node, frame, &fifo, &fmi))
+        return;
+
+    volatile uint32_t* rfr = fifo == CAN_RX_FIFO0 ? &node->hcan->Instance->RF0R
+                                                  : &node->hcan->Instance->RF1R;
+    uint32_t slot = node->rx_count[fifo];
+    if (slot == VCAN_RX_FIFO_SIZE)
+    {
+        *rfr |= CAN_RF0R_FOVR0;
+        // 未锁定时新帧覆盖最后一帧，锁定时丢弃新帧
+        if (node->hcan->Init.ReceiveFifoLocked == ENABLE)
+            return;
+        slot = VCAN_RX_FIFO_SIZE - 1;
+    }
+    else
+    {
+        node->rx_count[fifo]++;
+    }
+    node->rx[fifo][slot] = (VCAN_RxSlot){ .frame     = *frame,
+                                          .fmi       = fmi,
+                                          .timestamp = VCAN_GetTimeUs() & 0xFFFFU };
+    update_fifo_register(node, fifo);
+}
+
+static void bus_deliver(const uint32_t bus, const VCAN_Node* sender, const VCAN_Frame_t* frame)
+{
+    for (uint32_t i = 0; i < node_count; i++)
+        if (&nodes[i] != sender && nodes[i].bus == bus)
+            node_receive(&nodes[i], frame);
+}
+
+/* --------------------------------- bus API -------------------------------- */
+
+/**
+ * 把 CAN 句柄挂到虚拟总线上
+ *
+ * 代替 CubeMX 生成的 MX_CANx_Init，句柄恢复为复位后的 READY 状态
+ * @param hcan can handle
+ * @param instance CAN1 / CAN2
+ * @param bus 总线编号，挂在同一编号上的句柄互相可见
+ */
+void VCAN_Attach(CAN_HandleTypeDef* hcan, CAN_TypeDef* instance, const uint32_t bus)
+{
+    if (bus >= VCAN_MAX_BUS_NUM)
+        Error_Handler();
+    VCAN_Node* node = get_node(hcan);
+    if (node == NULL)
+    {
+        if (node_count >= VCAN_MAX_NODE_NUM)
+            Error_Handler();
+        node = &nodes[node_count++];
+    }
+    memset(node, 0, sizeof(VCAN_Node));
+    memset(hcan, 0, sizeof(CAN_HandleTypeDef));
+    memset(instance, 0, offsetof(CAN_TypeDef, RESERVED0));
+    // 默认 1 Mbit/s：42 MHz / 3 / (1 + 11 + 2)
+    instance->BTR  = (2U << CAN_BTR_BRP_Pos) | (10U << CAN_BTR_TS1_Pos) | (1U << CAN_BTR_TS2_Pos);
+    hcan->Instance = instance;
+    hcan->State    = HAL_CAN_STATE_READY;
+    node->hcan     = hcan;
+    node->bus      = bus;
+#ifdef VCAN_USE_SOCKETCAN
+    if (buses[bus].socket == 0)
+        buses[bus].socket = -1;
+#endif
+}
+
+/**
+ * 设置控制器发帧时的回调，用于实现模拟电机或抓取总线数据
+ * @param bus 总线编号
+ * @param hook 回调，NULL 表示取消
+ * @param user 透传给回调的用户参数
+ */
+void VCAN_SetTxHook(const uint32_t bus, const VCAN_TxHook_t hook, void* user)
+{
+    if (bus >= VCAN_MAX_BUS_NUM)
+        Error_Handler();
+    buses[bus].hook = hook;
+    buses[bus].user = user;
+}
+
+/**
+ * 以外部节点的身份向总线发送一帧
+ *
+ * 帧立即经过各控制器的过滤器进入接收 FIFO，接收中断在下一次 VCAN_Poll 中执行
+ * @param bus 总线编号
+ * @param frame 帧
+ */
+void VCAN_Inject(const uint32_t bus, const VCAN_Frame_t* frame)
+{
+    if (bus >= VCAN_MAX_BUS_NUM)
+        Error_Handler();
+    bus_deliver(bus, NULL, frame);
+}
+
+#ifdef VCAN_USE_SOCKETCAN
+/**
+ * 把虚拟总线桥接到 SocketCAN 网口（如 vcan0）
+ *
+ * 控制器发出的帧会写入网口，VCAN_Poll 时读取网口上的帧并投递到总线
+ * @param bus 总线编号
+ * @param ifname 网口名称
+ * @return 是否成功
+ */
+bool VCAN_BindSocketCAN(const uint32_t bus, const char* ifname)
+{
+    if (bus >= VCAN_MAX_BUS_NUM)
+        return false;
+    const int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0)
+        return false;
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0 ||
+        (addr.can_ifindex = ifr.ifr_ifindex,
+         bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) ||
+        fcntl(fd, F_SETFL, O_NONBLOCK) < 0)
+    {
+        close(fd);
+        return false;
+    }
+    buses[bus].socket = fd;
+    return true;
+}
+
+static void socketcan_write(const uint32_t bus, const VCAN_Frame_t* frame)
+{
+    if (buses[bus].socket <= 0)
+        return;
+    struct can_frame out;
+    memset(&out, 0, sizeof(out));
+    out.can_id = frame->id | (frame->ide == CAN_ID_EXT ? CAN_EFF_FLAG : 0U) |
+                 (frame->rtr == CAN_RTR_REMOTE ? CAN_RTR_FLAG : 0U);
+    out.can_dlc = frame->dlc;
+    memcpy(out.data, frame->data, sizeof(out.data));
+    (void) write(buses[bus].socket, &out, sizeof(out));
+}
+
+static uint32_t socketcan_read(void)
+{
+    uint32_t count = 0;
+    for (uint32_t bus = 0; bus < VCAN_MAX_BUS_NUM; bus++)
+    {
+        if (buses[bus].socket <= 0)
+            continue;
+        struct can_frame in;
+        while (read(buses[bus].socket, &in, sizeof(in)) == (ssize_t) sizeof(in))
+        {
+            VCAN_Frame_t frame = {
+                .ide = (in.can_id & CAN_EFF_FLAG) ? CAN_ID_EXT : CAN_ID_STD,
+                .rtr = (in.can_id & CAN_RTR_FLAG) ? CAN_RTR_REMOTE : CAN_RTR_DATA,
+                .dlc = in.can_dlc > 8 ? 8 : in.can_dlc,
+            };
+            frame.id = in.can_id & (frame.ide == CAN_ID_EXT ? CAN_EFF_MASK : CAN_SFF_MASK);
+            memcpy(frame.data, in.data, sizeof(frame.data));
+            bus_deliver(bus, NULL, &frame);
+            count++;
+        }
+    }
+    return count;
+}
+#endif
+
+static void call_isr(CAN_HandleTypeDef* hcan, void (*callback)(CAN_HandleTypeDef* hcan))
+{
+    if (callback == NULL)
+        return;
+    host_ipsr = 1;
+    callback(hcan);
+    host_ipsr = 0;
+}
+
+/**
+ * 找到优先级最高（ID 最小）的待发送邮箱
+ */
+static int32_t next_tx_mailbox(const VCAN_Node* node)
+{
+    int32_t  best    = -1;
+    uint32_t best_id = UINT32_MAX;
+    for (int32_t i = 0; i < VCAN_TX_MAILBOX_NUM; i++)
+    {
+        if (!node->tx_pending[i])
+            continue;
+        const uint32_t id = frame_to_filter32(&node->tx_mailbox[i]);
+        if (id < best_id)
+        {
+            best    = i;
+            best_id = id;
+        }
+    }
+    return best;
+}
+
+static bool node_transmit(VCAN_Node* node)
+{
+    const int32_t mailbox = next_tx_mailbox(node);
+    if (mailbox < 0)
+        return false;
+
+    const VCAN_Frame_t frame  = node->tx_mailbox[mailbox];
+    node->tx_pending[mailbox] = false;
+    bus_deliver(node->bus, node, &frame);
+#ifdef VCAN_USE_SOCKETCAN
+    socketcan_write(node->bus, &frame);
+#endif
+    if (buses[node->bus].hook != NULL)
+        buses[node->bus].hook(node->bus, &frame, buses[node->bus].user);
+
+    if (node->active_its & CAN_IT_TX_MAILBOX_EMPTY)
+    {
+        CAN_HandleTypeDef* hcan = node->hcan;
+        call_isr(hcan, mailbox == 0   ? hcan->TxMailbox0CompleteCallback
+                       : mailbox == 1 ? hcan->TxMailbox1CompleteCallback
+                                      : hcan->TxMailbox2CompleteCallback);
+    }
+    return true;
+}
+
+static bool node_service_rx(VCAN_Node* node, const uint32_t fifo)
+{
+    const uint32_t it = fifo == CAN_RX_FIFO0 ? CAN_IT_RX_FIFO0_MSG_PENDING
+                                             : CAN_IT_RX_FIFO1_MSG_PENDING;
+    if (node->rx_count[fifo] == 0 || (node->active_its & it) == 0)
+        return false;
+
+    CAN_HandleTypeDef* hcan   = node->hcan;
+    const uint32_t     before = node->rx_count[fifo];
+    call_isr(hcan, fifo == CAN_RX_FIFO0 ? hcan->RxFifo0MsgPendingCallback
+                                        : hcan->RxFifo1MsgPendingCallback);
+    // 回调没有读取数据时直接返回，避免像真实硬件那样卡死在中断里
+    return node->rx_count[fifo] < before;
+}
+
+/**
+ * 推进虚拟总线：发送所有待发邮箱，读取 SocketCAN，执行发送完成与接收中断
+ *
+ * 应在主循环中反复调用。屏蔽中断（__disable_irq 或 BASEPRI 非 0）期间调用不会产生任何动作。
+ * @return 本次在总线上传输和接收处理的帧数
+ */
+uint32_t VCAN_Poll(void)
+{
+    if (host_primask != 0 || host_basepri != 0 || host_ipsr != 0)
+        return 0;
+
+    uint32_t count = 0;
+#ifdef VCAN_USE_SOCKETCAN
+    count += socketcan_read();
+#endif
+    bool progress = true;
+    while (progress)
+    {
+        progress = false;
+        for (uint32_t i = 0; i < node_count; i++)
+        {
+            VCAN_Node* node = &nodes[i];
+            if (!node->started)
+                continue;
+            while (node_transmit(node))
+            {
+                count++;
+                progress = true;
+            }
+            for (uint32_t fifo = CAN_RX_FIFO0; fifo <= CAN_RX_FIFO1; fifo++)
+                while (node_service_rx(node, fifo))
+                    progress = true;
+        }
+    }
+    return count;
+}
+
+/* --------------------------------- HAL CAN -------------------------------- */
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef*       hcan,
+                                       const CAN_FilterTypeDef* sFilterConfig)
+{
+    if (hcan->State != HAL_CAN_STATE_READY && hcan->State != HAL_CAN_STATE_LISTENING)
+    {
+        hcan->ErrorCode |= 1U;
+        return HAL_ERROR;
+    }
+    // 过滤器寄存器位于 CAN1
+    CAN_TypeDef*   can_ip = CAN1;
+    const uint32_t bit    = 1UL << (sFilterConfig->FilterBank & 0x1FU);
+
+    can_ip->FMR |= FMR_FINIT;
+    can_ip->FMR &= ~CAN_FMR_CAN2SB;
+    can_ip->FMR |= sFilterConfig->SlaveStartFilterBank << CAN_FMR_CAN2SB_Pos;
+    can_ip->FA1R &= ~bit;
+
+    CAN_FilterRegister_TypeDef* reg = &can_ip->sFilterRegister[sFilterConfig->FilterBank];
+    if (sFilterConfig->FilterScale == CAN_FILTERSCALE_16BIT)
+    {
+        can_ip->FS1R &= ~bit;
+        reg->FR1 = ((0xFFFFU & sFilterConfig->FilterMaskIdLow) << 16) |
+                   (0xFFFFU & sFilterConfig->FilterIdLow);
+        reg->FR2 = ((0xFFFFU & sFilterConfig->FilterMaskIdHigh) << 16) |
+                   (0xFFFFU & sFilterConfig->FilterIdHigh);
+    }
+    else
+    {
+        can_ip->FS1R |= bit;
+        reg->FR1 = ((0xFFFFU & sFilterConfig->FilterIdHigh) << 16) |
+                   (0xFFFFU & sFilterConfig->FilterIdLow);
+        reg->FR2 = ((0xFFFFU & sFilterConfig->FilterMaskIdHigh) << 16) |
+                   (0xFFFFU & sFilterConfig->FilterMaskIdLow);
+    }
+
+    if (sFilterConfig->FilterMode == CAN_FILTERMODE_IDMASK)
+        can_ip->FM1R &= ~bit;
+    else
+        can_ip->FM1R |= bit;
+
+    if (sFilterConfig->FilterFIFOAssignment == CAN_FILTER_FIFO0)
+        can_ip->FFA1R &= ~bit;
+    else
+        can_ip->FFA1R |= bit;
+
+    if (sFilterConfig->FilterActivation == CAN_FILTER_ENABLE)
+        can_ip->FA1R |= bit;
+
+    can_ip->FMR &= ~FMR_FINIT;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef* hcan)
+{
+    VCAN_Node* node = get_node(hcan);
+    if (node == NULL || hcan->State != HAL_CAN_STATE_READY)
+    {
+        hcan->ErrorCode |= 1U;
+        return HAL_ERROR;
+    }
+    hcan->State   = HAL_CAN_STATE_LISTENING;
+    node->started = true;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef* hcan)
+{
+    VCAN_Node* node = get_node(hcan);
+    if (node == NULL || hcan->State != HAL_CAN_STATE_LISTENING)
+    {
+        hcan->ErrorCode |= 1U;
+        return HAL_ERROR;
+    }
+    hcan->State   = HAL_CAN_STATE_READY;
+    node->started = false;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef* hcan, const uint32_t ActiveITs)
+{
+    VCAN_Node* node = get_node(hcan);
+    if (node == NULL)
+        return HAL_ERROR;
+    node->active_its |= ActiveITs;
+    hcan->Instance->IER  = node->active_its;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_DeactivateNotification(CAN_HandleTypeDef* hcan,
+                                                 const uint32_t     InactiveITs)
+{
+    VCAN_Node* node = get_node(hcan);
+    if (node == NULL)
+        return HAL_ERROR;
+    node->active_its &= ~InactiveITs;
+    hcan->Instance->IER  = node->active_its;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_RegisterCallback(CAN_HandleTypeDef*              hcan,
+                                           const HAL_CAN_CallbackIDTypeDef CallbackID,
+                                           const pCAN_CallbackTypeDef      pCallback)
+{
+    if (pCallback == NULL)
+        return HAL_ERROR;
+    switch (CallbackID)
+    {
+    case HAL_CAN_TX_MAILBOX0_COMPLETE_CB_ID:
+        hcan->TxMailbox0CompleteCallback = pCallback;
+        break;
+    case HAL_CAN_TX_MAILBOX1_COMPLETE_CB_ID:
+        hcan->TxMailbox1CompleteCallback = pCallback;
+        break;
+    case HAL_CAN_TX_MAILBOX2_COMPLETE_CB_ID:
+        hcan->TxMailbox2CompleteCallback = pCallback;
+        break;
+    case HAL_CAN_TX_MAILBOX0_ABORT_CB_ID:
+        hcan->TxMailbox0AbortCallback = pCallback;
+        break;
+    case HAL_CAN_TX_MAILBOX1_ABORT_CB_ID:
+        hcan->TxMailbox1AbortCallback = pCallback;
+        break;
+    case HAL_CAN_TX_MAILBOX2_ABORT_CB_ID:
+        hcan->TxMailbox2AbortCallback = pCallback;
+        break;
+    case HAL_CAN_RX_FIFO0_MSG_PENDING_CB_ID:
+        hcan->RxFifo0MsgPendingCallback = pCallback;
+        break;
+    case HAL_CAN_RX_FIFO0_FULL_CB_ID:
+        hcan->RxFifo0FullCallback = pCallback;
+        break;
+    case HAL_CAN_RX_FIFO1_MSG_PENDING_CB_ID:
+        hcan->RxFifo1MsgPendingCallback = pCallback;
+        break;
+    case HAL_CAN_RX_FIFO1_FULL_CB_ID:
+        hcan->RxFifo1FullCallback = pCallback;
+        break;
+    case HAL_CAN_ERROR_CB_ID:
+        hcan->ErrorCallback = pCallback;
+        break;
+    default:
+        return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef*         hcan,
+                                       const CAN_TxHeaderTypeDef* pHeader,
+                                       const uint8_t              aData[],
+                                       uint32_t*                  pTxMailbox)
+{
+    VCAN_Node* node = get_node(hcan);
+    if (node == NULL || hcan->State != HAL_CAN_STATE_LISTENING)
+    {
+        hcan->ErrorCode |= 1U;
+        return HAL_ERROR;
+    }
+    for (uint32_t i = 0; i < VCAN_TX_MAILBOX_NUM; i++)
+    {
+        if (node->tx_pending[i])
+            continue;
+        VCAN_Frame_t* frame = &node->tx_mailbox[i];
+        frame->ide          = pHeader->IDE;
+        frame->rtr          = pHeader->RTR;
+        frame->id           = pHeader->IDE == CAN_ID_EXT ? pHeader->ExtId : pHeader->StdId;
+        frame->dlc          = (uint8_t) (pHeader->DLC > 8 ? 8 : pHeader->DLC);
+        memset(frame->data, 0, sizeof(frame->data));
+        memcpy(frame->data, aData, frame->dlc);
+        node->tx_pending[i] = true;
+        if (pTxMailbox != NULL)
+            *pTxMailbox = 1UL << i;
+        return HAL_OK;
+    }
+    hcan->ErrorCode |= 1U;
+    return HAL_ERROR;
+}
+
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(const CAN_HandleTypeDef* hcan)
+{
+    const VCAN_Node* node = get_node(hcan);
+    if (node == NULL || hcan->State != HAL_CAN_STATE_LISTENING)
+        return 0;
+    uint32_t level = 0;
+    for (uint32_t i = 0; i < VCAN_TX_MAILBOX_NUM; i++)
+        if (!node->tx_pending[i])
+            level++;
+    return level;
+}
+
+uint32_t HAL_CAN_IsTxMessagePending(const CAN_HandleTypeDef* hcan, const uint32_t TxMailboxes)
+{
+    const VCAN_Node* node = get_node(hcan);
+    if (node == NULL || hcan->State != HAL_CAN_STATE_LISTENING)
+        return 0;
+    for (uint32_t i = 0; i < VCAN_TX_MAILBOX_NUM; i++)
+        if ((TxMailboxes & 1UL << i) != 0 && node->tx_pending[i])
+            return 1;
+    return 0;
+}
+
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef*   hcan,
+                                       const uint32_t       RxFifo,
+                                       CAN_RxHeaderTypeDef* pHeader,
+                                       uint8_t              aData[])
+{
+    VCAN_Node* node = get_node(hcan);
+    if (node == NULL || RxFifo > CAN_RX_FIFO1 || node->rx_count[RxFifo] == 0)
+    {
+        hcan->ErrorCode |= 1U;
+        return HAL_ERROR;
+    }
+    const VCAN_RxSlot* slot = &node->rx[RxFifo][0];
+    pHeader->IDE              = slot->frame.ide;
+    pHeader->RTR              = slot->frame.rtr;
+    pHeader->StdId            = slot->frame.ide == CAN_ID_STD ? slot->frame.id : 0U;
+    pHeader->ExtId            = slot->frame.ide == CAN_ID_EXT ? slot->frame.id : 0U;
+    pHeader->DLC              = slot->frame.dlc;
+    pHeader->Timestamp        = slot->timestamp;
+    pHeader->FilterMatchIndex = slot->fmi;
+    memcpy(aData, slot->frame.data, 8);
+
+    node->rx_count[RxFifo]--;
+    memmove(&node->rx[RxFifo][0], &node->rx[RxFifo][1],
+            sizeof(VCAN_RxSlot) * node->rx_count[RxFifo]);
+    update_fifo_register(node, RxFifo);
+    return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetRxFifoFillLevel(const CAN_HandleTypeDef* hcan, const uint32_t RxFifo)
+{
+    const VCAN_Node* node = get_node(hcan);
+    if (node == NULL || RxFifo > CAN_RX_FIFO1)
+        return 0;
+    return node->rx_count[RxFifo];
+}